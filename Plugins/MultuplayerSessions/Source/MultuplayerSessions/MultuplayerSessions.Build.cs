@@ -44,6 +44,7 @@ public class MultuplayerSessions : ModuleRules
 				"Slate",
 				"SlateCore",
 				"UMG",
+				"Icmp",
 				// ... add private dependencies that you statically link with here ...	
 			}
 			);
@@ -4,6 +4,7 @@
 #include "Menu1.h"
 
 #include "MultiplayerSessionsSubsystem.h"
+#include "MultiplayerPreloadSubsystem.h"
 #include "OnlineSubsystem.h"
 #include "Components/Button.h"
 
@@ -39,13 +40,20 @@ void UMenu1::MenuSetup(int32 NumberOfPublicConnections ,FString TypeOfMatch)
 		MultiplayerSessionsSubsystem->MultiplayerOnCreateSessionComplete.AddDynamic(this,&ThisClass::OnCreateSession);
 		MultiplayerSessionsSubsystem->MultiplayerOnFindSessionComplete.AddUObject(this,&ThisClass::OnFindSession);
 		MultiplayerSessionsSubsystem->MultiplayerOnJoinSessionComplete.AddUObject(this,&ThisClass::OnJoinSession);
+		MultiplayerSessionsSubsystem->MultiplayerOnSessionSearchDelta.AddUObject(this,&ThisClass::OnSessionSearchDelta);
+		MultiplayerSessionsSubsystem->MultiplayerOnSessionsRanked.AddUObject(this,&ThisClass::OnSessionsRanked);
+		MultiplayerSessionsSubsystem->MultiplayerOnJoinPipelineComplete.AddUObject(this,&ThisClass::OnJoinPipelineComplete);
+		MultiplayerSessionsSubsystem->MultiplayerOnRejoinComplete.AddUObject(this,&ThisClass::OnRejoinComplete);
 		MultiplayerSessionsSubsystem->MultiplayerOnDestroySessionComplete.AddDynamic(this,&ThisClass::OnDestroySession);
 		MultiplayerSessionsSubsystem->MultiplayerOnStartSessionComplete.AddDynamic(this,&ThisClass::OnStartSession);
+		//菜单显示期间后台刷新会话列表，MenuTearDown时关掉
+		MultiplayerSessionsSubsystem->SetSearchCacheBackgroundRefresh(true);
 	}
 }
 
 void UMenu1::HostButtonClicked()
 {
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMenu1::HostButtonClicked);
 	if(GEngine)
 	{
 		GEngine->AddOnScreenDebugMessage(
@@ -55,6 +63,7 @@ void UMenu1::HostButtonClicked()
 			FString(TEXT("HostButtonClicked!"))
 		);
 	}
+	PrefetchLobby();
 	if(MultiplayerSessionsSubsystem)
 	{
 		//创建会话后，就立马跳转到关卡。
@@ -65,6 +74,7 @@ void UMenu1::HostButtonClicked()
 
 void UMenu1::JoinButtonClicked()
 {
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMenu1::JoinButtonClicked);
 	if(GEngine)
 	{
 		GEngine->AddOnScreenDebugMessage(
@@ -74,13 +84,60 @@ void UMenu1::JoinButtonClicked()
 			FString(TEXT("JoinButtonClicked!"))
 		);
 	}
+	PrefetchLobby();
 	if(MultiplayerSessionsSubsystem)
 	{
-		MultiplayerSessionsSubsystem->FindSession(10000);
+		//这次点击之后的找房、测速、加入、跳转都记在同一个加入ID下
+		MultiplayerSessionsSubsystem->BeginJoinTrace(TEXT("JoinButton"));
+		bJoinRequested = false;
+		//断线或崩溃前的那一局还在时直接连回去，不用再走一遍找房
+		bRejoinRequested = MultiplayerSessionsSubsystem->CanRejoin() && MultiplayerSessionsSubsystem->Rejoin();
+		if (bRejoinRequested)
+		{
+			return;
+		}
+		FindMatchingSessions();
 	}
 	
 }
 
+void UMenu1::FindMatchingSessions()
+{
+	//MatchType和版本号直接放进查询条件，返回的都是可以加入的会话
+	FMultiplayerSessionSearchFilter Filter;
+	Filter.MatchType = MatchType;
+	Filter.MinOpenSlots = 1;
+	Filter.BuildVersion = UMultiplayerSessionsSubsystem::GetLocalBuildVersion();
+	MultiplayerSessionsSubsystem->FindSession(10000, Filter);
+}
+
+void UMenu1::OnRejoinComplete(bool bWasSuccessful)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMenu1::OnRejoinComplete);
+	const bool bWasRequested = bRejoinRequested;
+	bRejoinRequested = false;
+	if (!bWasSuccessful && bWasRequested && MultiplayerSessionsSubsystem)
+	{
+		bJoinRequested = false;
+		FindMatchingSessions();
+	}
+}
+
+void UMenu1::PrefetchLobby()
+{
+	UGameInstance* GameInstance = GetGameInstance();
+	UMultiplayerPreloadSubsystem* PreloadSubsystem = GameInstance ? GameInstance->GetSubsystem<UMultiplayerPreloadSubsystem>() : nullptr;
+	if (PreloadSubsystem == nullptr)
+	{
+		return;
+	}
+	PreloadSubsystem->PreloadPackage(PathToLobby);
+	for (const FString& PackageName : LobbyPrefetchPackages)
+	{
+		PreloadSubsystem->PreloadPackage(PackageName);
+	}
+}
+
 bool UMenu1::Initialize()
 {
 	if(!Super::Initialize())return false;
@@ -98,6 +155,10 @@ bool UMenu1::Initialize()
 void UMenu1::MenuTearDown()
 {
 	RemoveFromParent();
+	if(MultiplayerSessionsSubsystem)
+	{
+		MultiplayerSessionsSubsystem->SetSearchCacheBackgroundRefresh(false);
+	}
 	UWorld* World = GetWorld();
 	if(World)
 	{
@@ -119,6 +180,7 @@ void UMenu1::OnLevelRemovedFromWorld(ULevel* InLevel, UWorld* InWorld)
 
 void UMenu1::OnCreateSession(bool bWasSuccessful)
 {
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMenu1::OnCreateSession);
 	if(bWasSuccessful)
 	{
 		if(GEngine)
@@ -130,10 +192,14 @@ void UMenu1::OnCreateSession(bool bWasSuccessful)
 				FString(TEXT("Session Created Successfully!"))
 			);
 		}
-		UWorld* World = GetWorld();
-		if(World)
+		if(MultiplayerSessionsSubsystem)
 		{
-			World->ServerTravel("/Game/ThirdPersonCPP/Maps/Lobby?listen");
+			UMultiplayerPreloadSubsystem* PreloadSubsystem = GetGameInstance()->GetSubsystem<UMultiplayerPreloadSubsystem>();
+			if(PreloadSubsystem)
+			{
+				PreloadSubsystem->NotifyTravelStarted(PathToLobby);
+			}
+			MultiplayerSessionsSubsystem->ServerTravel(PathToLobby + TEXT("?listen"));
 		}
 	}
 	else
@@ -153,39 +219,107 @@ void UMenu1::OnCreateSession(bool bWasSuccessful)
 
 void UMenu1::OnFindSession(const TArray<FOnlineSessionSearchResult>& SearchResults, bool bWasSuccessful)
 {
-	if (MultiplayerSessionsSubsystem == nullptr)
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMenu1::OnFindSession);
+	//重连时的搜索只找原来那一局，由子系统自己处理
+	if (MultiplayerSessionsSubsystem == nullptr || bJoinRequested || MultiplayerSessionsSubsystem->IsRejoinInProgress())
 	{
 		return;
 	}
-	for (auto Result : SearchResults)
+	RankCandidateSessions(SearchResults);
+}
+
+void UMenu1::OnSessionSearchDelta(const TArray<FOnlineSessionSearchResult>& AddedResults, const TArray<FString>& RemovedSessionIds, const TArray<FOnlineSessionSearchResult>& ChangedResults)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMenu1::OnSessionSearchDelta);
+	//缓存里没有合适的会话时，后台刷新出来的新会话或有变化的会话可能就是我们要的
+	if (MultiplayerSessionsSubsystem == nullptr || bJoinRequested || MultiplayerSessionsSubsystem->IsRejoinInProgress())
 	{
-		FString SettingsValue;
-		Result.Session.SessionSettings.Get(FName("MatchType"), SettingsValue);
-		if (SettingsValue == MatchType)
-		{
-			MultiplayerSessionsSubsystem->JoinSession(Result);
-			return;
-		}
+		return;
 	}
+	TArray<FOnlineSessionSearchResult> Candidates;
+	Candidates.Reserve(AddedResults.Num() + ChangedResults.Num());
+	Candidates.Append(AddedResults);
+	Candidates.Append(ChangedResults);
+	RankCandidateSessions(Candidates);
 }
 
-void UMenu1::OnJoinSession(EOnJoinSessionCompleteResult::Type Result)
+bool UMenu1::RankCandidateSessions(const TArray<FOnlineSessionSearchResult>& SearchResults)
 {
-	IOnlineSubsystem* Subsystem = IOnlineSubsystem::Get();
-	if (Subsystem)
+	//结果已经由子系统按MatchType过滤过了，不再取第一个，而是测速后加入延迟最低的
+	if (SearchResults.Num() == 0)
 	{
-		IOnlineSessionPtr SessionInterface = Subsystem->GetSessionInterface();
-		if (SessionInterface.IsValid())
-		{
-			FString Address;
-			SessionInterface->GetResolvedConnectString(NAME_GameSession, Address);
+		return false;
+	}
+	//排序可能在RankSessions返回前就完成并回调OnSessionsRanked，先标记再发起
+	bJoinRequested = true;
+	if (!MultiplayerSessionsSubsystem->RankSessions(SearchResults, &RankRequestId))
+	{
+		bJoinRequested = false;
+		return false;
+	}
+	return true;
+}
 
-			APlayerController* PlayerController = GetGameInstance()->GetFirstLocalPlayerController();
-			if (PlayerController)
-			{
-				PlayerController->ClientTravel(Address, ETravelType::TRAVEL_Absolute);
-			}
-		}
+void UMenu1::OnSessionsRanked(int32 RequestId, const TArray<FMultiplayerRankedSession>& RankedSessions)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMenu1::OnSessionsRanked);
+	//菜单没有在等排序结果，或者是自动加入、基准测试发起的那一轮
+	if (MultiplayerSessionsSubsystem == nullptr || !bJoinRequested || RankRequestId == 0 || RequestId < RankRequestId)
+	{
+		return;
+	}
+	if (RequestId > RankRequestId)
+	{
+		//菜单那一轮被后发起的排序取消了，等下次刷新重新排
+		RankRequestId = 0;
+		bJoinRequested = false;
+		return;
+	}
+	RankRequestId = 0;
+	//从延迟最低的开始逐个尝试，加入成功后子系统直接跳转到大厅
+	if (RankedSessions.Num() == 0 || !MultiplayerSessionsSubsystem->JoinRankedSessions(RankedSessions, PathToLobby))
+	{
+		//没有可加入的会话，继续等后台刷新
+		bJoinRequested = false;
+	}
+}
+
+void UMenu1::OnJoinPipelineComplete(bool bWasSuccessful, int32 Attempts, double SecondsToJoin)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMenu1::OnJoinPipelineComplete);
+	if (bWasSuccessful)
+	{
+		return;
+	}
+	//所有候选都失败了，缓存里的列表已经不可信，下次点Join重新搜索
+	bJoinRequested = false;
+	if (MultiplayerSessionsSubsystem)
+	{
+		MultiplayerSessionsSubsystem->InvalidateSearchCache();
+	}
+	if(GEngine)
+	{
+		GEngine->AddOnScreenDebugMessage(
+			-1,
+			15.f,
+			FColor::Red,
+			FString::Printf(TEXT("Join Failed after %d attempts!"), Attempts)
+		);
+	}
+}
+
+void UMenu1::OnJoinSession(EOnJoinSessionCompleteResult::Type Result)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMenu1::OnJoinSession);
+	//跳转由子系统的加入流水线负责，这里只提示单次失败，流水线会接着尝试下一个会话
+	if (Result != EOnJoinSessionCompleteResult::Success && GEngine)
+	{
+		GEngine->AddOnScreenDebugMessage(
+			-1,
+			5.f,
+			FColor::Yellow,
+			FString::Printf(TEXT("Join Session Failed: %s"), LexToString(Result))
+		);
 	}
 }
 
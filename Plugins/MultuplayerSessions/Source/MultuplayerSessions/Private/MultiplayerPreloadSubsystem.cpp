@@ -0,0 +1,144 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MultiplayerPreloadSubsystem.h"
+
+#include "MultiplayerSessionsStats.h"
+#include "UObject/UObjectGlobals.h"
+#include "Engine/World.h"
+#include "Misc/PackageName.h"
+#include "Misc/CommandLine.h"
+#include "UObject/UObjectHash.h"
+
+void UMultiplayerPreloadSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+	bPreloadDisabled = FParse::Param(FCommandLine::Get(), TEXT("NoMapPreload"));
+	PostLoadMapHandle = FCoreUObjectDelegates::PostLoadMapWithWorld.AddUObject(this, &ThisClass::OnPostLoadMapWithWorld);
+}
+
+void UMultiplayerPreloadSubsystem::Deinitialize()
+{
+	FCoreUObjectDelegates::PostLoadMapWithWorld.Remove(PostLoadMapHandle);
+	ReleaseAll();
+	Super::Deinitialize();
+}
+
+void UMultiplayerPreloadSubsystem::PreloadPackage(const FString& PackageName)
+{
+	if (bPreloadDisabled || PackageName.IsEmpty() || !FPackageName::IsValidLongPackageName(PackageName))
+	{
+		return;
+	}
+	const FName PackageFName(*PackageName);
+	FPreloadEntry* Entry = PreloadEntries.Find(PackageFName);
+	if (Entry == nullptr)
+	{
+		Entry = &PreloadEntries.Add(PackageFName);
+	}
+	else if (!Entry->bFailed || Entry->Attempts >= MaxPreloadAttempts)
+	{
+		//正在加载、已经加载好了，或者已经试够了次数
+		return;
+	}
+	StartLoad(PackageFName, *Entry);
+}
+
+void UMultiplayerPreloadSubsystem::StartLoad(const FName& PackageName, FPreloadEntry& Entry)
+{
+	Entry.StartTime = FPlatformTime::Seconds();
+	Entry.FinishTime = 0.0;
+	Entry.bLoaded = false;
+	Entry.bFailed = false;
+	++Entry.Attempts;
+	INC_DWORD_STAT(STAT_MPS_PreloadCount);
+	LoadPackageAsync(PackageName.ToString(), FLoadPackageAsyncDelegate::CreateUObject(this, &ThisClass::OnPackageLoaded));
+}
+
+bool UMultiplayerPreloadSubsystem::IsPackagePreloaded(const FString& PackageName) const
+{
+	const FPreloadEntry* Entry = PreloadEntries.Find(FName(*PackageName));
+	return Entry && Entry->bLoaded;
+}
+
+void UMultiplayerPreloadSubsystem::OnPackageLoaded(const FName& PackageName, UPackage* LoadedPackage, EAsyncLoadingResult::Type Result)
+{
+	FPreloadEntry* Entry = PreloadEntries.Find(PackageName);
+	if (Entry == nullptr)
+	{
+		//加载完成前已经被释放了
+		return;
+	}
+	Entry->FinishTime = FPlatformTime::Seconds();
+	if (Result == EAsyncLoadingResult::Succeeded && LoadedPackage)
+	{
+		Entry->bLoaded = true;
+		//地图包引用世界（世界再引用关卡和Actor），其他包引用里面的资源
+		if (UWorld* World = UWorld::FindWorldInPackage(LoadedPackage))
+		{
+			PreloadedObjects.AddUnique(World);
+		}
+		else
+		{
+			ForEachObjectWithOuter(LoadedPackage, [this](UObject* Object)
+			{
+				if (Object->HasAnyFlags(RF_Public))
+				{
+					PreloadedObjects.AddUnique(Object);
+				}
+			}, false);
+		}
+		return;
+	}
+	Entry->bFailed = true;
+	UE_LOG(LogTemp, Warning, TEXT("MultiplayerSessions: failed to preload %s (attempt %d/%d)"), *PackageName.ToString(), Entry->Attempts, MaxPreloadAttempts);
+	if (Entry->Attempts < MaxPreloadAttempts)
+	{
+		StartLoad(PackageName, *Entry);
+	}
+}
+
+void UMultiplayerPreloadSubsystem::NotifyTravelStarted(const FString& PackageName)
+{
+	TravelDestination = FName(*PackageName);
+	TravelStartTime = FPlatformTime::Seconds();
+	const FPreloadEntry* Entry = PreloadEntries.Find(TravelDestination);
+	bTravelDestinationPreloaded = Entry && Entry->bLoaded;
+	if (Entry == nullptr || Entry->bFailed)
+	{
+		return;
+	}
+	//这是跳转之前已经在后台做完的加载时间，不等于省下的时间；省下多少要和 -NoMapPreload 跑出来的跳转耗时对比
+	const double EndTime = Entry->bLoaded ? Entry->FinishTime : TravelStartTime;
+	const float AheadMs = static_cast<float>((EndTime - Entry->StartTime) * 1000.0);
+	SET_FLOAT_STAT(STAT_MPS_PreloadAheadMs, AheadMs);
+	CSV_CUSTOM_STAT(MultuplayerSessions, PreloadAheadMs, AheadMs, ECsvCustomStatOp::Set);
+	UE_LOG(LogTemp, Log, TEXT("MultiplayerSessions: travel to %s started with %.1f ms of loading done ahead (%s)"),
+		*PackageName, AheadMs, Entry->bLoaded ? TEXT("fully preloaded") : TEXT("still loading"));
+}
+
+void UMultiplayerPreloadSubsystem::ReleaseAll()
+{
+	PreloadEntries.Reset();
+	PreloadedObjects.Reset();
+}
+
+void UMultiplayerPreloadSubsystem::OnPostLoadMapWithWorld(UWorld* LoadedWorld)
+{
+	//无缝跳转中间还会加载过渡地图，要等到目标地图加载完，新世界自己持有地图之后才放掉引用
+	if (LoadedWorld == nullptr || TravelDestination.IsNone())
+	{
+		return;
+	}
+	const FString LoadedPackageName = UWorld::RemovePIEPrefix(LoadedWorld->GetOutermost()->GetName());
+	if (FName(*LoadedPackageName) == TravelDestination)
+	{
+		//预加载和 -NoMapPreload 各跑一次，对比这一行的耗时就是真正省下的时间
+		const double TravelLoadMs = (FPlatformTime::Seconds() - TravelStartTime) * 1000.0;
+		CSV_CUSTOM_STAT(MultuplayerSessions, TravelLoadMs, static_cast<float>(TravelLoadMs), ECsvCustomStatOp::Set);
+		UE_LOG(LogTemp, Log, TEXT("MultiplayerSessions: travel to %s loaded in %.1f ms (%s)"), *LoadedPackageName, TravelLoadMs,
+			bPreloadDisabled ? TEXT("cold, -NoMapPreload") : bTravelDestinationPreloaded ? TEXT("preloaded") : TEXT("not fully preloaded"));
+		TravelDestination = NAME_None;
+		ReleaseAll();
+	}
+}
@@ -0,0 +1,371 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MultiplayerSessionsSubsystem.h"
+#include "MultiplayerSimulatedSessionInterface.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "TimerManager.h"
+#include "UObject/StrongObjectPtr.h"
+
+namespace MultiplayerSessionsBenchmarks
+{
+	static double MillisecondsSince(double StartSeconds)
+	{
+		return (FPlatformTime::Seconds() - StartSeconds) * 1000.0;
+	}
+
+	static double PhysicalMBSince(uint64 StartPhysical)
+	{
+		return (static_cast<int64>(FPlatformMemory::GetStats().UsedPhysical) - static_cast<int64>(StartPhysical)) / (1024.0 * 1024.0);
+	}
+
+	// 压测用单独的子系统实例，不碰游戏实例上那个：菜单和自动加入绑在它的委托上，换接口或者广播结果都会让它们跟着动
+	// 这个实例没有Initialize，不挂地图加载和断线的回调，也不会自动加入
+	static UMultiplayerSessionsSubsystem* CreateIsolatedSubsystem(UGameInstance& GameInstance, const IOnlineSessionPtr& Backend)
+	{
+		UMultiplayerSessionsSubsystem* Subsystem = NewObject<UMultiplayerSessionsSubsystem>(&GameInstance, NAME_None, RF_Transient);
+		if (!Subsystem->UseSessionInterface(Backend))
+		{
+			UE_LOG(LogTemp, Error, TEXT("MultiplayerSessions.Benchmark: the isolated subsystem rejected the simulated backend"));
+			Subsystem->MarkPendingKill();
+			return nullptr;
+		}
+		return Subsystem;
+	}
+
+	static void DestroyIsolatedSubsystem(UGameInstance& GameInstance, UMultiplayerSessionsSubsystem* Subsystem)
+	{
+		Subsystem->Deinitialize();
+		GameInstance.GetTimerManager().ClearAllTimersForObject(Subsystem);
+		Subsystem->MarkPendingKill();
+	}
+
+	// 对一个规模跑一遍 生成 -> 找房 -> 过滤 -> 排序 -> 加入，模拟后端延迟为0，回调都在调用里同步完成
+	static void RunBenchmark(UGameInstance& GameInstance, int32 NumSessions, float JoinFailureRate, int32 NumJoins)
+	{
+		FMultiplayerSimulatedSessionParams Params;
+		Params.NumSessions = NumSessions;
+
+		const uint64 BackendStartPhysical = FPlatformMemory::GetStats().UsedPhysical;
+		double StartTime = FPlatformTime::Seconds();
+		TSharedRef<FMultiplayerSimulatedSessionInterface, ESPMode::ThreadSafe> Backend = MakeShared<FMultiplayerSimulatedSessionInterface, ESPMode::ThreadSafe>(Params);
+		const double GenerateMs = MillisecondsSince(StartTime);
+		const double BackendMB = PhysicalMBSince(BackendStartPhysical);
+
+		UMultiplayerSessionsSubsystem* IsolatedSubsystem = CreateIsolatedSubsystem(GameInstance, Backend);
+		if (IsolatedSubsystem == nullptr)
+		{
+			return;
+		}
+		UMultiplayerSessionsSubsystem& Subsystem = *IsolatedSubsystem;
+
+		FMultiplayerSessionSearchFilter Filter;
+		Filter.MatchType = TEXT("FreeForAll");
+		Filter.MinOpenSlots = 1;
+		Filter.BuildVersion = UMultiplayerSessionsSubsystem::GetLocalBuildVersion();
+
+		// 找房：包括后端过滤、子系统的二次检查和移进缓存
+		int32 NumFound = 0;
+		FDelegateHandle FindHandle = Subsystem.MultiplayerOnFindSessionComplete.AddLambda([&NumFound](const TArray<FOnlineSessionSearchResult>& Results, bool bWasSuccessful)
+		{
+			NumFound = Results.Num();
+		});
+		const int32 NumFindRuns = 5;
+		const uint64 CacheStartPhysical = FPlatformMemory::GetStats().UsedPhysical;
+		StartTime = FPlatformTime::Seconds();
+		for (int32 Run = 0; Run < NumFindRuns; ++Run)
+		{
+			Subsystem.InvalidateSearchCache();
+			Subsystem.FindSession(NumSessions, Filter);
+		}
+		const double FindMs = MillisecondsSince(StartTime) / NumFindRuns;
+		const double CacheMB = PhysicalMBSince(CacheStartPhysical);
+		StartTime = FPlatformTime::Seconds();
+		Subsystem.FindSession(NumSessions, Filter);
+		const double CachedFindMs = MillisecondsSince(StartTime);
+		Subsystem.MultiplayerOnFindSessionComplete.Remove(FindHandle);
+
+		// 过滤：对全部广播的会话做一遍客户端的检查
+		int32 NumMatches = 0;
+		StartTime = FPlatformTime::Seconds();
+		for (const FOnlineSessionSearchResult& Session : Backend->GetAdvertisedSessions())
+		{
+			if (Filter.Matches(Session))
+			{
+				++NumMatches;
+			}
+		}
+		const double FilterNs = MillisecondsSince(StartTime) * 1e6 / FMath::Max(1, NumSessions);
+
+		// 排序：模拟会话没有可ping的地址，测的是QoS阶段本身和排序的开销
+		const TArray<FOnlineSessionSearchResult> Candidates = Subsystem.GetCachedSearchResults();
+		int32 NumRanked = 0;
+		FDelegateHandle RankHandle = Subsystem.MultiplayerOnSessionsRanked.AddLambda([&NumRanked](int32 RequestId, const TArray<FMultiplayerRankedSession>& RankedSessions)
+		{
+			NumRanked = RankedSessions.Num();
+		});
+		StartTime = FPlatformTime::Seconds();
+		Subsystem.RankSessions(Candidates);
+		const double RankMs = MillisecondsSince(StartTime);
+		Subsystem.MultiplayerOnSessionsRanked.Remove(RankHandle);
+
+		// 加入：每次都要先销毁上一次加入的会话，测的是整条操作链
+		Backend->SetFailureRate(JoinFailureRate);
+		int32 NumJoinSucceeded = 0;
+		int32 NumJoinFailed = 0;
+		FDelegateHandle JoinHandle = Subsystem.MultiplayerOnJoinSessionComplete.AddLambda([&NumJoinSucceeded, &NumJoinFailed](EOnJoinSessionCompleteResult::Type Result)
+		{
+			if (Result == EOnJoinSessionCompleteResult::Success)
+			{
+				++NumJoinSucceeded;
+			}
+			else
+			{
+				++NumJoinFailed;
+			}
+		});
+		const int32 JoinCount = FMath::Min(NumJoins, Candidates.Num());
+		StartTime = FPlatformTime::Seconds();
+		for (int32 Index = 0; Index < JoinCount; ++Index)
+		{
+			Subsystem.JoinSession(Candidates[Index]);
+		}
+		const double JoinMs = MillisecondsSince(StartTime);
+		Subsystem.MultiplayerOnJoinSessionComplete.Remove(JoinHandle);
+		Subsystem.DestorySession();
+		DestroyIsolatedSubsystem(GameInstance, IsolatedSubsystem);
+
+		UE_LOG(LogTemp, Display, TEXT("BenchmarkSessions %d sessions: generate %.1f ms, find %.2f ms (%d results, %.0f sessions/s), cached find %.3f ms, filter %.1f ns/session (%d match), rank %.2f ms (%d), join %.3f ms/op (%d ok, %d failed), backend %.1f MB, cache %.1f MB"),
+			NumSessions, GenerateMs,
+			FindMs, NumFound, FindMs > 0.0 ? NumSessions / (FindMs / 1000.0) : 0.0,
+			CachedFindMs,
+			FilterNs, NumMatches,
+			RankMs, NumRanked,
+			JoinCount > 0 ? JoinMs / JoinCount : 0.0, NumJoinSucceeded, NumJoinFailed,
+			BackendMB, CacheMB);
+	}
+
+	// 带延迟的一轮：模拟后端的回调由FTicker在之后的帧里完成，按游戏里的异步流程串起 找房 -> 排序 -> 逐个加入
+	// 测的是每一步的实际等待时间和跨了多少帧，同步那一轮测不到回调排队和操作链等待的开销
+	class FLatencyBenchmark : public TSharedFromThis<FLatencyBenchmark>
+	{
+	public:
+		FLatencyBenchmark(UGameInstance& InGameInstance, int32 InNumSessions, float InLatencyMs, float InJoinFailureRate, int32 InNumJoins)
+			: GameInstance(&InGameInstance)
+			, NumSessions(InNumSessions)
+			, LatencyMs(InLatencyMs)
+			, JoinFailureRate(InJoinFailureRate)
+			, NumJoins(InNumJoins)
+		{
+		}
+
+		bool Start()
+		{
+			FMultiplayerSimulatedSessionParams Params;
+			Params.NumSessions = NumSessions;
+			Params.MinLatencyMs = LatencyMs;
+			Params.MaxLatencyMs = LatencyMs;
+			Backend = MakeShared<FMultiplayerSimulatedSessionInterface, ESPMode::ThreadSafe>(Params);
+			Subsystem.Reset(CreateIsolatedSubsystem(*GameInstance, Backend));
+			if (!Subsystem.IsValid())
+			{
+				return false;
+			}
+			Subsystem->MultiplayerOnFindSessionComplete.AddSP(this, &FLatencyBenchmark::OnFindComplete);
+			Subsystem->MultiplayerOnSessionsRanked.AddSP(this, &FLatencyBenchmark::OnSessionsRanked);
+			Subsystem->MultiplayerOnJoinSessionComplete.AddSP(this, &FLatencyBenchmark::OnJoinComplete);
+
+			Filter.MatchType = TEXT("FreeForAll");
+			Filter.MinOpenSlots = 1;
+			Filter.BuildVersion = UMultiplayerSessionsSubsystem::GetLocalBuildVersion();
+			StartTime = FPlatformTime::Seconds();
+			StartFrame = GFrameCounter;
+			PhaseStartTime = StartTime;
+			Subsystem->FindSession(NumSessions, Filter);
+			return true;
+		}
+
+		// 游戏实例要没了就不等回调，直接收尾
+		bool IsStale() const { return !GameInstance.IsValid(); }
+
+		void Abort()
+		{
+			UE_LOG(LogTemp, Warning, TEXT("BenchmarkSessions latency %.0f ms: aborted"), LatencyMs);
+			Cleanup();
+		}
+
+	private:
+		void OnFindComplete(const TArray<FOnlineSessionSearchResult>& Results, bool bWasSuccessful)
+		{
+			FindMs = MillisecondsSince(PhaseStartTime);
+			NumFound = Results.Num();
+			Candidates = Subsystem->GetCachedSearchResults();
+			PhaseStartTime = FPlatformTime::Seconds();
+			Subsystem->RankSessions(Candidates, &RankRequestId);
+		}
+
+		void OnSessionsRanked(int32 RequestId, const TArray<FMultiplayerRankedSession>& RankedSessions)
+		{
+			if (RequestId != RankRequestId)
+			{
+				return;
+			}
+			RankMs = MillisecondsSince(PhaseStartTime);
+			NumRanked = RankedSessions.Num();
+			Backend->SetFailureRate(JoinFailureRate);
+			JoinCount = FMath::Min(NumJoins, Candidates.Num());
+			PhaseStartTime = FPlatformTime::Seconds();
+			JoinNext();
+		}
+
+		void JoinNext()
+		{
+			if (JoinIndex >= JoinCount)
+			{
+				Finish();
+				return;
+			}
+			Subsystem->JoinSession(Candidates[JoinIndex++]);
+		}
+
+		void OnJoinComplete(EOnJoinSessionCompleteResult::Type Result)
+		{
+			if (Result == EOnJoinSessionCompleteResult::Success)
+			{
+				++NumJoinSucceeded;
+			}
+			else
+			{
+				++NumJoinFailed;
+			}
+			JoinNext();
+		}
+
+		void Finish()
+		{
+			const double JoinMs = MillisecondsSince(PhaseStartTime);
+			UE_LOG(LogTemp, Display, TEXT("BenchmarkSessions latency %.0f ms, %d sessions: find %.1f ms (%d results), rank %.2f ms (%d), join %.1f ms/op (%d ok, %d failed), total %.1f ms over %llu frames"),
+				LatencyMs, NumSessions,
+				FindMs, NumFound,
+				RankMs, NumRanked,
+				JoinCount > 0 ? JoinMs / JoinCount : 0.0, NumJoinSucceeded, NumJoinFailed,
+				MillisecondsSince(StartTime), GFrameCounter - StartFrame);
+			Cleanup();
+		}
+
+		void Cleanup();
+
+		TWeakObjectPtr<UGameInstance> GameInstance;
+		TStrongObjectPtr<UMultiplayerSessionsSubsystem> Subsystem;
+		TSharedPtr<FMultiplayerSimulatedSessionInterface, ESPMode::ThreadSafe> Backend;
+		FMultiplayerSessionSearchFilter Filter;
+		TArray<FOnlineSessionSearchResult> Candidates;
+		int32 NumSessions{0};
+		float LatencyMs{0.f};
+		float JoinFailureRate{0.f};
+		int32 NumJoins{0};
+		int32 RankRequestId{0};
+		int32 JoinIndex{0};
+		int32 JoinCount{0};
+		int32 NumFound{0};
+		int32 NumRanked{0};
+		int32 NumJoinSucceeded{0};
+		int32 NumJoinFailed{0};
+		double StartTime{0.0};
+		double PhaseStartTime{0.0};
+		uint64 StartFrame{0};
+		double FindMs{0.0};
+		double RankMs{0.0};
+	};
+
+	// 同一时间只跑一轮带延迟的压测，跑完之前不接受新的Benchmark
+	static TSharedPtr<FLatencyBenchmark> ActiveLatencyBenchmark;
+
+	void FLatencyBenchmark::Cleanup()
+	{
+		if (Subsystem.IsValid())
+		{
+			Subsystem->MultiplayerOnFindSessionComplete.RemoveAll(this);
+			Subsystem->MultiplayerOnSessionsRanked.RemoveAll(this);
+			Subsystem->MultiplayerOnJoinSessionComplete.RemoveAll(this);
+			Subsystem->DestorySession();
+			if (GameInstance.IsValid())
+			{
+				DestroyIsolatedSubsystem(*GameInstance, Subsystem.Get());
+			}
+			Subsystem.Reset();
+		}
+		// 最后一步，之后this可能已经释放
+		if (ActiveLatencyBenchmark.Get() == this)
+		{
+			ActiveLatencyBenchmark.Reset();
+		}
+	}
+
+	// MultiplayerSessions.Benchmark [Sessions...] [FailureRate=0.1] [Joins=1000] [Latency=50] [LatencyJoins=20]
+	// 不连Steam，用进程内的模拟后端测子系统在不同会话规模下的找房、过滤、排序、加入耗时和内存，默认1k/10k/100k
+	// 之后用最小的规模再跑一轮带延迟的异步流程，结果在几帧之后才打出来；Latency=0 不跑这一轮
+	static void Benchmark(const TArray<FString>& Args, UWorld* World)
+	{
+		UGameInstance* GameInstance = World ? World->GetGameInstance() : nullptr;
+		if (GameInstance == nullptr)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("MultiplayerSessions.Benchmark needs a game instance"));
+			return;
+		}
+		if (ActiveLatencyBenchmark.IsValid())
+		{
+			if (!ActiveLatencyBenchmark->IsStale())
+			{
+				UE_LOG(LogTemp, Warning, TEXT("MultiplayerSessions.Benchmark skipped: the latency run is still in progress"));
+				return;
+			}
+			// Abort会清掉ActiveLatencyBenchmark，先拿住引用
+			TSharedPtr<FLatencyBenchmark> StaleBenchmark = ActiveLatencyBenchmark;
+			StaleBenchmark->Abort();
+		}
+
+		TArray<int32> SessionCounts;
+		float JoinFailureRate = 0.1f;
+		int32 NumJoins = 1000;
+		float LatencyMs = 50.f;
+		int32 NumLatencyJoins = 20;
+		for (const FString& Arg : Args)
+		{
+			if (FParse::Value(*Arg, TEXT("FailureRate="), JoinFailureRate) || FParse::Value(*Arg, TEXT("LatencyJoins="), NumLatencyJoins)
+				|| FParse::Value(*Arg, TEXT("Joins="), NumJoins) || FParse::Value(*Arg, TEXT("Latency="), LatencyMs))
+			{
+				continue;
+			}
+			if (Arg.IsNumeric())
+			{
+				SessionCounts.Add(FMath::Max(1, FCString::Atoi(*Arg)));
+			}
+		}
+		if (SessionCounts.Num() == 0)
+		{
+			SessionCounts = {1000, 10000, 100000};
+		}
+		for (const int32 NumSessions : SessionCounts)
+		{
+			RunBenchmark(*GameInstance, NumSessions, JoinFailureRate, NumJoins);
+		}
+
+		if (LatencyMs > 0.f)
+		{
+			TSharedRef<FLatencyBenchmark> LatencyBenchmark = MakeShared<FLatencyBenchmark>(*GameInstance, FMath::Min(SessionCounts), LatencyMs, JoinFailureRate, NumLatencyJoins);
+			ActiveLatencyBenchmark = LatencyBenchmark;
+			if (!LatencyBenchmark->Start())
+			{
+				ActiveLatencyBenchmark.Reset();
+			}
+		}
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchmarkCommand(
+		TEXT("MultiplayerSessions.Benchmark"),
+		TEXT("Measure find, filter, rank and join cost against an in-process simulated backend. Usage: MultiplayerSessions.Benchmark [Sessions...=1000 10000 100000] [FailureRate=0.1] [Joins=1000] [Latency=50] [LatencyJoins=20]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&Benchmark));
+}
@@ -0,0 +1,251 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MultiplayerSessionsStats.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Misc/Guid.h"
+#include "ProfilingDebugging/MiscTrace.h"
+
+DEFINE_STAT(STAT_MPS_CreateSessionCount);
+DEFINE_STAT(STAT_MPS_FindSessionCount);
+DEFINE_STAT(STAT_MPS_JoinSessionCount);
+DEFINE_STAT(STAT_MPS_ResolveConnectStringCount);
+DEFINE_STAT(STAT_MPS_ClientTravelCount);
+DEFINE_STAT(STAT_MPS_ServerTravelCount);
+DEFINE_STAT(STAT_MPS_FailureCount);
+DEFINE_STAT(STAT_MPS_SearchCacheHits);
+DEFINE_STAT(STAT_MPS_PreloadCount);
+DEFINE_STAT(STAT_MPS_QosPingsSent);
+DEFINE_STAT(STAT_MPS_QosPingsFailed);
+DEFINE_STAT(STAT_MPS_QosCacheHits);
+DEFINE_STAT(STAT_MPS_JoinFailovers);
+DEFINE_STAT(STAT_MPS_LastJoinAttempts);
+
+DEFINE_STAT(STAT_MPS_CreateSessionMs);
+DEFINE_STAT(STAT_MPS_FindSessionMs);
+DEFINE_STAT(STAT_MPS_JoinSessionMs);
+DEFINE_STAT(STAT_MPS_ResolveConnectStringMs);
+DEFINE_STAT(STAT_MPS_ClientTravelMs);
+DEFINE_STAT(STAT_MPS_ServerTravelMs);
+DEFINE_STAT(STAT_MPS_PreloadAheadMs);
+DEFINE_STAT(STAT_MPS_QosRankingMs);
+DEFINE_STAT(STAT_MPS_QosBestRttMs);
+DEFINE_STAT(STAT_MPS_TimeToJoinMs);
+DEFINE_STAT(STAT_MPS_RejoinMs);
+
+CSV_DEFINE_CATEGORY_MODULE(MULTUPLAYERSESSIONS_API, MultuplayerSessions, true);
+
+UE_TRACE_CHANNEL_DEFINE(MultiplayerSessionsChannel);
+
+namespace
+{
+	//第一个桶的上界（毫秒）和相邻桶的比例
+	constexpr double FirstBucketUpperMs = 1.0;
+	constexpr double BucketGrowth = 1.25;
+
+	FMultiplayerSessionsLatencyHistogram Histograms[static_cast<int32>(EMultiplayerSessionsTiming::Num)];
+
+	FAutoConsoleCommand DumpLatencyCommand(
+		TEXT("MultiplayerSessions.DumpLatency"),
+		TEXT("Logs p50/p95/p99 latency of every session operation."),
+		FConsoleCommandDelegate::CreateStatic(&MultiplayerSessionsStats::DumpToLog));
+
+	FAutoConsoleCommand ResetLatencyCommand(
+		TEXT("MultiplayerSessions.ResetLatency"),
+		TEXT("Clears the session operation latency histograms."),
+		FConsoleCommandDelegate::CreateStatic(&MultiplayerSessionsStats::ResetAll));
+}
+
+FMultiplayerSessionsLatencyHistogram::FMultiplayerSessionsLatencyHistogram()
+{
+	Reset();
+}
+
+void FMultiplayerSessionsLatencyHistogram::AddSample(double Milliseconds)
+{
+	Milliseconds = FMath::Max(Milliseconds, 0.0);
+	++Buckets[GetBucketIndex(Milliseconds)];
+	++NumSamples;
+	TotalMs += Milliseconds;
+	MaxMs = FMath::Max(MaxMs, Milliseconds);
+}
+
+double FMultiplayerSessionsLatencyHistogram::GetPercentile(double Percentile) const
+{
+	if (NumSamples == 0)
+	{
+		return 0.0;
+	}
+	const uint64 Rank = FMath::Max<uint64>(1, FMath::CeilToInt(FMath::Clamp(Percentile, 0.0, 100.0) / 100.0 * NumSamples));
+	uint64 Seen = 0;
+	for (int32 Index = 0; Index < NumBuckets; ++Index)
+	{
+		Seen += Buckets[Index];
+		if (Seen >= Rank)
+		{
+			//最后一个桶没有上界，用最大值代替；其它桶也不会超过最大值
+			return FMath::Min(GetBucketUpperBound(Index), MaxMs);
+		}
+	}
+	return MaxMs;
+}
+
+void FMultiplayerSessionsLatencyHistogram::Reset()
+{
+	FMemory::Memzero(Buckets);
+	NumSamples = 0;
+	TotalMs = 0.0;
+	MaxMs = 0.0;
+}
+
+int32 FMultiplayerSessionsLatencyHistogram::GetBucketIndex(double Milliseconds)
+{
+	if (Milliseconds <= FirstBucketUpperMs)
+	{
+		return 0;
+	}
+	const int32 Index = FMath::CeilToInt(FMath::Loge(Milliseconds / FirstBucketUpperMs) / FMath::Loge(BucketGrowth));
+	return FMath::Clamp(Index, 0, NumBuckets - 1);
+}
+
+double FMultiplayerSessionsLatencyHistogram::GetBucketUpperBound(int32 BucketIndex)
+{
+	if (BucketIndex >= NumBuckets - 1)
+	{
+		return DBL_MAX;
+	}
+	return FirstBucketUpperMs * FMath::Pow(BucketGrowth, BucketIndex);
+}
+
+const TCHAR* MultiplayerSessionsStats::GetTimingName(EMultiplayerSessionsTiming Timing)
+{
+	switch (Timing)
+	{
+	case EMultiplayerSessionsTiming::CreateSession: return TEXT("CreateSession");
+	case EMultiplayerSessionsTiming::FindSession: return TEXT("FindSession");
+	case EMultiplayerSessionsTiming::JoinSession: return TEXT("JoinSession");
+	case EMultiplayerSessionsTiming::ResolveConnectString: return TEXT("ResolveConnectString");
+	case EMultiplayerSessionsTiming::ClientTravel: return TEXT("ClientTravel");
+	case EMultiplayerSessionsTiming::ServerTravel: return TEXT("ServerTravel");
+	case EMultiplayerSessionsTiming::QosRanking: return TEXT("QosRanking");
+	case EMultiplayerSessionsTiming::TimeToJoin: return TEXT("TimeToJoin");
+	case EMultiplayerSessionsTiming::Rejoin: return TEXT("Rejoin");
+	default: return TEXT("Unknown");
+	}
+}
+
+void MultiplayerSessionsStats::RecordTiming(EMultiplayerSessionsTiming Timing, double Milliseconds, bool bWasSuccessful)
+{
+	check(Timing < EMultiplayerSessionsTiming::Num);
+	Histograms[static_cast<int32>(Timing)].AddSample(Milliseconds);
+	if (!bWasSuccessful)
+	{
+		INC_DWORD_STAT(STAT_MPS_FailureCount);
+	}
+
+	//stat和CSV的名字都要求是编译期常量，只能逐个展开
+	const float Ms = static_cast<float>(Milliseconds);
+	switch (Timing)
+	{
+	case EMultiplayerSessionsTiming::CreateSession:
+		INC_DWORD_STAT(STAT_MPS_CreateSessionCount);
+		SET_FLOAT_STAT(STAT_MPS_CreateSessionMs, Ms);
+		CSV_CUSTOM_STAT(MultuplayerSessions, CreateSessionMs, Ms, ECsvCustomStatOp::Set);
+		break;
+	case EMultiplayerSessionsTiming::FindSession:
+		INC_DWORD_STAT(STAT_MPS_FindSessionCount);
+		SET_FLOAT_STAT(STAT_MPS_FindSessionMs, Ms);
+		CSV_CUSTOM_STAT(MultuplayerSessions, FindSessionMs, Ms, ECsvCustomStatOp::Set);
+		break;
+	case EMultiplayerSessionsTiming::JoinSession:
+		INC_DWORD_STAT(STAT_MPS_JoinSessionCount);
+		SET_FLOAT_STAT(STAT_MPS_JoinSessionMs, Ms);
+		CSV_CUSTOM_STAT(MultuplayerSessions, JoinSessionMs, Ms, ECsvCustomStatOp::Set);
+		break;
+	case EMultiplayerSessionsTiming::ResolveConnectString:
+		INC_DWORD_STAT(STAT_MPS_ResolveConnectStringCount);
+		SET_FLOAT_STAT(STAT_MPS_ResolveConnectStringMs, Ms);
+		CSV_CUSTOM_STAT(MultuplayerSessions, ResolveConnectStringMs, Ms, ECsvCustomStatOp::Set);
+		break;
+	case EMultiplayerSessionsTiming::ClientTravel:
+		INC_DWORD_STAT(STAT_MPS_ClientTravelCount);
+		SET_FLOAT_STAT(STAT_MPS_ClientTravelMs, Ms);
+		CSV_CUSTOM_STAT(MultuplayerSessions, ClientTravelMs, Ms, ECsvCustomStatOp::Set);
+		break;
+	case EMultiplayerSessionsTiming::ServerTravel:
+		INC_DWORD_STAT(STAT_MPS_ServerTravelCount);
+		SET_FLOAT_STAT(STAT_MPS_ServerTravelMs, Ms);
+		CSV_CUSTOM_STAT(MultuplayerSessions, ServerTravelMs, Ms, ECsvCustomStatOp::Set);
+		break;
+	case EMultiplayerSessionsTiming::QosRanking:
+		SET_FLOAT_STAT(STAT_MPS_QosRankingMs, Ms);
+		CSV_CUSTOM_STAT(MultuplayerSessions, QosRankingMs, Ms, ECsvCustomStatOp::Set);
+		break;
+	case EMultiplayerSessionsTiming::TimeToJoin:
+		SET_FLOAT_STAT(STAT_MPS_TimeToJoinMs, Ms);
+		CSV_CUSTOM_STAT(MultuplayerSessions, TimeToJoinMs, Ms, ECsvCustomStatOp::Set);
+		break;
+	case EMultiplayerSessionsTiming::Rejoin:
+		SET_FLOAT_STAT(STAT_MPS_RejoinMs, Ms);
+		CSV_CUSTOM_STAT(MultuplayerSessions, RejoinMs, Ms, ECsvCustomStatOp::Set);
+		break;
+	default:
+		break;
+	}
+	UE_LOG(LogTemp, Log, TEXT("MultiplayerSessions: %s took %.1f ms (%s)"), GetTimingName(Timing), Milliseconds, bWasSuccessful ? TEXT("ok") : TEXT("failed"));
+}
+
+const FMultiplayerSessionsLatencyHistogram& MultiplayerSessionsStats::GetHistogram(EMultiplayerSessionsTiming Timing)
+{
+	check(Timing < EMultiplayerSessionsTiming::Num);
+	return Histograms[static_cast<int32>(Timing)];
+}
+
+void MultiplayerSessionsStats::DumpToLog()
+{
+	for (int32 Index = 0; Index < static_cast<int32>(EMultiplayerSessionsTiming::Num); ++Index)
+	{
+		const FMultiplayerSessionsLatencyHistogram& Histogram = Histograms[Index];
+		UE_LOG(LogTemp, Display, TEXT("MultiplayerSessions %-20s n=%-5u mean=%8.1f p50=%8.1f p95=%8.1f p99=%8.1f max=%8.1f ms"),
+			GetTimingName(static_cast<EMultiplayerSessionsTiming>(Index)),
+			Histogram.GetNumSamples(),
+			Histogram.GetMeanMs(),
+			Histogram.GetPercentile(50.0),
+			Histogram.GetPercentile(95.0),
+			Histogram.GetPercentile(99.0),
+			Histogram.GetMaxMs());
+	}
+}
+
+void MultiplayerSessionsStats::ResetAll()
+{
+	for (FMultiplayerSessionsLatencyHistogram& Histogram : Histograms)
+	{
+		Histogram.Reset();
+	}
+}
+
+const TCHAR* MultiplayerSessionsTrace::JoinIdOption = TEXT("JoinId");
+
+FString MultiplayerSessionsTrace::NewJoinId()
+{
+	//短一点，书签和日志里好认，同一次压测里也不会撞
+	return FGuid::NewGuid().ToString(EGuidFormats::Digits).Left(12);
+}
+
+void MultiplayerSessionsTrace::Bookmark(const TCHAR* Event, const FString& JoinId, const FString& Detail)
+{
+	const TCHAR* Id = JoinId.IsEmpty() ? TEXT("-") : *JoinId;
+	if (UE_TRACE_CHANNELEXPR_IS_ENABLED(MultiplayerSessionsChannel))
+	{
+		TRACE_BOOKMARK(TEXT("MPS %s join=%s %s"), Event, Id, *Detail);
+		//开了通道时同时写日志，客户端和服务器的日志里也能按加入ID对上
+		UE_LOG(LogTemp, Log, TEXT("MultiplayerSessions trace: %s join=%s %s"), Event, Id, *Detail);
+	}
+	else
+	{
+		//没开通道时只在Verbose下输出，平时不刷屏
+		UE_LOG(LogTemp, Verbose, TEXT("MultiplayerSessions trace: %s join=%s %s"), Event, Id, *Detail);
+	}
+}
@@ -4,6 +4,99 @@
 #include "MultiplayerSessionsSubsystem.h"
 
 #include "OnlineSubsystem.h"
+#include "TimerManager.h"
+#include "Engine/GameInstance.h"
+#include "Engine/Engine.h"
+#include "Misc/NetworkVersion.h"
+#include "GameFramework/PlayerController.h"
+#include "Engine/LocalPlayer.h"
+#include "Misc/CommandLine.h"
+#include "UObject/UObjectGlobals.h"
+#include "Icmp.h"
+#include "MultiplayerPreloadSubsystem.h"
+#include "MultiplayerSimulatedSessionInterface.h"
+
+namespace MultiplayerSessionsCache
+{
+	//判断同一个会话两次搜索之间是否有需要通知菜单的变化
+	bool HasResultChanged(const FOnlineSessionSearchResult& Old, const FOnlineSessionSearchResult& New)
+	{
+		if (Old.Session.NumOpenPublicConnections != New.Session.NumOpenPublicConnections ||
+			Old.Session.NumOpenPrivateConnections != New.Session.NumOpenPrivateConnections ||
+			Old.PingInMs != New.PingInMs)
+		{
+			return true;
+		}
+		FString OldMatchType;
+		FString NewMatchType;
+		Old.Session.SessionSettings.Get(FName("MatchType"), OldMatchType);
+		New.Session.SessionSettings.Get(FName("MatchType"), NewMatchType);
+		return OldMatchType != NewMatchType;
+	}
+}
+
+namespace MultiplayerSessionsQos
+{
+	//从连接地址里取出可以ping的主机名，Steam的P2P地址（steam.xxx）没法用ICMP测，返回空
+	FString GetPingableHost(const FString& ConnectString)
+	{
+		FString Host;
+		FString Port;
+		if (!ConnectString.Split(TEXT(":"), &Host, &Port, ESearchCase::IgnoreCase, ESearchDir::FromEnd) || !Port.IsNumeric())
+		{
+			Host = ConnectString;
+		}
+		if (Host.IsEmpty() || Host.StartsWith(TEXT("steam."), ESearchCase::IgnoreCase))
+		{
+			return FString();
+		}
+		return Host;
+	}
+}
+
+bool FMultiplayerSessionSearchFilter::Matches(const FOnlineSessionSearchResult& Result) const
+{
+	if (!Result.IsValid() || Result.Session.NumOpenPublicConnections < MinOpenSlots)
+	{
+		return false;
+	}
+	const FOnlineSessionSettings& Settings = Result.Session.SessionSettings;
+	if (!MatchType.IsEmpty())
+	{
+		//只取出设置的值来比较，不复制整个搜索结果
+		FString SettingsValue;
+		if (!Settings.Get(FName("MatchType"), SettingsValue) || SettingsValue != MatchType)
+		{
+			return false;
+		}
+	}
+	if (BuildVersion != 0)
+	{
+		int32 SessionBuildVersion = 0;
+		if (!Settings.Get(FName("BuildVersion"), SessionBuildVersion) || SessionBuildVersion != BuildVersion)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void FMultiplayerSessionSearchFilter::ApplyToQuery(FOnlineSearchSettings& QuerySettings) const
+{
+	//这些条件交给后端（Steam大厅的过滤器）处理，返回的结果只剩匹配的会话
+	if (!MatchType.IsEmpty())
+	{
+		QuerySettings.Set(FName("MatchType"), MatchType, EOnlineComparisonOp::Equals);
+	}
+	if (MinOpenSlots > 0)
+	{
+		QuerySettings.Set(SEARCH_MINSLOTSAVAILABLE, MinOpenSlots, EOnlineComparisonOp::GreaterThanEquals);
+	}
+	if (BuildVersion != 0)
+	{
+		QuerySettings.Set(FName("BuildVersion"), BuildVersion, EOnlineComparisonOp::Equals);
+	}
+}
 
 UMultiplayerSessionsSubsystem::UMultiplayerSessionsSubsystem():
 CreateSessionCompleteDelegate(FOnCreateSessionCompleteDelegate::CreateUObject(this,&ThisClass::OnCreateSessionComplete)),
@@ -12,127 +105,1563 @@ JoinSessionCompleteDelegate(FOnJoinSessionCompleteDelegate::CreateUObject(this,&
 DestroySessionCompleteDelegate(FOnDestroySessionCompleteDelegate::CreateUObject(this,&ThisClass::OnDestorySessionComplete)),
 StartSessionCompleteDelegate(FOnStartSessionCompleteDelegate::CreateUObject(this,&ThisClass::OnStartSessionComplete))
 {
-	IOnlineSubsystem* Subsystem = IOnlineSubsystem::Get();
-	if(Subsystem)
+	IOnlineSubsystem* Subsystem = IOnlineSubsystem::Get();
+	if(Subsystem)
+	{
+		OnlineInterface = Subsystem->GetSessionInterface();
+	}
+	
+}
+
+void UMultiplayerSessionsSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+	//离线压测：MultiPlayerGame -SimulatedSessions=10000 [-SimulatedLatencyMs=50] [-SimulatedFailureRate=0.1]
+	FMultiplayerSimulatedSessionParams SimulatedParams;
+	if (FMultiplayerSimulatedSessionParams::FromCommandLine(SimulatedParams))
+	{
+		UE_LOG(LogTemp, Display, TEXT("MultiplayerSessions: using simulated backend with %d sessions"), SimulatedParams.NumSessions);
+		UseSessionInterface(MakeShared<FMultiplayerSimulatedSessionInterface, ESPMode::ThreadSafe>(SimulatedParams));
+	}
+	//跳转的计时在新地图加载完成时结束
+	PostLoadMapHandle = FCoreUObjectDelegates::PostLoadMapWithWorld.AddUObject(this, &ThisClass::OnPostLoadMapWithWorld);
+	//断线时自动重连，重连时直接跳转失败也从这里得知
+	if (GEngine)
+	{
+		NetworkFailureHandle = GEngine->OnNetworkFailure().AddUObject(this, &ThisClass::OnNetworkFailure);
+		TravelFailureHandle = GEngine->OnTravelFailure().AddUObject(this, &ThisClass::OnTravelFailure);
+	}
+
+	//压测客户端：MultiPlayerGame -nullrhi -nosound -AutoJoin -MatchType=FreeForAll [-AutoJoinDedicated] [-AutoJoinAttempts=10]
+	if (!IsRunningDedicatedServer() && FParse::Param(FCommandLine::Get(), TEXT("AutoJoin")))
+	{
+		FMultiplayerSessionSearchFilter Filter;
+		FParse::Value(FCommandLine::Get(), TEXT("MatchType="), Filter.MatchType);
+		Filter.BuildVersion = GetLocalBuildVersion();
+		Filter.bDedicatedServers = FParse::Param(FCommandLine::Get(), TEXT("AutoJoinDedicated"));
+		int32 MaxAttempts = 10;
+		FParse::Value(FCommandLine::Get(), TEXT("AutoJoinAttempts="), MaxAttempts);
+		StartAutoJoin(Filter, MaxAttempts);
+	}
+}
+
+void UMultiplayerSessionsSubsystem::Deinitialize()
+{
+	FCoreUObjectDelegates::PostLoadMapWithWorld.Remove(PostLoadMapHandle);
+	if (GEngine)
+	{
+		GEngine->OnNetworkFailure().Remove(NetworkFailureHandle);
+		GEngine->OnTravelFailure().Remove(TravelFailureHandle);
+	}
+	if (IsRejoinInProgress())
+	{
+		FinishRejoin(false);
+	}
+	StopSearchCacheRefresh();
+	CancelRanking();
+	CancelJoinPipeline();
+	if (bAutoJoinActive)
+	{
+		FinishAutoJoin(false);
+	}
+	Super::Deinitialize();
+}
+
+void UMultiplayerSessionsSubsystem::BeginTiming(EMultiplayerSessionsTiming Timing)
+{
+	TimingStartSeconds[static_cast<int32>(Timing)] = FPlatformTime::Seconds();
+	MultiplayerSessionsTrace::Bookmark(MultiplayerSessionsStats::GetTimingName(Timing), JoinTraceId, TEXT("begin"));
+}
+
+void UMultiplayerSessionsSubsystem::EndTiming(EMultiplayerSessionsTiming Timing, bool bWasSuccessful)
+{
+	double& StartSeconds = TimingStartSeconds[static_cast<int32>(Timing)];
+	if (StartSeconds <= 0.0)
+	{
+		return;
+	}
+	const double Milliseconds = (FPlatformTime::Seconds() - StartSeconds) * 1000.0;
+	MultiplayerSessionsStats::RecordTiming(Timing, Milliseconds, bWasSuccessful);
+	StartSeconds = 0.0;
+	MultiplayerSessionsTrace::Bookmark(MultiplayerSessionsStats::GetTimingName(Timing), JoinTraceId,
+		FString::Printf(TEXT("end %s %.1f ms"), bWasSuccessful ? TEXT("ok") : TEXT("failed"), Milliseconds));
+}
+
+const FString& UMultiplayerSessionsSubsystem::BeginJoinTrace(const TCHAR* Reason)
+{
+	JoinTraceId = MultiplayerSessionsTrace::NewJoinId();
+	MultiplayerSessionsTrace::Bookmark(TEXT("Begin"), JoinTraceId, Reason);
+	return JoinTraceId;
+}
+
+void UMultiplayerSessionsSubsystem::SetRemoteJoinId(const FUniqueNetIdRepl& PlayerId, const FString& JoinId)
+{
+	if (PlayerId.IsValid() && !JoinId.IsEmpty())
+	{
+		RemoteJoinIds.Add(PlayerId.ToString(), JoinId);
+	}
+}
+
+FString UMultiplayerSessionsSubsystem::GetRemoteJoinId(const FUniqueNetIdRepl& PlayerId) const
+{
+	const FString* JoinId = PlayerId.IsValid() ? RemoteJoinIds.Find(PlayerId.ToString()) : nullptr;
+	return JoinId ? *JoinId : FString();
+}
+
+void UMultiplayerSessionsSubsystem::RemoveRemoteJoinId(const FUniqueNetIdRepl& PlayerId)
+{
+	if (PlayerId.IsValid())
+	{
+		RemoteJoinIds.Remove(PlayerId.ToString());
+	}
+}
+
+void UMultiplayerSessionsSubsystem::OnPostLoadMapWithWorld(UWorld* LoadedWorld)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::OnPostLoadMapWithWorld);
+	//无缝跳转到比赛地图时也会走到这里，客户端这边的跳转就以这个书签结束
+	MultiplayerSessionsTrace::Bookmark(TEXT("MapLoaded"), JoinTraceId, LoadedWorld ? LoadedWorld->GetMapName() : TEXT("failed"));
+	EndTiming(EMultiplayerSessionsTiming::ClientTravel, LoadedWorld != nullptr);
+	EndTiming(EMultiplayerSessionsTiming::ServerTravel, LoadedWorld != nullptr);
+	if (LoadedWorld == nullptr)
+	{
+		return;
+	}
+	const bool bConnectedAsClient = LoadedWorld->GetNetMode() == NM_Client;
+	if (RejoinStage == EMultiplayerRejoinStage::DirectTravel && bConnectedAsClient)
+	{
+		//直接跳转成功，只花了一次连接的时间
+		LastJoinedUnixTime = FDateTime::UtcNow().ToUnixTimestamp();
+		SaveConfig();
+		FinishRejoin(true);
+	}
+	else if (bRejoinAfterMapLoad && !bConnectedAsClient)
+	{
+		bRejoinAfterMapLoad = false;
+		BeginJoinTrace(TEXT("AutoRejoin"));
+		Rejoin();
+	}
+}
+
+bool UMultiplayerSessionsSubsystem::CanRejoin() const
+{
+	if (LastJoinedSessionId.IsEmpty() && LastConnectString.IsEmpty())
+	{
+		return false;
+	}
+	return FDateTime::UtcNow().ToUnixTimestamp() - LastJoinedUnixTime < static_cast<int64>(RejoinMaxAgeSeconds);
+}
+
+void UMultiplayerSessionsSubsystem::ClearRejoinInfo()
+{
+	bRejoinAfterMapLoad = false;
+	if (LastJoinedSessionId.IsEmpty() && LastConnectString.IsEmpty())
+	{
+		return;
+	}
+	LastJoinedSessionId.Reset();
+	LastConnectString.Reset();
+	LastJoinedMatchType.Reset();
+	LastJoinedUnixTime = 0;
+	SaveConfig();
+}
+
+void UMultiplayerSessionsSubsystem::RememberJoinedSession(const FOnlineSessionSearchResult& SessionResult, const FString& ConnectString)
+{
+	LastJoinedSessionId = SessionResult.GetSessionIdStr();
+	LastConnectString = ConnectString;
+	LastJoinedMatchType.Reset();
+	SessionResult.Session.SessionSettings.Get(FName("MatchType"), LastJoinedMatchType);
+	LastJoinedUnixTime = FDateTime::UtcNow().ToUnixTimestamp();
+	//立即写盘，进程崩溃后重启也能重连
+	SaveConfig();
+}
+
+bool UMultiplayerSessionsSubsystem::Rejoin()
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::Rejoin);
+	if (IsRejoinInProgress() || bJoinPipelineActive || !CanRejoin())
+	{
+		return false;
+	}
+	UGameInstance* GameInstance = GetGameInstance();
+	if (GameInstance == nullptr)
+	{
+		return false;
+	}
+	CancelRanking();
+	StopSearchCacheRefresh();
+	bRejoinAfterMapLoad = false;
+	BeginTiming(EMultiplayerSessionsTiming::Rejoin);
+	RejoinPipelineHandle = MultiplayerOnJoinPipelineComplete.AddUObject(this, &ThisClass::OnRejoinPipelineComplete);
+
+	APlayerController* PlayerController = GameInstance->GetFirstLocalPlayerController();
+	if (LastConnectString.IsEmpty() || PlayerController == nullptr)
+	{
+		RejoinFindById();
+		return true;
+	}
+	//地址还有效时不用经过后端，省掉整个搜索和加入
+	RejoinStage = EMultiplayerRejoinStage::DirectTravel;
+	UE_LOG(LogTemp, Log, TEXT("MultiplayerSessions rejoin: travelling directly to %s"), *LastConnectString);
+	GameInstance->GetTimerManager().SetTimer(RejoinTimer, this, &ThisClass::OnRejoinDirectTravelTimeout, FMath::Max(RejoinDirectTravelTimeoutSeconds, 0.1f));
+	ClientTravel(LastConnectString);
+	return true;
+}
+
+void UMultiplayerSessionsSubsystem::OnRejoinDirectTravelTimeout()
+{
+	if (RejoinStage != EMultiplayerRejoinStage::DirectTravel)
+	{
+		return;
+	}
+	UE_LOG(LogTemp, Log, TEXT("MultiplayerSessions rejoin: direct travel timed out after %.1f s"), RejoinDirectTravelTimeoutSeconds);
+	if (GEngine)
+	{
+		GEngine->CancelPending(GetWorld());
+	}
+	EndTiming(EMultiplayerSessionsTiming::ClientTravel, false);
+	RejoinFindById();
+}
+
+void UMultiplayerSessionsSubsystem::RejoinFindById()
+{
+	UGameInstance* GameInstance = GetGameInstance();
+	if (GameInstance)
+	{
+		GameInstance->GetTimerManager().ClearTimer(RejoinTimer);
+	}
+	RejoinStage = EMultiplayerRejoinStage::FindById;
+	MultiplayerSessionsTrace::Bookmark(TEXT("RejoinFindById"), JoinTraceId, LastJoinedSessionId);
+	const FUniqueNetIdRepl LocalPlayerId = GetLocalPlayerId();
+	TSharedPtr<const FUniqueNetId> SessionId;
+	if (OnlineInterface.IsValid() && !LastJoinedSessionId.IsEmpty())
+	{
+		SessionId = OnlineInterface->CreateSessionIdFromString(LastJoinedSessionId);
+	}
+	//按Id查询需要本地玩家的Id，后端不支持时也会直接返回false
+	if (!LocalPlayerId.IsValid() || !SessionId.IsValid() ||
+		!OnlineInterface->FindSessionById(*LocalPlayerId, *SessionId, *LocalPlayerId,
+			FOnSingleSessionResultCompleteDelegate::CreateUObject(this, &ThisClass::OnRejoinFindByIdComplete)))
+	{
+		if (RejoinStage == EMultiplayerRejoinStage::FindById)
+		{
+			RejoinFullSearch();
+		}
+	}
+}
+
+void UMultiplayerSessionsSubsystem::OnRejoinFindByIdComplete(int32 LocalUserNum, bool bWasSuccessful, const FOnlineSessionSearchResult& SearchResult)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::OnRejoinFindByIdComplete);
+	if (RejoinStage != EMultiplayerRejoinStage::FindById)
+	{
+		return;
+	}
+	if (bWasSuccessful && SearchResult.IsValid())
+	{
+		TArray<FOnlineSessionSearchResult> Candidates;
+		Candidates.Add(SearchResult);
+		if (JoinCandidateSessions(Candidates))
+		{
+			return;
+		}
+	}
+	RejoinFullSearch();
+}
+
+void UMultiplayerSessionsSubsystem::RejoinFullSearch()
+{
+	if (!OnlineInterface.IsValid() || LastJoinedSessionId.IsEmpty())
+	{
+		FinishRejoin(false);
+		return;
+	}
+	RejoinStage = EMultiplayerRejoinStage::FullSearch;
+	MultiplayerSessionsTrace::Bookmark(TEXT("RejoinFullSearch"), JoinTraceId, LastJoinedSessionId);
+	RejoinFindHandle = MultiplayerOnFindSessionComplete.AddUObject(this, &ThisClass::OnRejoinFindComplete);
+	//要找的是原来那一局，人满了也要能搜到
+	FMultiplayerSessionSearchFilter Filter;
+	Filter.MatchType = LastJoinedMatchType;
+	Filter.MinOpenSlots = 0;
+	Filter.BuildVersion = GetLocalBuildVersion();
+	InvalidateSearchCache();
+	FindSession(10000, Filter);
+}
+
+void UMultiplayerSessionsSubsystem::OnRejoinFindComplete(const TArray<FOnlineSessionSearchResult>& SearchResults, bool bWasSuccessful)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::OnRejoinFindComplete);
+	if (RejoinStage != EMultiplayerRejoinStage::FullSearch)
+	{
+		return;
+	}
+	MultiplayerOnFindSessionComplete.Remove(RejoinFindHandle);
+	const FOnlineSessionSearchResult* Previous = SearchResults.FindByPredicate([this](const FOnlineSessionSearchResult& Result)
+	{
+		return Result.GetSessionIdStr() == LastJoinedSessionId;
+	});
+	if (Previous)
+	{
+		TArray<FOnlineSessionSearchResult> Candidates;
+		Candidates.Add(*Previous);
+		if (JoinCandidateSessions(Candidates))
+		{
+			return;
+		}
+	}
+	//原来那一局已经不在了
+	FinishRejoin(false);
+}
+
+void UMultiplayerSessionsSubsystem::OnRejoinPipelineComplete(bool bWasSuccessful, int32 Attempts, double SecondsToJoin)
+{
+	if (RejoinStage == EMultiplayerRejoinStage::FindById)
+	{
+		if (bWasSuccessful)
+		{
+			FinishRejoin(true);
+		}
+		else
+		{
+			RejoinFullSearch();
+		}
+	}
+	else if (RejoinStage == EMultiplayerRejoinStage::FullSearch)
+	{
+		FinishRejoin(bWasSuccessful);
+	}
+}
+
+void UMultiplayerSessionsSubsystem::OnNetworkFailure(UWorld* World, UNetDriver* NetDriver, ENetworkFailure::Type FailureType, const FString& ErrorString)
+{
+	UGameInstance* GameInstance = GetGameInstance();
+	if (RejoinStage == EMultiplayerRejoinStage::DirectTravel)
+	{
+		//记下的地址连不上了，下一帧改用SessionId查询，让引擎先处理完这次失败
+		UE_LOG(LogTemp, Log, TEXT("MultiplayerSessions rejoin: direct travel failed (%s)"), ENetworkFailure::ToString(FailureType));
+		EndTiming(EMultiplayerSessionsTiming::ClientTravel, false);
+		if (GameInstance)
+		{
+			GameInstance->GetTimerManager().ClearTimer(RejoinTimer);
+			GameInstance->GetTimerManager().SetTimerForNextTick(this, &ThisClass::RejoinFindById);
+		}
+		return;
+	}
+	//已经在对局里的客户端掉线了，引擎回到默认地图后自动重连
+	const bool bLostConnection = FailureType == ENetworkFailure::ConnectionLost || FailureType == ENetworkFailure::ConnectionTimeout;
+	if (bAutoRejoinOnDisconnect && bLostConnection && World && World->GetNetMode() == NM_Client && !IsRejoinInProgress() && CanRejoin())
+	{
+		bRejoinAfterMapLoad = true;
+	}
+}
+
+void UMultiplayerSessionsSubsystem::OnTravelFailure(UWorld* World, ETravelFailure::Type FailureType, const FString& ErrorString)
+{
+	//无缝跳转在加载目标地图时失败，不会再有PostLoadMap来结束计时；没在计时的话这里什么也不做
+	EndTiming(EMultiplayerSessionsTiming::ServerTravel, false);
+	if (RejoinStage != EMultiplayerRejoinStage::DirectTravel)
+	{
+		return;
+	}
+	UE_LOG(LogTemp, Log, TEXT("MultiplayerSessions rejoin: direct travel failed (%s)"), ETravelFailure::ToString(FailureType));
+	EndTiming(EMultiplayerSessionsTiming::ClientTravel, false);
+	UGameInstance* GameInstance = GetGameInstance();
+	if (GameInstance)
+	{
+		GameInstance->GetTimerManager().ClearTimer(RejoinTimer);
+		GameInstance->GetTimerManager().SetTimerForNextTick(this, &ThisClass::RejoinFindById);
+	}
+}
+
+void UMultiplayerSessionsSubsystem::FinishRejoin(bool bWasSuccessful)
+{
+	const EMultiplayerRejoinStage FinishedStage = RejoinStage;
+	RejoinStage = EMultiplayerRejoinStage::None;
+	MultiplayerOnFindSessionComplete.Remove(RejoinFindHandle);
+	MultiplayerOnJoinPipelineComplete.Remove(RejoinPipelineHandle);
+	UGameInstance* GameInstance = GetGameInstance();
+	if (GameInstance)
+	{
+		GameInstance->GetTimerManager().ClearTimer(RejoinTimer);
+	}
+	EndTiming(EMultiplayerSessionsTiming::Rejoin, bWasSuccessful);
+	UE_LOG(LogTemp, Display, TEXT("MultiplayerSessions Rejoin result=%s stage=%s"),
+		bWasSuccessful ? TEXT("success") : TEXT("failure"),
+		FinishedStage == EMultiplayerRejoinStage::DirectTravel ? TEXT("DirectTravel") :
+		FinishedStage == EMultiplayerRejoinStage::FindById ? TEXT("FindById") : TEXT("FullSearch"));
+	if (!bWasSuccessful)
+	{
+		//原来那一局已经回不去了，不要每次断线都再试一遍
+		ClearRejoinInfo();
+	}
+	MultiplayerOnRejoinComplete.Broadcast(bWasSuccessful);
+}
+
+void UMultiplayerSessionsSubsystem::StartAutoJoin(const FMultiplayerSessionSearchFilter& Filter, int32 MaxAttempts)
+{
+	if (bAutoJoinActive)
+	{
+		return;
+	}
+	bAutoJoinActive = true;
+	AutoJoinAttempts = 0;
+	AutoJoinMaxAttempts = FMath::Max(1, MaxAttempts);
+	AutoJoinFilter = Filter;
+	AutoJoinStartTime = FPlatformTime::Seconds();
+	AutoJoinFindHandle = MultiplayerOnFindSessionComplete.AddUObject(this, &ThisClass::OnAutoJoinFindComplete);
+	AutoJoinPipelineHandle = MultiplayerOnJoinPipelineComplete.AddUObject(this, &ThisClass::OnAutoJoinPipelineComplete);
+	AutoJoinRankedHandle = MultiplayerOnSessionsRanked.AddUObject(this, &ThisClass::OnAutoJoinSessionsRanked);
+	//Initialize时世界还没创建好，等定时器第一次触发时再找房
+	UGameInstance* GameInstance = GetGameInstance();
+	if (GameInstance)
+	{
+		GameInstance->GetTimerManager().SetTimer(AutoJoinRetryTimer, this, &ThisClass::RetryAutoJoin, 1.f);
+	}
+}
+
+void UMultiplayerSessionsSubsystem::RetryAutoJoin()
+{
+	if (!bAutoJoinActive)
+	{
+		return;
+	}
+	if (!OnlineInterface.IsValid() || AutoJoinAttempts >= AutoJoinMaxAttempts)
+	{
+		FinishAutoJoin(false);
+		return;
+	}
+	++AutoJoinAttempts;
+	BeginJoinTrace(TEXT("AutoJoin"));
+	//每次都要最新的列表，不能用缓存里已经满了的会话
+	InvalidateSearchCache();
+	FindSession(10000, AutoJoinFilter);
+}
+
+void UMultiplayerSessionsSubsystem::OnAutoJoinFindComplete(const TArray<FOnlineSessionSearchResult>& SearchResults, bool bWasSuccessful)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::OnAutoJoinFindComplete);
+	if (!bAutoJoinActive)
+	{
+		return;
+	}
+	//先测速排序，在OnAutoJoinSessionsRanked里加入延迟最低的会话
+	if (bWasSuccessful && SearchResults.Num() > 0 && RankSessions(SearchResults, &AutoJoinRankRequestId))
+	{
+		return;
+	}
+	GetGameInstance()->GetTimerManager().SetTimer(AutoJoinRetryTimer, this, &ThisClass::RetryAutoJoin, 1.f);
+}
+
+void UMultiplayerSessionsSubsystem::OnAutoJoinSessionsRanked(int32 RequestId, const TArray<FMultiplayerRankedSession>& RankedSessions)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::OnAutoJoinSessionsRanked);
+	//别人（菜单、基准测试）发起的排序结果不处理
+	if (!bAutoJoinActive || RequestId != AutoJoinRankRequestId)
+	{
+		return;
+	}
+	AutoJoinRankRequestId = 0;
+	//加入和跳转交给流水线，一个会话失败了会自动换下一个
+	if (RankedSessions.Num() > 0 && JoinRankedSessions(RankedSessions))
+	{
+		return;
+	}
+	GetGameInstance()->GetTimerManager().SetTimer(AutoJoinRetryTimer, this, &ThisClass::RetryAutoJoin, 1.f);
+}
+
+void UMultiplayerSessionsSubsystem::OnAutoJoinPipelineComplete(bool bWasSuccessful, int32 Attempts, double SecondsToJoin)
+{
+	if (!bAutoJoinActive)
+	{
+		return;
+	}
+	if (bWasSuccessful)
+	{
+		FinishAutoJoin(true);
+		return;
+	}
+	GetGameInstance()->GetTimerManager().SetTimer(AutoJoinRetryTimer, this, &ThisClass::RetryAutoJoin, 1.f);
+}
+
+void UMultiplayerSessionsSubsystem::FinishAutoJoin(bool bWasSuccessful)
+{
+	bAutoJoinActive = false;
+	MultiplayerOnFindSessionComplete.Remove(AutoJoinFindHandle);
+	MultiplayerOnJoinPipelineComplete.Remove(AutoJoinPipelineHandle);
+	MultiplayerOnSessionsRanked.Remove(AutoJoinRankedHandle);
+	UGameInstance* GameInstance = GetGameInstance();
+	if (GameInstance)
+	{
+		GameInstance->GetTimerManager().ClearTimer(AutoJoinRetryTimer);
+	}
+	//压测脚本按这一行统计客户端的结果
+	UE_LOG(LogTemp, Display, TEXT("MultiplayerSessions AutoJoin result=%s attempts=%d seconds=%.3f"),
+		bWasSuccessful ? TEXT("success") : TEXT("failure"), AutoJoinAttempts, FPlatformTime::Seconds() - AutoJoinStartTime);
+	MultiplayerSessionsStats::DumpToLog();
+}
+
+bool UMultiplayerSessionsSubsystem::SetSessionJoinable(bool bJoinable)
+{
+	if (!OnlineInterface.IsValid())
+	{
+		return false;
+	}
+	FOnlineSessionSettings* Settings = OnlineInterface->GetSessionSettings(NAME_GameSession);
+	if (Settings == nullptr)
+	{
+		return false;
+	}
+	if (Settings->bAllowJoinInProgress == bJoinable && Settings->bShouldAdvertise == bJoinable)
+	{
+		return true;
+	}
+	//不再补位时也不再广播，找房的人就不会再搜到这个会话
+	FOnlineSessionSettings UpdatedSettings = *Settings;
+	UpdatedSettings.bAllowJoinInProgress = bJoinable;
+	UpdatedSettings.bShouldAdvertise = bJoinable;
+	return OnlineInterface->UpdateSession(NAME_GameSession, UpdatedSettings);
+}
+
+bool UMultiplayerSessionsSubsystem::ResolveConnectString(FString& OutAddress)
+{
+	if (!OnlineInterface.IsValid())
+	{
+		return false;
+	}
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::ResolveConnectString);
+	BeginTiming(EMultiplayerSessionsTiming::ResolveConnectString);
+	const bool bResolved = OnlineInterface->GetResolvedConnectString(NAME_GameSession, OutAddress);
+	EndTiming(EMultiplayerSessionsTiming::ResolveConnectString, bResolved);
+	return bResolved;
+}
+
+void UMultiplayerSessionsSubsystem::ClientTravel(const FString& Address)
+{
+	UGameInstance* GameInstance = GetGameInstance();
+	APlayerController* PlayerController = GameInstance ? GameInstance->GetFirstLocalPlayerController() : nullptr;
+	if (PlayerController)
+	{
+		MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::ClientTravel);
+		//离开菜单了，不再需要刷新会话列表
+		SetSearchCacheBackgroundRefresh(false);
+		BeginTiming(EMultiplayerSessionsTiming::ClientTravel);
+		//加入ID跟着URL带到服务器的Login选项里，服务器的书签也用它
+		FString URL = Address;
+		if (!JoinTraceId.IsEmpty())
+		{
+			URL += FString::Printf(TEXT("?%s=%s"), MultiplayerSessionsTrace::JoinIdOption, *JoinTraceId);
+		}
+		PlayerController->ClientTravel(URL, ETravelType::TRAVEL_Absolute);
+	}
+}
+
+bool UMultiplayerSessionsSubsystem::ServerTravel(const FString& URL)
+{
+	UWorld* World = GetWorld();
+	if (World == nullptr)
+	{
+		return false;
+	}
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::ServerTravel);
+	SetSearchCacheBackgroundRefresh(false);
+	BeginTiming(EMultiplayerSessionsTiming::ServerTravel);
+	if (!World->ServerTravel(URL))
+	{
+		EndTiming(EMultiplayerSessionsTiming::ServerTravel, false);
+		return false;
+	}
+	return true;
+}
+
+bool UMultiplayerSessionsSubsystem::CreateSession(int32 NumPublicConnections, FString MatchType)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::CreateSession);
+	if(!OnlineInterface.IsValid())
+	{
+		return false;
+	}
+	if (IsSessionOpInProgress())
+	{
+		//同样参数的重复建房请求合并到正在进行的那一次，完成时只广播一次
+		if (SessionOpChain == EMultiplayerSessionOp::Create &&
+			PendingNumPublicConnections == NumPublicConnections && PendingMatchType == MatchType)
+		{
+			return true;
+		}
+		UE_LOG(LogTemp, Warning, TEXT("CreateSession rejected: another session operation is in progress"));
+		return false;
+	}
+	//开始建房后就不需要再刷新会话列表了
+	StopSearchCacheRefresh();
+	BeginJoinTrace(TEXT("Host"));
+
+	BeginTiming(EMultiplayerSessionsTiming::CreateSession);
+	PendingNumPublicConnections = NumPublicConnections;
+	PendingMatchType = MatchType;
+	DesiredNumPublicConnections = NumPublicConnections;
+	DesiredMatchType = MatchType;
+
+	//已经有会话时必须等销毁完成后再创建，否则创建会失败
+	SessionOpChain = EMultiplayerSessionOp::Create;
+	PendingSessionOps.Reset();
+	if (OnlineInterface->GetNamedSession(NAME_GameSession) != nullptr)
+	{
+		PendingSessionOps.Add(EMultiplayerSessionOp::Destroy);
+	}
+	PendingSessionOps.Add(EMultiplayerSessionOp::Create);
+	if (bStartSessionAfterCreate)
+	{
+		PendingSessionOps.Add(EMultiplayerSessionOp::Start);
+	}
+	RunNextSessionOp();
+	return true;
+}
+
+bool UMultiplayerSessionsSubsystem::BeginCreateSession()
+{
+	//用一个deletegateHandle来表示这个 委托，这样方便我们以后在委托list中删除这个委托。
+	CreateSessionCompleteDelegateHandle = OnlineInterface->AddOnCreateSessionCompleteDelegate_Handle(CreateSessionCompleteDelegate);
+
+	LastSessionSettings = MakeShareable(new FOnlineSessionSettings());
+	LastSessionSettings->bIsLANMatch =IOnlineSubsystem::Get()->GetSubsystemName()=="NULL"?true:false;
+	LastSessionSettings->NumPublicConnections = PendingNumPublicConnections;
+	LastSessionSettings->bAllowJoinInProgress =true;
+	LastSessionSettings->bShouldAdvertise = true;
+	//专用服务器没有本地玩家，不能用presence和Steam大厅，只能作为游戏服务器广播
+	const bool bDedicated = IsRunningDedicatedServer();
+	LastSessionSettings->bIsDedicated = bDedicated;
+	LastSessionSettings->bAllowJoinViaPresence = !bDedicated;
+	LastSessionSettings->bUsesPresence = !bDedicated;
+	LastSessionSettings->bUseLobbiesIfAvailable = !bDedicated;
+	//这个matchType就是为了我们后来去找会话时，可以通过这个Matchtpye来确定那个使我们想要的那个会话。
+	LastSessionSettings->Set(FName("MatchType"),PendingMatchType,EOnlineDataAdvertisementType::ViaOnlineServiceAndPing);
+	//版本号也广播出去，找房的一方可以直接在查询里过滤掉不兼容的会话
+	LastSessionSettings->Set(FName("BuildVersion"),GetLocalBuildVersion(),EOnlineDataAdvertisementType::ViaOnlineServiceAndPing);
+
+	const FUniqueNetIdRepl LocalPlayerId = GetLocalPlayerId();
+	const bool bCreated = LocalPlayerId.IsValid() ?
+		OnlineInterface->CreateSession(*LocalPlayerId, NAME_GameSession, *LastSessionSettings) :
+		OnlineInterface->CreateSession(0, NAME_GameSession, *LastSessionSettings);
+	if (!bCreated)
+	{
+		OnlineInterface->ClearOnCreateSessionCompleteDelegate_Handle(CreateSessionCompleteDelegateHandle);
+		return false;
+	}
+	return true;
+}
+void UMultiplayerSessionsSubsystem::FindSession(int32 MaxSearchResults, const FMultiplayerSessionSearchFilter& Filter)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::FindSession);
+	if(!OnlineInterface.IsValid())return;
+	if (IsSearchCacheValid(MaxSearchResults, Filter))
+	{
+		//命中缓存：不用等后端，直接把上次的结果交给菜单
+		const double CacheAge = FPlatformTime::Seconds() - CachedSearchTime;
+		INC_DWORD_STAT(STAT_MPS_SearchCacheHits);
+		MultiplayerSessionsTrace::Bookmark(TEXT("FindSessionCacheHit"), JoinTraceId, FString::Printf(TEXT("%d results"), CachedSearchResults.Num()));
+		MultiplayerOnFindSessionComplete.Broadcast(CachedSearchResults, true);
+		if (CacheAge >= SearchCacheRefreshAge)
+		{
+			//缓存有点旧了，后台刷新一次，变化通过MultiplayerOnSessionSearchDelta通知
+			StartSessionSearch(MaxSearchResults, Filter, true);
+		}
+		return;
+	}
+	StartSessionSearch(MaxSearchResults, Filter, false);
+}
+
+void UMultiplayerSessionsSubsystem::StartSessionSearch(int32 MaxSearchResults, const FMultiplayerSessionSearchFilter& Filter, bool bBackgroundRefresh)
+{
+	if (bSearchInProgress)
+	{
+		if (Filter != RefreshSearchFilter && !bBackgroundRefresh)
+		{
+			bRestartSearchWithPendingFilter = true;
+			PendingMaxSearchResults = MaxSearchResults;
+			PendingSearchFilter = Filter;
+			return;
+		}
+		//重复点击Join时不重复发起搜索，合并到正在进行的那一次；前台请求要保证完成时广播完整结果
+		bSearchIsBackgroundRefresh = bSearchIsBackgroundRefresh && bBackgroundRefresh;
+		return;
+	}
+	FindSessionCompleteDelegateHandle=OnlineInterface->AddOnFindSessionsCompleteDelegate_Handle(FindSessionsCompleteDelegate);
+	LastSessionSearch = MakeShareable(new FOnlineSessionSearch());
+	LastSessionSearch->MaxSearchResults = MaxSearchResults;
+	LastSessionSearch->bIsLanQuery = IOnlineSubsystem::Get()->GetSubsystemName() == "NULL" ? true : false;
+	if (Filter.bDedicatedServers)
+	{
+		LastSessionSearch->QuerySettings.Set(SEARCH_DEDICATED_ONLY, true, EOnlineComparisonOp::Equals);
+	}
+	else
+	{
+		LastSessionSearch->QuerySettings.Set(SEARCH_PRESENCE, true, EOnlineComparisonOp::Equals);
+	}
+	Filter.ApplyToQuery(LastSessionSearch->QuerySettings);
+	RefreshMaxSearchResults = MaxSearchResults;
+	RefreshSearchFilter = Filter;
+	bSearchInProgress = true;
+	BeginTiming(EMultiplayerSessionsTiming::FindSession);
+	bSearchIsBackgroundRefresh = bBackgroundRefresh;
+	const FUniqueNetIdRepl LocalPlayerId = GetLocalPlayerId();
+	const bool bSearchStarted = LocalPlayerId.IsValid() ?
+		OnlineInterface->FindSessions(*LocalPlayerId, LastSessionSearch.ToSharedRef()) :
+		OnlineInterface->FindSessions(0, LastSessionSearch.ToSharedRef());
+	if (!bSearchStarted)
+	{
+		OnlineInterface->ClearOnFindSessionsCompleteDelegate_Handle(FindSessionCompleteDelegateHandle);
+		bSearchInProgress = false;
+		EndTiming(EMultiplayerSessionsTiming::FindSession, false);
+
+		if (!bSearchIsBackgroundRefresh)
+		{
+			MultiplayerOnFindSessionComplete.Broadcast(TArray<FOnlineSessionSearchResult>(), false);
+		}
+	}
+}
+
+bool UMultiplayerSessionsSubsystem::IsSearchCacheValid(int32 MaxSearchResults, const FMultiplayerSessionSearchFilter& Filter) const
+{
+	//缓存的结果数上限比这次要求的少时，不能保证结果完整
+	return CachedSearchResults.Num() > 0 &&
+		CachedSearchFilter == Filter &&
+		CachedMaxSearchResults >= MaxSearchResults &&
+		FPlatformTime::Seconds() - CachedSearchTime < SearchCacheTTL;
+}
+
+void UMultiplayerSessionsSubsystem::InvalidateSearchCache()
+{
+	CachedSearchResults.Reset();
+	CachedSearchTime = 0.0;
+	CachedMaxSearchResults = 0;
+}
+
+bool UMultiplayerSessionsSubsystem::UseSessionInterface(IOnlineSessionPtr InSessionInterface)
+{
+	if (IsSessionOpInProgress() || bSearchInProgress || bJoinPipelineActive || IsRejoinInProgress())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UseSessionInterface rejected: a session operation is in progress"));
+		return false;
+	}
+	//旧接口上的结果和测速对新接口没有意义
+	CancelRanking();
+	StopSearchCacheRefresh();
+	InvalidateSearchCache();
+	QosRttCache.Reset();
+	OnlineInterface = InSessionInterface;
+	return true;
+}
+
+FUniqueNetIdRepl UMultiplayerSessionsSubsystem::GetLocalPlayerId() const
+{
+	//专用服务器和无头客户端没有本地玩家，这时返回无效的Id，调用方改用0号用户
+	UWorld* World = GetWorld();
+	const ULocalPlayer* LocalPlayer = World ? World->GetFirstLocalPlayerFromController() : nullptr;
+	return LocalPlayer ? LocalPlayer->GetPreferredUniqueNetId() : FUniqueNetIdRepl();
+}
+
+int32 UMultiplayerSessionsSubsystem::GetLocalBuildVersion()
+{
+	return static_cast<int32>(FNetworkVersion::GetLocalNetworkVersion());
+}
+
+void UMultiplayerSessionsSubsystem::BroadcastSearchDelta(const TArray<FOnlineSessionSearchResult>& OldResults)
+{
+	TMap<FString, const FOnlineSessionSearchResult*> OldById;
+	OldById.Reserve(OldResults.Num());
+	for (const FOnlineSessionSearchResult& Result : OldResults)
 	{
-		OnlineInterface = Subsystem->GetSessionInterface();
+		OldById.Add(Result.GetSessionIdStr(), &Result);
+	}
+
+	TArray<FOnlineSessionSearchResult> Added;
+	TArray<FOnlineSessionSearchResult> Changed;
+	for (const FOnlineSessionSearchResult& Result : CachedSearchResults)
+	{
+		const FOnlineSessionSearchResult* Old = nullptr;
+		if (OldById.RemoveAndCopyValue(Result.GetSessionIdStr(), Old))
+		{
+			if (MultiplayerSessionsCache::HasResultChanged(*Old, Result))
+			{
+				Changed.Add(Result);
+			}
+		}
+		else
+		{
+			Added.Add(Result);
+		}
+	}
+	//剩下的就是这次没有再搜到的会话
+	TArray<FString> Removed;
+	OldById.GenerateKeyArray(Removed);
+
+	if (Added.Num() > 0 || Removed.Num() > 0 || Changed.Num() > 0)
+	{
+		MultiplayerOnSessionSearchDelta.Broadcast(Added, Removed, Changed);
 	}
-	
 }
-void UMultiplayerSessionsSubsystem::CreateSession(int32 NumPublicConnections, FString MatchType)
+
+void UMultiplayerSessionsSubsystem::SetSearchCacheBackgroundRefresh(bool bEnabled)
 {
-	if(!OnlineInterface.IsValid())
+	bBackgroundRefreshEnabled = bEnabled;
+	if (!bEnabled)
 	{
+		StopSearchCacheRefresh();
 		return;
 	}
-	auto ExistingSession = OnlineInterface->GetNamedSession(NAME_GameSession);
-	if(ExistingSession!= nullptr)
+	//还没搜过就没有可以刷新的条件，等第一次找房完成时再开始；正在搜的话也等它完成
+	if (RefreshMaxSearchResults > 0 && !bSearchInProgress)
 	{
-		OnlineInterface->DestroySession(NAME_GameSession);
+		ScheduleSearchCacheRefresh(false);
 	}
-	//用一个deletegateHandle来表示这个 委托，这样方便我们以后在委托list中删除这个委托。
-	CreateSessionCompleteDelegateHandle = OnlineInterface->AddOnCreateSessionCompleteDelegate_Handle(CreateSessionCompleteDelegate);
+}
 
-	LastSessionSettings = MakeShareable(new FOnlineSessionSettings());
-	LastSessionSettings->bIsLANMatch =IOnlineSubsystem::Get()->GetSubsystemName()=="NULL"?true:false;
-	LastSessionSettings->NumPublicConnections = NumPublicConnections;
-	LastSessionSettings->bAllowJoinInProgress =true;
-	LastSessionSettings->bAllowJoinViaPresence = true;
-	LastSessionSettings->bShouldAdvertise = true;
-	LastSessionSettings->bUsesPresence = true;
-	LastSessionSettings->bUseLobbiesIfAvailable = true;
-	//这个matchType就是为了我们后来去找会话时，可以通过这个Matchtpye来确定那个使我们想要的那个会话。
-	LastSessionSettings->Set(FName("MatchType"),MatchType,EOnlineDataAdvertisementType::ViaOnlineServiceAndPing);
+void UMultiplayerSessionsSubsystem::ScheduleSearchCacheRefresh(bool bRestart)
+{
+	UGameInstance* GameInstance = GetGameInstance();
+	if (GameInstance == nullptr || !bBackgroundRefreshEnabled || SearchCacheBackgroundRefreshInterval <= 0.f)
+	{
+		return;
+	}
+	FTimerManager& TimerManager = GameInstance->GetTimerManager();
+	if (bRestart || !TimerManager.IsTimerActive(SearchCacheRefreshTimer))
+	{
+		TimerManager.SetTimer(SearchCacheRefreshTimer, this, &ThisClass::OnSearchCacheRefreshTimer, SearchCacheBackgroundRefreshInterval);
+	}
+}
 
-	const ULocalPlayer* LocalPlayer = GetWorld()->GetFirstLocalPlayerFromController();
-	if (!OnlineInterface->CreateSession(*LocalPlayer->GetPreferredUniqueNetId(),NAME_GameSession,*LastSessionSettings))
+void UMultiplayerSessionsSubsystem::OnSearchCacheRefreshTimer()
+{
+	if (bBackgroundRefreshEnabled && OnlineInterface.IsValid())
 	{
-		OnlineInterface->ClearOnCreateSessionCompleteDelegate_Handle(CreateSessionCompleteDelegateHandle);
-		MultiplayerOnCreateSessionComplete.Broadcast(false);
+		StartSessionSearch(RefreshMaxSearchResults, RefreshSearchFilter, true);
 	}
-	
 }
-void UMultiplayerSessionsSubsystem::FindSession(int32 MaxSearchResults)
+
+void UMultiplayerSessionsSubsystem::StopSearchCacheRefresh()
 {
-	if(!OnlineInterface.IsValid())return;
-	FindSessionCompleteDelegateHandle=OnlineInterface->AddOnFindSessionsCompleteDelegate_Handle(FindSessionsCompleteDelegate);
-	LastSessionSearch = MakeShareable(new FOnlineSessionSearch());
-	LastSessionSearch->MaxSearchResults = MaxSearchResults;
-	LastSessionSearch->bIsLanQuery = IOnlineSubsystem::Get()->GetSubsystemName() == "NULL" ? true : false;
-	LastSessionSearch->QuerySettings.Set(SEARCH_PRESENCE, true, EOnlineComparisonOp::Equals);
-	const ULocalPlayer* LocalPlayer = GetWorld()->GetFirstLocalPlayerFromController();
-	if (!OnlineInterface->FindSessions(*LocalPlayer->GetPreferredUniqueNetId(), LastSessionSearch.ToSharedRef()))
+	UGameInstance* GameInstance = GetGameInstance();
+	if (GameInstance)
 	{
-		OnlineInterface->ClearOnFindSessionsCompleteDelegate_Handle(FindSessionCompleteDelegateHandle);
+		GameInstance->GetTimerManager().ClearTimer(SearchCacheRefreshTimer);
+	}
+}
 
-		MultiplayerOnFindSessionComplete.Broadcast(TArray<FOnlineSessionSearchResult>(), false);
+bool UMultiplayerSessionsSubsystem::RankSessions(const TArray<FOnlineSessionSearchResult>& Candidates, int32* OutRequestId)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::RankSessions);
+	UGameInstance* GameInstance = GetGameInstance();
+	if (!OnlineInterface.IsValid() || GameInstance == nullptr)
+	{
+		return false;
+	}
+	CancelRanking();
+	bQosInProgress = true;
+	++QosRequestId;
+	if (OutRequestId)
+	{
+		*OutRequestId = QosRequestId;
+	}
+	BeginTiming(EMultiplayerSessionsTiming::QosRanking);
+
+	const double Now = FPlatformTime::Seconds();
+	QosCandidates.Reset(Candidates.Num());
+	QosPingHosts.Reset(Candidates.Num());
+	for (const FOnlineSessionSearchResult& Candidate : Candidates)
+	{
+		if (!Candidate.IsValid())
+		{
+			continue;
+		}
+		FMultiplayerRankedSession& Ranked = QosCandidates.AddDefaulted_GetRef();
+		Ranked.Result = Candidate;
+		const int32 MaxPlayers = Candidate.Session.SessionSettings.NumPublicConnections;
+		Ranked.OpenSlots = Candidate.Session.NumOpenPublicConnections;
+		Ranked.FillRatio = MaxPlayers > 0 ? FMath::Clamp(static_cast<float>(MaxPlayers - Ranked.OpenSlots) / MaxPlayers, 0.f, 1.f) : 0.f;
+		//先用后端给的延迟兜底，ping成功后再覆盖
+		if (Candidate.PingInMs >= 0 && Candidate.PingInMs < MAX_QUERY_PING)
+		{
+			Ranked.RttMs = static_cast<float>(Candidate.PingInMs);
+			Ranked.bReachable = true;
+		}
+
+		FString& Host = QosPingHosts.AddDefaulted_GetRef();
+		const FQosCacheEntry* Cached = QosRttCache.Find(Candidate.GetSessionIdStr());
+		if (Cached && Now - Cached->Time < QosCacheTTL)
+		{
+			INC_DWORD_STAT(STAT_MPS_QosCacheHits);
+			Ranked.RttMs = Cached->RttMs;
+			Ranked.bMeasured = true;
+			Ranked.bReachable = true;
+			continue;
+		}
+		FString ConnectString;
+		if (OnlineInterface->GetResolvedConnectString(Candidate, NAME_GamePort, ConnectString))
+		{
+			Host = MultiplayerSessionsQos::GetPingableHost(ConnectString);
+		}
+	}
+
+	GameInstance->GetTimerManager().SetTimer(QosDeadlineTimer, this, &ThisClass::OnQosDeadline, FMath::Max(QosDeadlineSeconds, 0.01f));
+	StartNextQosPings();
+	return true;
+}
+
+void UMultiplayerSessionsSubsystem::CancelRanking()
+{
+	if (!bQosInProgress)
+	{
+		return;
+	}
+	++QosGeneration;
+	bQosInProgress = false;
+	QosPingsInFlight = 0;
+	QosNextCandidate = 0;
+	UGameInstance* GameInstance = GetGameInstance();
+	if (GameInstance)
+	{
+		GameInstance->GetTimerManager().ClearTimer(QosDeadlineTimer);
+	}
+	EndTiming(EMultiplayerSessionsTiming::QosRanking, false);
+}
+
+void UMultiplayerSessionsSubsystem::StartNextQosPings()
+{
+	const int32 MaxInFlight = FMath::Max(1, QosMaxConcurrentPings);
+	while (bQosInProgress && QosPingsInFlight < MaxInFlight && QosNextCandidate < QosCandidates.Num())
+	{
+		const int32 CandidateIndex = QosNextCandidate++;
+		const FString& Host = QosPingHosts[CandidateIndex];
+		if (Host.IsEmpty())
+		{
+			continue;
+		}
+		++QosPingsInFlight;
+		INC_DWORD_STAT(STAT_MPS_QosPingsSent);
+		//回调在游戏线程上执行；子系统可能已经销毁，或者这一轮已经被取消
+		TWeakObjectPtr<UMultiplayerSessionsSubsystem> WeakThis(this);
+		const int32 Generation = QosGeneration;
+		FIcmp::IcmpEcho(Host, QosPingTimeoutSeconds, [WeakThis, Generation, CandidateIndex](FIcmpEchoResult EchoResult)
+		{
+			if (UMultiplayerSessionsSubsystem* StrongThis = WeakThis.Get())
+			{
+				StrongThis->OnQosPingComplete(Generation, CandidateIndex,
+					EchoResult.Status == EIcmpResponseStatus::Success, EchoResult.Time * 1000.f);
+			}
+		});
+	}
+	if (bQosInProgress && QosPingsInFlight == 0 && QosNextCandidate >= QosCandidates.Num())
+	{
+		FinishRanking();
+	}
+}
+
+void UMultiplayerSessionsSubsystem::OnQosPingComplete(int32 Generation, int32 CandidateIndex, bool bSuccess, float RttMs)
+{
+	if (Generation != QosGeneration || !bQosInProgress || !QosCandidates.IsValidIndex(CandidateIndex))
+	{
+		return;
+	}
+	--QosPingsInFlight;
+	if (bSuccess)
+	{
+		FMultiplayerRankedSession& Ranked = QosCandidates[CandidateIndex];
+		Ranked.RttMs = RttMs;
+		Ranked.bMeasured = true;
+		Ranked.bReachable = true;
+		QosRttCache.Add(Ranked.Result.GetSessionIdStr(), FQosCacheEntry{RttMs, FPlatformTime::Seconds()});
+	}
+	else
+	{
+		//ping不通（防火墙挡了ICMP也很常见）不代表连不上，保留后端给的延迟
+		INC_DWORD_STAT(STAT_MPS_QosPingsFailed);
+	}
+	StartNextQosPings();
+}
+
+void UMultiplayerSessionsSubsystem::OnQosDeadline()
+{
+	if (bQosInProgress)
+	{
+		UE_LOG(LogTemp, Log, TEXT("MultiplayerSessions QoS deadline reached with %d pings in flight and %d not started"),
+			QosPingsInFlight, QosCandidates.Num() - QosNextCandidate);
+		FinishRanking();
+	}
+}
+
+void UMultiplayerSessionsSubsystem::FinishRanking()
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::FinishRanking);
+	//迟到的回调按轮次丢弃
+	++QosGeneration;
+	bQosInProgress = false;
+	QosPingsInFlight = 0;
+	QosNextCandidate = 0;
+	UGameInstance* GameInstance = GetGameInstance();
+	if (GameInstance)
+	{
+		GameInstance->GetTimerManager().ClearTimer(QosDeadlineTimer);
+	}
+
+	TArray<FMultiplayerRankedSession> Ranked = MoveTemp(QosCandidates);
+	QosPingHosts.Reset();
+	SortRankedSessions(Ranked);
+	EndTiming(EMultiplayerSessionsTiming::QosRanking, Ranked.Num() > 0);
+	if (Ranked.Num() > 0)
+	{
+		SET_FLOAT_STAT(STAT_MPS_QosBestRttMs, Ranked[0].RttMs);
+		UE_LOG(LogTemp, Log, TEXT("MultiplayerSessions QoS best of %d: %s rtt=%.1f ms (%s) open=%d fill=%.2f"),
+			Ranked.Num(), *Ranked[0].Result.GetSessionIdStr(), Ranked[0].RttMs,
+			Ranked[0].bMeasured ? TEXT("icmp") : TEXT("backend"), Ranked[0].OpenSlots, Ranked[0].FillRatio);
+	}
+	MultiplayerOnSessionsRanked.Broadcast(QosRequestId, Ranked);
+}
+
+void UMultiplayerSessionsSubsystem::SortRankedSessions(TArray<FMultiplayerRankedSession>& Sessions) const
+{
+	const float BucketMs = FMath::Max(QosRttBucketMs, 1.f);
+	Sessions.StableSort([BucketMs](const FMultiplayerRankedSession& A, const FMultiplayerRankedSession& B)
+	{
+		if (A.bReachable != B.bReachable)
+		{
+			return A.bReachable;
+		}
+		const int32 BucketA = FMath::FloorToInt(A.RttMs / BucketMs);
+		const int32 BucketB = FMath::FloorToInt(B.RttMs / BucketMs);
+		if (BucketA != BucketB)
+		{
+			return BucketA < BucketB;
+		}
+		//延迟差不多时优先人多的会话，更快凑满开局
+		if (!FMath::IsNearlyEqual(A.FillRatio, B.FillRatio))
+		{
+			return A.FillRatio > B.FillRatio;
+		}
+		if (A.OpenSlots != B.OpenSlots)
+		{
+			return A.OpenSlots > B.OpenSlots;
+		}
+		return A.RttMs < B.RttMs;
+	});
+}
+
+bool UMultiplayerSessionsSubsystem::JoinRankedSessions(const TArray<FMultiplayerRankedSession>& RankedSessions, const FString& ExpectedMap)
+{
+	TArray<FOnlineSessionSearchResult> Candidates;
+	Candidates.Reserve(RankedSessions.Num());
+	for (const FMultiplayerRankedSession& Ranked : RankedSessions)
+	{
+		Candidates.Add(Ranked.Result);
+	}
+	return JoinCandidateSessions(Candidates, ExpectedMap);
+}
+
+bool UMultiplayerSessionsSubsystem::JoinCandidateSessions(const TArray<FOnlineSessionSearchResult>& Candidates, const FString& ExpectedMap)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::JoinCandidateSessions);
+	if (!OnlineInterface.IsValid() || Candidates.Num() == 0)
+	{
+		return false;
+	}
+	if (bJoinPipelineActive || IsSessionOpInProgress())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("JoinCandidateSessions rejected: another session operation is in progress"));
+		return false;
+	}
+	bJoinPipelineActive = true;
+	JoinPipelineCandidates = Candidates;
+	JoinPipelineExpectedMap = ExpectedMap;
+	JoinPipelineNextCandidate = 0;
+	JoinPipelineAttempts = 0;
+	JoinPipelineStartTime = FPlatformTime::Seconds();
+	BeginTiming(EMultiplayerSessionsTiming::TimeToJoin);
+	JoinPipelineJoinHandle = MultiplayerOnJoinSessionComplete.AddUObject(this, &ThisClass::OnJoinPipelineAttemptComplete);
+	TryNextJoinCandidate();
+	return true;
+}
+
+void UMultiplayerSessionsSubsystem::CancelJoinPipeline()
+{
+	if (!bJoinPipelineActive)
+	{
+		return;
+	}
+	bJoinAttemptInFlight = false;
+	FinishJoinPipeline(false);
+}
+
+void UMultiplayerSessionsSubsystem::TryNextJoinCandidate()
+{
+	UGameInstance* GameInstance = GetGameInstance();
+	const int32 MaxAttempts = FMath::Max(1, JoinPipelineMaxAttempts);
+	while (bJoinPipelineActive && JoinPipelineNextCandidate < JoinPipelineCandidates.Num() && JoinPipelineAttempts < MaxAttempts)
+	{
+		const FOnlineSessionSearchResult& Candidate = JoinPipelineCandidates[JoinPipelineNextCandidate++];
+		if (!Candidate.IsValid())
+		{
+			continue;
+		}
+		//别的会话操作还没完时JoinSession直接拒绝，也不广播，换候选也一样会被拒绝；不算尝试，整条流水线按失败结束
+		if (IsSessionOpInProgress())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("MultiplayerSessions join pipeline stopped: another session operation is in progress"));
+			break;
+		}
+		if (JoinPipelineAttempts > 0)
+		{
+			INC_DWORD_STAT(STAT_MPS_JoinFailovers);
+		}
+		const int32 Attempt = ++JoinPipelineAttempts;
+		bJoinAttemptInFlight = true;
+		MultiplayerSessionsTrace::Bookmark(TEXT("JoinAttempt"), JoinTraceId,
+			FString::Printf(TEXT("%d %s"), JoinPipelineAttempts, *Candidate.GetSessionIdStr()));
+		if (JoinSession(Candidate))
+		{
+			//加入已经发出去了才开始计超时；同步完成时回调里已经换到了下一个候选，那次尝试自己会设
+			if (GameInstance && JoinAttemptTimeoutSeconds > 0.f && bJoinAttemptInFlight && JoinPipelineAttempts == Attempt)
+			{
+				GameInstance->GetTimerManager().SetTimer(JoinAttemptTimer, this, &ThisClass::OnJoinAttemptTimeout, JoinAttemptTimeoutSeconds);
+			}
+			return;
+		}
+		if (!bJoinAttemptInFlight)
+		{
+			return;
+		}
+		bJoinAttemptInFlight = false;
+	}
+	if (bJoinPipelineActive)
+	{
+		FinishJoinPipeline(false);
+	}
+}
+
+void UMultiplayerSessionsSubsystem::OnJoinPipelineAttemptComplete(EOnJoinSessionCompleteResult::Type Result)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::OnJoinPipelineAttemptComplete);
+	if (!bJoinPipelineActive || !bJoinAttemptInFlight)
+	{
+		return;
+	}
+	bJoinAttemptInFlight = false;
+	UGameInstance* GameInstance = GetGameInstance();
+	if (GameInstance)
+	{
+		GameInstance->GetTimerManager().ClearTimer(JoinAttemptTimer);
+	}
+
+	const FOnlineSessionSearchResult& Candidate = JoinPipelineCandidates[JoinPipelineNextCandidate - 1];
+	const FString SessionId = Candidate.GetSessionIdStr();
+	FString Address;
+	if (Result == EOnJoinSessionCompleteResult::Success && ResolveConnectString(Address))
+	{
+		//记下来，断线或崩溃后可以直接连回这个地址
+		RememberJoinedSession(Candidate, Address);
+		if (!JoinPipelineExpectedMap.IsEmpty())
+		{
+			UMultiplayerPreloadSubsystem* PreloadSubsystem = GameInstance ? GameInstance->GetSubsystem<UMultiplayerPreloadSubsystem>() : nullptr;
+			if (PreloadSubsystem)
+			{
+				PreloadSubsystem->NotifyTravelStarted(JoinPipelineExpectedMap);
+			}
+		}
+		FinishJoinPipeline(true);
+		ClientTravel(Address);
+		return;
+	}
+	//列表里的会话可能已经满了或者已经关了，换下一个，不用重新搜索
+	UE_LOG(LogTemp, Log, TEXT("MultiplayerSessions join attempt %d failed on %s (%s), trying next candidate"),
+		JoinPipelineAttempts, *SessionId, Result == EOnJoinSessionCompleteResult::Success ? TEXT("ResolveConnectStringFailed") : LexToString(Result));
+	TryNextJoinCandidate();
+}
+
+void UMultiplayerSessionsSubsystem::OnJoinAttemptTimeout()
+{
+	if (!bJoinPipelineActive || !bJoinAttemptInFlight)
+	{
+		return;
 	}
+	UE_LOG(LogTemp, Log, TEXT("MultiplayerSessions join attempt %d timed out after %.1f s"), JoinPipelineAttempts, JoinAttemptTimeoutSeconds);
+	//按失败结束当前的加入，广播出来的结果会让流水线换下一个候选
+	if (SessionOpChain == EMultiplayerSessionOp::Join)
+	{
+		AbortSessionOpChain();
+		return;
+	}
+	bJoinAttemptInFlight = false;
+	TryNextJoinCandidate();
+}
+
+void UMultiplayerSessionsSubsystem::FinishJoinPipeline(bool bWasSuccessful)
+{
+	bJoinPipelineActive = false;
+	MultiplayerOnJoinSessionComplete.Remove(JoinPipelineJoinHandle);
+	UGameInstance* GameInstance = GetGameInstance();
+	if (GameInstance)
+	{
+		GameInstance->GetTimerManager().ClearTimer(JoinAttemptTimer);
+	}
+	const int32 Attempts = JoinPipelineAttempts;
+	const double SecondsToJoin = FPlatformTime::Seconds() - JoinPipelineStartTime;
+	JoinPipelineCandidates.Reset();
+	EndTiming(EMultiplayerSessionsTiming::TimeToJoin, bWasSuccessful);
+	SET_DWORD_STAT(STAT_MPS_LastJoinAttempts, Attempts);
+	CSV_CUSTOM_STAT(MultuplayerSessions, JoinAttempts, Attempts, ECsvCustomStatOp::Set);
+	UE_LOG(LogTemp, Display, TEXT("MultiplayerSessions JoinPipeline result=%s attempts=%d seconds=%.3f"),
+		bWasSuccessful ? TEXT("success") : TEXT("failure"), Attempts, SecondsToJoin);
+	MultiplayerOnJoinPipelineComplete.Broadcast(bWasSuccessful, Attempts, SecondsToJoin);
 }
-void UMultiplayerSessionsSubsystem::JoinSession(const FOnlineSessionSearchResult& SessionResult)
+
+bool UMultiplayerSessionsSubsystem::JoinSession(const FOnlineSessionSearchResult& SessionResult)
 {
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::JoinSession);
 	if (!OnlineInterface.IsValid())
 	{
 		MultiplayerOnJoinSessionComplete.Broadcast(EOnJoinSessionCompleteResult::UnknownError);
-		return;
+		return false;
+	}
+	if (IsSessionOpInProgress())
+	{
+		//重复加入同一个会话时合并
+		if (SessionOpChain == EMultiplayerSessionOp::Join &&
+			PendingJoinResult.GetSessionIdStr() == SessionResult.GetSessionIdStr())
+		{
+			return true;
+		}
+		UE_LOG(LogTemp, Warning, TEXT("JoinSession rejected: another session operation is in progress"));
+		return false;
 	}
+	StopSearchCacheRefresh();
+
+	BeginTiming(EMultiplayerSessionsTiming::JoinSession);
+	PendingJoinResult = SessionResult;
+	SessionOpChain = EMultiplayerSessionOp::Join;
+	PendingSessionOps.Reset();
+	//之前留下的会话会让JoinSession直接失败，先销毁
+	if (OnlineInterface->GetNamedSession(NAME_GameSession) != nullptr)
+	{
+		PendingSessionOps.Add(EMultiplayerSessionOp::Destroy);
+	}
+	PendingSessionOps.Add(EMultiplayerSessionOp::Join);
+	RunNextSessionOp();
+	return true;
+}
+
+bool UMultiplayerSessionsSubsystem::BeginJoinSession()
+{
 	JoinSessionCompleteDelegateHandle = OnlineInterface->AddOnJoinSessionCompleteDelegate_Handle(JoinSessionCompleteDelegate);
 
-	const ULocalPlayer* LocalPlayer = GetWorld()->GetFirstLocalPlayerFromController();
-	if (!OnlineInterface->JoinSession(*LocalPlayer->GetPreferredUniqueNetId(), NAME_GameSession, SessionResult))
+	const FUniqueNetIdRepl LocalPlayerId = GetLocalPlayerId();
+	const bool bJoinStarted = LocalPlayerId.IsValid() ?
+		OnlineInterface->JoinSession(*LocalPlayerId, NAME_GameSession, PendingJoinResult) :
+		OnlineInterface->JoinSession(0, NAME_GameSession, PendingJoinResult);
+	if (!bJoinStarted)
 	{
 		OnlineInterface->ClearOnJoinSessionCompleteDelegate_Handle(JoinSessionCompleteDelegateHandle);
+		return false;
+	}
+	return true;
+}
 
-		MultiplayerOnJoinSessionComplete.Broadcast(EOnJoinSessionCompleteResult::UnknownError);
+bool UMultiplayerSessionsSubsystem::DestorySession()
+{
+	if (!OnlineInterface.IsValid())
+	{
+		MultiplayerOnDestroySessionComplete.Broadcast(false);
+		return false;
 	}
+	if (IsSessionOpInProgress())
+	{
+		if (SessionOpChain == EMultiplayerSessionOp::Destroy)
+		{
+			return true;
+		}
+		UE_LOG(LogTemp, Warning, TEXT("DestroySession rejected: another session operation is in progress"));
+		return false;
+	}
+	SessionOpChain = EMultiplayerSessionOp::Destroy;
+	PendingSessionOps.Reset();
+	PendingSessionOps.Add(EMultiplayerSessionOp::Destroy);
+	RunNextSessionOp();
+	return true;
 }
-void UMultiplayerSessionsSubsystem::DestorySession()
+
+bool UMultiplayerSessionsSubsystem::BeginDestroySession()
 {
-	
+	DestorySessionCompleteDelegateHandle = OnlineInterface->AddOnDestroySessionCompleteDelegate_Handle(DestroySessionCompleteDelegate);
+	if (!OnlineInterface->DestroySession(NAME_GameSession))
+	{
+		OnlineInterface->ClearOnDestroySessionCompleteDelegate_Handle(DestorySessionCompleteDelegateHandle);
+		return false;
+	}
+	return true;
 }
-void UMultiplayerSessionsSubsystem::StartSession()
+
+bool UMultiplayerSessionsSubsystem::StartSession()
 {
-	
+	if (!OnlineInterface.IsValid())
+	{
+		MultiplayerOnStartSessionComplete.Broadcast(false);
+		return false;
+	}
+	if (IsSessionOpInProgress())
+	{
+		if (SessionOpChain == EMultiplayerSessionOp::Start)
+		{
+			return true;
+		}
+		UE_LOG(LogTemp, Warning, TEXT("StartSession rejected: another session operation is in progress"));
+		return false;
+	}
+	SessionOpChain = EMultiplayerSessionOp::Start;
+	PendingSessionOps.Reset();
+	PendingSessionOps.Add(EMultiplayerSessionOp::Start);
+	RunNextSessionOp();
+	return true;
+}
+
+bool UMultiplayerSessionsSubsystem::BeginStartSession()
+{
+	StartSessionCompleteDelegateHandle = OnlineInterface->AddOnStartSessionCompleteDelegate_Handle(StartSessionCompleteDelegate);
+	if (!OnlineInterface->StartSession(NAME_GameSession))
+	{
+		OnlineInterface->ClearOnStartSessionCompleteDelegate_Handle(StartSessionCompleteDelegateHandle);
+		return false;
+	}
+	return true;
+}
+
+void UMultiplayerSessionsSubsystem::RunNextSessionOp()
+{
+	if (PendingSessionOps.Num() == 0)
+	{
+		FinishSessionOpChain(true);
+		return;
+	}
+	const EMultiplayerSessionOp Op = PendingSessionOps[0];
+	PendingSessionOps.RemoveAt(0, 1, false);
+	CurrentSessionOp = Op;
+	//操作链里的每一步（比如加入前先销毁旧会话）单独打书签，看得出时间花在哪一步
+	MultiplayerSessionsTrace::Bookmark(TEXT("SessionOp"), JoinTraceId, UEnum::GetValueAsString(Op));
+
+	bool bStarted = false;
+	switch (Op)
+	{
+	case EMultiplayerSessionOp::Destroy:
+		bStarted = BeginDestroySession();
+		break;
+	case EMultiplayerSessionOp::Create:
+		bStarted = BeginCreateSession();
+		break;
+	case EMultiplayerSessionOp::Start:
+		bStarted = BeginStartSession();
+		break;
+	case EMultiplayerSessionOp::Join:
+		bStarted = BeginJoinSession();
+		break;
+	default:
+		break;
+	}
+	//有的在线子系统（比如NULL）失败时会同步触发完成回调，那时链已经结束，不能再广播一次
+	if (!bStarted && CurrentSessionOp == Op)
+	{
+		FinishSessionOpChain(false);
+	}
+}
+
+void UMultiplayerSessionsSubsystem::AbortSessionOpChain()
+{
+	if (!IsSessionOpInProgress())
+	{
+		return;
+	}
+	//先摘掉后端的回调，之后迟到的完成通知不会再进来
+	if (OnlineInterface.IsValid())
+	{
+		switch (CurrentSessionOp)
+		{
+		case EMultiplayerSessionOp::Destroy:
+			OnlineInterface->ClearOnDestroySessionCompleteDelegate_Handle(DestorySessionCompleteDelegateHandle);
+			break;
+		case EMultiplayerSessionOp::Create:
+			OnlineInterface->ClearOnCreateSessionCompleteDelegate_Handle(CreateSessionCompleteDelegateHandle);
+			break;
+		case EMultiplayerSessionOp::Start:
+			OnlineInterface->ClearOnStartSessionCompleteDelegate_Handle(StartSessionCompleteDelegateHandle);
+			break;
+		case EMultiplayerSessionOp::Join:
+			OnlineInterface->ClearOnJoinSessionCompleteDelegate_Handle(JoinSessionCompleteDelegateHandle);
+			break;
+		default:
+			break;
+		}
+	}
+	LastJoinResult = EOnJoinSessionCompleteResult::UnknownError;
+	FinishSessionOpChain(false);
+}
+
+void UMultiplayerSessionsSubsystem::FinishSessionOpChain(bool bWasSuccessful)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::FinishSessionOpChain);
+	//先清掉状态再广播，回调里可以立即发起下一次操作
+	const EMultiplayerSessionOp FinishedChain = SessionOpChain;
+	const EOnJoinSessionCompleteResult::Type JoinResult = bWasSuccessful ? EOnJoinSessionCompleteResult::Success : LastJoinResult;
+	CurrentSessionOp = EMultiplayerSessionOp::None;
+	SessionOpChain = EMultiplayerSessionOp::None;
+	PendingSessionOps.Reset();
+	LastJoinResult = EOnJoinSessionCompleteResult::UnknownError;
+
+	switch (FinishedChain)
+	{
+	case EMultiplayerSessionOp::Create:
+		EndTiming(EMultiplayerSessionsTiming::CreateSession, bWasSuccessful);
+		MultiplayerOnCreateSessionComplete.Broadcast(bWasSuccessful);
+		break;
+	case EMultiplayerSessionOp::Join:
+		EndTiming(EMultiplayerSessionsTiming::JoinSession, bWasSuccessful);
+		MultiplayerOnJoinSessionComplete.Broadcast(JoinResult);
+		break;
+	case EMultiplayerSessionOp::Destroy:
+		MultiplayerOnDestroySessionComplete.Broadcast(bWasSuccessful);
+		break;
+	case EMultiplayerSessionOp::Start:
+		MultiplayerOnStartSessionComplete.Broadcast(bWasSuccessful);
+		break;
+	default:
+		break;
+	}
 }
 
 void UMultiplayerSessionsSubsystem::OnCreateSessionComplete(FName SessionName, bool bWasSuccessful)
 {
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::OnCreateSessionComplete);
 	if(OnlineInterface)
 	{
 		OnlineInterface->ClearOnCreateSessionCompleteDelegate_Handle(CreateSessionCompleteDelegateHandle);
 	}
-	MultiplayerOnCreateSessionComplete.Broadcast(bWasSuccessful);
+	if (CurrentSessionOp != EMultiplayerSessionOp::Create)
+	{
+		return;
+	}
+	if (!bWasSuccessful)
+	{
+		FinishSessionOpChain(false);
+		return;
+	}
+	RunNextSessionOp();
 }
 void UMultiplayerSessionsSubsystem::OnFindSessionComplete(bool bWasSuccessful)
 {
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::OnFindSessionComplete);
 	if (OnlineInterface)
 	{
 		OnlineInterface->ClearOnFindSessionsCompleteDelegate_Handle(FindSessionCompleteDelegateHandle);
 	}
+	bSearchInProgress = false;
+	const bool bWasBackgroundRefresh = bSearchIsBackgroundRefresh;
+	EndTiming(EMultiplayerSessionsTiming::FindSession, bWasSuccessful);
+
+	if (bRestartSearchWithPendingFilter)
+	{
+		//这次的结果是按旧条件搜的，直接用新的条件重新搜索
+		bRestartSearchWithPendingFilter = false;
+		StartSessionSearch(PendingMaxSearchResults, PendingSearchFilter, false);
+		return;
+	}
+
+	if (bWasSuccessful)
+	{
+		//后端不支持的过滤条件在这里一次性剔除，原地删除，不复制结果
+		TArray<FOnlineSessionSearchResult>& SearchResults = LastSessionSearch->SearchResults;
+		const FMultiplayerSessionSearchFilter& Filter = RefreshSearchFilter;
+		SearchResults.RemoveAll([&Filter](const FOnlineSessionSearchResult& Result)
+		{
+			return !Filter.Matches(Result);
+		});
+
+		//搜索结果归缓存所有，直接移动过来，不再复制一份
+		TArray<FOnlineSessionSearchResult> OldResults = MoveTemp(CachedSearchResults);
+		CachedSearchResults = MoveTemp(SearchResults);
+		CachedSearchTime = FPlatformTime::Seconds();
+		CachedMaxSearchResults = RefreshMaxSearchResults;
+		const bool bFilterChanged = CachedSearchFilter != RefreshSearchFilter;
+		CachedSearchFilter = RefreshSearchFilter;
+		if (OldResults.Num() > 0 && !bFilterChanged)
+		{
+			BroadcastSearchDelta(OldResults);
+		}
+	}
+	//失败了也要接着刷新，否则一次失败之后菜单开着的这段时间都不会再刷新
+	ScheduleSearchCacheRefresh(true);
+	//后台刷新失败时保留旧的缓存，也不打扰菜单
+	if (bWasBackgroundRefresh)
+	{
+		return;
+	}
 	//找到了，但是结果数组为0，
-	if (LastSessionSearch->SearchResults.Num() <= 0)
+	if (!bWasSuccessful || CachedSearchResults.Num() <= 0)
 	{
 		MultiplayerOnFindSessionComplete.Broadcast(TArray<FOnlineSessionSearchResult>(), false);
 		return;
 	}
 
-	MultiplayerOnFindSessionComplete.Broadcast(LastSessionSearch->SearchResults, bWasSuccessful);
+	MultiplayerOnFindSessionComplete.Broadcast(CachedSearchResults, bWasSuccessful);
 }
 void UMultiplayerSessionsSubsystem::OnJoinSessionComplete(FName SessionName, EOnJoinSessionCompleteResult::Type Result)
 {
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::OnJoinSessionComplete);
 	if (OnlineInterface)
 	{
 		OnlineInterface->ClearOnJoinSessionCompleteDelegate_Handle(JoinSessionCompleteDelegateHandle);
 	}
-
-	MultiplayerOnJoinSessionComplete.Broadcast(Result);
+	if (CurrentSessionOp != EMultiplayerSessionOp::Join)
+	{
+		return;
+	}
+	LastJoinResult = Result;
+	if (Result != EOnJoinSessionCompleteResult::Success)
+	{
+		FinishSessionOpChain(false);
+		return;
+	}
+	RunNextSessionOp();
 }
 void UMultiplayerSessionsSubsystem::OnDestorySessionComplete(FName SessionName, bool bWasSuccessful)
 {
-	
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::OnDestorySessionComplete);
+	if (OnlineInterface)
+	{
+		OnlineInterface->ClearOnDestroySessionCompleteDelegate_Handle(DestorySessionCompleteDelegateHandle);
+	}
+	if (CurrentSessionOp != EMultiplayerSessionOp::Destroy)
+	{
+		return;
+	}
+	//销毁失败但会话已经不存在时（比如被后端清掉了），后面的创建/加入仍然可以继续
+	if (!bWasSuccessful && OnlineInterface.IsValid() && OnlineInterface->GetNamedSession(NAME_GameSession) != nullptr)
+	{
+		FinishSessionOpChain(false);
+		return;
+	}
+	RunNextSessionOp();
 }
 void UMultiplayerSessionsSubsystem::OnStartSessionComplete(FName SessionName, bool bWasSuccessful)
 {
-	
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(UMultiplayerSessionsSubsystem::OnStartSessionComplete);
+	if (OnlineInterface)
+	{
+		OnlineInterface->ClearOnStartSessionCompleteDelegate_Handle(StartSessionCompleteDelegateHandle);
+	}
+	if (CurrentSessionOp != EMultiplayerSessionOp::Start)
+	{
+		return;
+	}
+	if (!bWasSuccessful)
+	{
+		FinishSessionOpChain(false);
+		return;
+	}
+	RunNextSessionOp();
 }
 
-
@@ -0,0 +1,520 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MultiplayerSimulatedSessionInterface.h"
+
+#include "Containers/Ticker.h"
+#include "Misc/CommandLine.h"
+#include "Misc/NetworkVersion.h"
+
+namespace MultiplayerSimulatedSessions
+{
+	const FName IdType(TEXT("Simulated"));
+	const TCHAR* const MatchTypes[] = {TEXT("FreeForAll"), TEXT("Teams"), TEXT("CaptureTheFlag")};
+}
+
+bool FMultiplayerSimulatedSessionParams::FromCommandLine(FMultiplayerSimulatedSessionParams& OutParams)
+{
+	const TCHAR* CommandLine = FCommandLine::Get();
+	if (!FParse::Value(CommandLine, TEXT("SimulatedSessions="), OutParams.NumSessions))
+	{
+		return false;
+	}
+	//给的是平均延迟，实际在它的0.5到1.5倍之间随机
+	float LatencyMs = 0.f;
+	if (FParse::Value(CommandLine, TEXT("SimulatedLatencyMs="), LatencyMs))
+	{
+		OutParams.MinLatencyMs = LatencyMs * 0.5f;
+		OutParams.MaxLatencyMs = LatencyMs * 1.5f;
+	}
+	FParse::Value(CommandLine, TEXT("SimulatedFailureRate="), OutParams.FailureRate);
+	FParse::Value(CommandLine, TEXT("SimulatedConnectAddress="), OutParams.ConnectAddress);
+	FParse::Value(CommandLine, TEXT("SimulatedSeed="), OutParams.Seed);
+	return true;
+}
+
+FMultiplayerSimulatedSessionInfo::FMultiplayerSimulatedSessionInfo(const FString& InSessionId)
+	: SessionId(InSessionId, MultiplayerSimulatedSessions::IdType)
+{
+}
+
+FMultiplayerSimulatedSessionInterface::FMultiplayerSimulatedSessionInterface(const FMultiplayerSimulatedSessionParams& InParams)
+	: Params(InParams)
+	, Random(InParams.Seed)
+{
+	Params.NumSessions = FMath::Max(0, Params.NumSessions);
+	Params.FailureRate = FMath::Clamp(Params.FailureRate, 0.f, 1.f);
+	GenerateSessions();
+}
+
+FMultiplayerSimulatedSessionInterface::~FMultiplayerSimulatedSessionInterface()
+{
+}
+
+void FMultiplayerSimulatedSessionInterface::GenerateSessions()
+{
+	const int32 LocalBuildVersion = static_cast<int32>(FNetworkVersion::GetLocalNetworkVersion());
+	AdvertisedSessions.Reserve(Params.NumSessions);
+	SessionIndexById.Reserve(Params.NumSessions);
+	for (int32 Index = 0; Index < Params.NumSessions; ++Index)
+	{
+		const FString SessionId = FString::Printf(TEXT("SimSession%d"), Index);
+		FOnlineSessionSearchResult& Result = AdvertisedSessions.AddDefaulted_GetRef();
+		FOnlineSession& Session = Result.Session;
+		Session.OwningUserId = MakeShared<FUniqueNetIdString>(FString::Printf(TEXT("SimHost%d"), Index), MultiplayerSimulatedSessions::IdType);
+		Session.OwningUserName = FString::Printf(TEXT("SimHost%d"), Index);
+		Session.SessionInfo = MakeShared<FMultiplayerSimulatedSessionInfo>(SessionId);
+
+		//人数、空位和延迟的分布大致照着线上的大厅列表
+		FOnlineSessionSettings& Settings = Session.SessionSettings;
+		Settings.NumPublicConnections = Random.FRand() < 0.5f ? 4 : 8;
+		Settings.bIsDedicated = Random.FRand() < 0.2f;
+		Settings.bUsesPresence = !Settings.bIsDedicated;
+		Settings.bShouldAdvertise = true;
+		Settings.bAllowJoinInProgress = true;
+		Settings.Set(FName("MatchType"), FString(MultiplayerSimulatedSessions::MatchTypes[Index % UE_ARRAY_COUNT(MultiplayerSimulatedSessions::MatchTypes)]), EOnlineDataAdvertisementType::ViaOnlineServiceAndPing);
+		//少量会话是旧版本建的，用来检验版本过滤
+		Settings.Set(FName("BuildVersion"), Random.FRand() < 0.05f ? LocalBuildVersion + 1 : LocalBuildVersion, EOnlineDataAdvertisementType::ViaOnlineServiceAndPing);
+		Session.NumOpenPublicConnections = Random.RandRange(0, Settings.NumPublicConnections);
+		Result.PingInMs = Random.RandRange(10, 300);
+
+		SessionIndexById.Add(SessionId, Index);
+	}
+}
+
+void FMultiplayerSimulatedSessionInterface::Complete(TFunction<void()>&& Callback)
+{
+	const float LatencyMs = Random.FRandRange(Params.MinLatencyMs, FMath::Max(Params.MinLatencyMs, Params.MaxLatencyMs));
+	if (LatencyMs <= 0.f)
+	{
+		Callback();
+		return;
+	}
+	//后端可能在完成前被换掉（比如压测结束），那时直接丢弃
+	TWeakPtr<FMultiplayerSimulatedSessionInterface, ESPMode::ThreadSafe> WeakThis = AsShared();
+	TFunction<void()> DelayedCallback = MoveTemp(Callback);
+	FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([WeakThis, DelayedCallback](float DeltaTime)
+	{
+		if (WeakThis.IsValid())
+		{
+			DelayedCallback();
+		}
+		return false;
+	}), LatencyMs / 1000.f);
+}
+
+bool FMultiplayerSimulatedSessionInterface::RollFailure()
+{
+	return Params.FailureRate > 0.f && Random.FRand() < Params.FailureRate;
+}
+
+bool FMultiplayerSimulatedSessionInterface::MatchesQuery(const FOnlineSessionSearchResult& Result, const FOnlineSearchSettings& QuerySettings) const
+{
+	const FOnlineSessionSettings& Settings = Result.Session.SessionSettings;
+	FString QueryMatchType;
+	if (QuerySettings.Get(FName("MatchType"), QueryMatchType))
+	{
+		FString MatchType;
+		if (!Settings.Get(FName("MatchType"), MatchType) || MatchType != QueryMatchType)
+		{
+			return false;
+		}
+	}
+	int32 QueryBuildVersion = 0;
+	if (QuerySettings.Get(FName("BuildVersion"), QueryBuildVersion))
+	{
+		int32 BuildVersion = 0;
+		if (!Settings.Get(FName("BuildVersion"), BuildVersion) || BuildVersion != QueryBuildVersion)
+		{
+			return false;
+		}
+	}
+	int32 MinSlots = 0;
+	if (QuerySettings.Get(SEARCH_MINSLOTSAVAILABLE, MinSlots) && Result.Session.NumOpenPublicConnections < MinSlots)
+	{
+		return false;
+	}
+	bool bDedicatedOnly = false;
+	if (QuerySettings.Get(SEARCH_DEDICATED_ONLY, bDedicatedOnly) && bDedicatedOnly != Settings.bIsDedicated)
+	{
+		return false;
+	}
+	bool bPresence = false;
+	if (QuerySettings.Get(SEARCH_PRESENCE, bPresence) && bPresence && !Settings.bUsesPresence)
+	{
+		return false;
+	}
+	return true;
+}
+
+TSharedPtr<const FUniqueNetId> FMultiplayerSimulatedSessionInterface::CreateSessionIdFromString(const FString& SessionIdStr)
+{
+	return MakeShared<FUniqueNetIdString>(SessionIdStr, MultiplayerSimulatedSessions::IdType);
+}
+
+FNamedOnlineSession* FMultiplayerSimulatedSessionInterface::AddNamedSession(FName SessionName, const FOnlineSessionSettings& SessionSettings)
+{
+	return new (Sessions) FNamedOnlineSession(SessionName, SessionSettings);
+}
+
+FNamedOnlineSession* FMultiplayerSimulatedSessionInterface::AddNamedSession(FName SessionName, const FOnlineSession& Session)
+{
+	return new (Sessions) FNamedOnlineSession(SessionName, Session);
+}
+
+FNamedOnlineSession* FMultiplayerSimulatedSessionInterface::GetNamedSession(FName SessionName)
+{
+	for (FNamedOnlineSession& Session : Sessions)
+	{
+		if (Session.SessionName == SessionName)
+		{
+			return &Session;
+		}
+	}
+	return nullptr;
+}
+
+void FMultiplayerSimulatedSessionInterface::RemoveNamedSession(FName SessionName)
+{
+	Sessions.RemoveAll([SessionName](const FNamedOnlineSession& Session)
+	{
+		return Session.SessionName == SessionName;
+	});
+}
+
+bool FMultiplayerSimulatedSessionInterface::HasPresenceSession()
+{
+	return Sessions.ContainsByPredicate([](const FNamedOnlineSession& Session)
+	{
+		return Session.SessionSettings.bUsesPresence;
+	});
+}
+
+EOnlineSessionState::Type FMultiplayerSimulatedSessionInterface::GetSessionState(FName SessionName) const
+{
+	for (const FNamedOnlineSession& Session : Sessions)
+	{
+		if (Session.SessionName == SessionName)
+		{
+			return Session.SessionState;
+		}
+	}
+	return EOnlineSessionState::NoSession;
+}
+
+bool FMultiplayerSimulatedSessionInterface::CreateSession(int32 HostingPlayerNum, FName SessionName, const FOnlineSessionSettings& NewSessionSettings)
+{
+	if (GetNamedSession(SessionName) != nullptr)
+	{
+		return false;
+	}
+	Complete([this, SessionName, NewSessionSettings]()
+	{
+		const bool bWasSuccessful = !RollFailure() && GetNamedSession(SessionName) == nullptr;
+		if (bWasSuccessful)
+		{
+			FNamedOnlineSession* Session = AddNamedSession(SessionName, NewSessionSettings);
+			Session->SessionInfo = MakeShared<FMultiplayerSimulatedSessionInfo>(FString::Printf(TEXT("SimLocal%d"), NextLocalSessionId++));
+			Session->OwningUserId = MakeShared<FUniqueNetIdString>(TEXT("SimLocalHost"), MultiplayerSimulatedSessions::IdType);
+			Session->bHosting = true;
+			Session->SessionState = EOnlineSessionState::Pending;
+		}
+		TriggerOnCreateSessionCompleteDelegates(SessionName, bWasSuccessful);
+	});
+	return true;
+}
+
+bool FMultiplayerSimulatedSessionInterface::CreateSession(const FUniqueNetId& HostingPlayerId, FName SessionName, const FOnlineSessionSettings& NewSessionSettings)
+{
+	return CreateSession(0, SessionName, NewSessionSettings);
+}
+
+bool FMultiplayerSimulatedSessionInterface::StartSession(FName SessionName)
+{
+	if (GetNamedSession(SessionName) == nullptr)
+	{
+		return false;
+	}
+	Complete([this, SessionName]()
+	{
+		FNamedOnlineSession* Session = GetNamedSession(SessionName);
+		const bool bWasSuccessful = Session != nullptr && !RollFailure();
+		if (bWasSuccessful)
+		{
+			Session->SessionState = EOnlineSessionState::InProgress;
+		}
+		TriggerOnStartSessionCompleteDelegates(SessionName, bWasSuccessful);
+	});
+	return true;
+}
+
+bool FMultiplayerSimulatedSessionInterface::UpdateSession(FName SessionName, FOnlineSessionSettings& UpdatedSessionSettings, bool bShouldRefreshOnlineData)
+{
+	FNamedOnlineSession* Session = GetNamedSession(SessionName);
+	if (Session == nullptr)
+	{
+		return false;
+	}
+	Session->SessionSettings = UpdatedSessionSettings;
+	Complete([this, SessionName]()
+	{
+		TriggerOnUpdateSessionCompleteDelegates(SessionName, GetNamedSession(SessionName) != nullptr);
+	});
+	return true;
+}
+
+bool FMultiplayerSimulatedSessionInterface::EndSession(FName SessionName)
+{
+	FNamedOnlineSession* Session = GetNamedSession(SessionName);
+	if (Session == nullptr)
+	{
+		return false;
+	}
+	Session->SessionState = EOnlineSessionState::Ended;
+	Complete([this, SessionName]()
+	{
+		TriggerOnEndSessionCompleteDelegates(SessionName, true);
+	});
+	return true;
+}
+
+bool FMultiplayerSimulatedSessionInterface::DestroySession(FName SessionName, const FOnDestroySessionCompleteDelegate& CompletionDelegate)
+{
+	if (GetNamedSession(SessionName) == nullptr)
+	{
+		return false;
+	}
+	Complete([this, SessionName, CompletionDelegate]()
+	{
+		const bool bWasSuccessful = GetNamedSession(SessionName) != nullptr;
+		RemoveNamedSession(SessionName);
+		CompletionDelegate.ExecuteIfBound(SessionName, bWasSuccessful);
+		TriggerOnDestroySessionCompleteDelegates(SessionName, bWasSuccessful);
+	});
+	return true;
+}
+
+bool FMultiplayerSimulatedSessionInterface::IsPlayerInSession(FName SessionName, const FUniqueNetId& UniqueId)
+{
+	return false;
+}
+
+bool FMultiplayerSimulatedSessionInterface::StartMatchmaking(const TArray<TSharedRef<const FUniqueNetId>>& LocalPlayers, FName SessionName, const FOnlineSessionSettings& NewSessionSettings, TSharedRef<FOnlineSessionSearch>& SearchSettings)
+{
+	return false;
+}
+
+bool FMultiplayerSimulatedSessionInterface::CancelMatchmaking(int32 SearchingPlayerNum, FName SessionName)
+{
+	return false;
+}
+
+bool FMultiplayerSimulatedSessionInterface::CancelMatchmaking(const FUniqueNetId& SearchingPlayerId, FName SessionName)
+{
+	return false;
+}
+
+bool FMultiplayerSimulatedSessionInterface::FindSessions(int32 SearchingPlayerNum, const TSharedRef<FOnlineSessionSearch>& SearchSettings)
+{
+	SearchSettings->SearchState = EOnlineAsyncTaskState::InProgress;
+	TSharedRef<FOnlineSessionSearch> Search = SearchSettings;
+	Complete([this, Search]()
+	{
+		if (RollFailure())
+		{
+			Search->SearchState = EOnlineAsyncTaskState::Failed;
+			TriggerOnFindSessionsCompleteDelegates(false);
+			return;
+		}
+		//和Steam大厅一样在后端按查询条件过滤，最多返回MaxSearchResults个
+		Search->SearchResults.Reset();
+		for (const FOnlineSessionSearchResult& Session : AdvertisedSessions)
+		{
+			if (Search->SearchResults.Num() >= Search->MaxSearchResults)
+			{
+				break;
+			}
+			if (MatchesQuery(Session, Search->QuerySettings))
+			{
+				Search->SearchResults.Add(Session);
+			}
+		}
+		Search->SearchState = EOnlineAsyncTaskState::Done;
+		TriggerOnFindSessionsCompleteDelegates(true);
+	});
+	return true;
+}
+
+bool FMultiplayerSimulatedSessionInterface::FindSessions(const FUniqueNetId& SearchingPlayerId, const TSharedRef<FOnlineSessionSearch>& SearchSettings)
+{
+	return FindSessions(0, SearchSettings);
+}
+
+bool FMultiplayerSimulatedSessionInterface::FindSessionById(const FUniqueNetId& SearchingUserId, const FUniqueNetId& SessionId, const FUniqueNetId& FriendId, const FOnSingleSessionResultCompleteDelegate& CompletionDelegate)
+{
+	const FString SessionIdStr = SessionId.ToString();
+	Complete([this, SessionIdStr, CompletionDelegate]()
+	{
+		const int32* Index = SessionIndexById.Find(SessionIdStr);
+		if (Index == nullptr || RollFailure())
+		{
+			CompletionDelegate.ExecuteIfBound(0, false, FOnlineSessionSearchResult());
+			return;
+		}
+		CompletionDelegate.ExecuteIfBound(0, true, AdvertisedSessions[*Index]);
+	});
+	return true;
+}
+
+bool FMultiplayerSimulatedSessionInterface::CancelFindSessions()
+{
+	return false;
+}
+
+bool FMultiplayerSimulatedSessionInterface::PingSearchResults(const FOnlineSessionSearchResult& SearchResult)
+{
+	return false;
+}
+
+bool FMultiplayerSimulatedSessionInterface::JoinSession(int32 LocalUserNum, FName SessionName, const FOnlineSessionSearchResult& DesiredSession)
+{
+	const FString SessionId = DesiredSession.GetSessionIdStr();
+	Complete([this, SessionName, SessionId]()
+	{
+		const int32* Index = SessionIndexById.Find(SessionId);
+		EOnJoinSessionCompleteResult::Type Result = EOnJoinSessionCompleteResult::Success;
+		if (GetNamedSession(SessionName) != nullptr)
+		{
+			Result = EOnJoinSessionCompleteResult::AlreadyInSession;
+		}
+		else if (Index == nullptr)
+		{
+			Result = EOnJoinSessionCompleteResult::SessionDoesNotExist;
+		}
+		else if (AdvertisedSessions[*Index].Session.NumOpenPublicConnections <= 0)
+		{
+			Result = EOnJoinSessionCompleteResult::SessionIsFull;
+		}
+		else if (RollFailure())
+		{
+			Result = EOnJoinSessionCompleteResult::CouldNotRetrieveAddress;
+		}
+
+		if (Result == EOnJoinSessionCompleteResult::Success)
+		{
+			//加入后占掉一个空位，后面的搜索能看到变化
+			FOnlineSession& Advertised = AdvertisedSessions[*Index].Session;
+			--Advertised.NumOpenPublicConnections;
+			FNamedOnlineSession* Session = AddNamedSession(SessionName, Advertised);
+			Session->SessionState = EOnlineSessionState::Pending;
+		}
+		TriggerOnJoinSessionCompleteDelegates(SessionName, Result);
+	});
+	return true;
+}
+
+bool FMultiplayerSimulatedSessionInterface::JoinSession(const FUniqueNetId& LocalUserId, FName SessionName, const FOnlineSessionSearchResult& DesiredSession)
+{
+	return JoinSession(0, SessionName, DesiredSession);
+}
+
+bool FMultiplayerSimulatedSessionInterface::FindFriendSession(int32 LocalUserNum, const FUniqueNetId& Friend)
+{
+	return false;
+}
+
+bool FMultiplayerSimulatedSessionInterface::FindFriendSession(const FUniqueNetId& LocalUserId, const FUniqueNetId& Friend)
+{
+	return false;
+}
+
+bool FMultiplayerSimulatedSessionInterface::FindFriendSession(const FUniqueNetId& LocalUserId, const TArray<TSharedRef<const FUniqueNetId>>& FriendList)
+{
+	return false;
+}
+
+bool FMultiplayerSimulatedSessionInterface::SendSessionInviteToFriend(int32 LocalUserNum, FName SessionName, const FUniqueNetId& Friend)
+{
+	return false;
+}
+
+bool FMultiplayerSimulatedSessionInterface::SendSessionInviteToFriend(const FUniqueNetId& LocalUserId, FName SessionName, const FUniqueNetId& Friend)
+{
+	return false;
+}
+
+bool FMultiplayerSimulatedSessionInterface::SendSessionInviteToFriends(int32 LocalUserNum, FName SessionName, const TArray<TSharedRef<const FUniqueNetId>>& Friends)
+{
+	return false;
+}
+
+bool FMultiplayerSimulatedSessionInterface::SendSessionInviteToFriends(const FUniqueNetId& LocalUserId, FName SessionName, const TArray<TSharedRef<const FUniqueNetId>>& Friends)
+{
+	return false;
+}
+
+bool FMultiplayerSimulatedSessionInterface::GetResolvedConnectString(FName SessionName, FString& ConnectInfo, FName PortType)
+{
+	if (GetNamedSession(SessionName) == nullptr)
+	{
+		return false;
+	}
+	ConnectInfo = Params.ConnectAddress;
+	return true;
+}
+
+bool FMultiplayerSimulatedSessionInterface::GetResolvedConnectString(const FOnlineSessionSearchResult& SearchResult, FName PortType, FString& ConnectInfo)
+{
+	//模拟的会话没有真实主机可以ping，QoS阶段会改用PingInMs
+	return false;
+}
+
+FOnlineSessionSettings* FMultiplayerSimulatedSessionInterface::GetSessionSettings(FName SessionName)
+{
+	FNamedOnlineSession* Session = GetNamedSession(SessionName);
+	return Session ? &Session->SessionSettings : nullptr;
+}
+
+bool FMultiplayerSimulatedSessionInterface::RegisterPlayer(FName SessionName, const FUniqueNetId& PlayerId, bool bWasInvited)
+{
+	return GetNamedSession(SessionName) != nullptr;
+}
+
+bool FMultiplayerSimulatedSessionInterface::RegisterPlayers(FName SessionName, const TArray<TSharedRef<const FUniqueNetId>>& Players, bool bWasInvited)
+{
+	return GetNamedSession(SessionName) != nullptr;
+}
+
+bool FMultiplayerSimulatedSessionInterface::UnregisterPlayer(FName SessionName, const FUniqueNetId& PlayerId)
+{
+	return GetNamedSession(SessionName) != nullptr;
+}
+
+bool FMultiplayerSimulatedSessionInterface::UnregisterPlayers(FName SessionName, const TArray<TSharedRef<const FUniqueNetId>>& Players)
+{
+	return GetNamedSession(SessionName) != nullptr;
+}
+
+void FMultiplayerSimulatedSessionInterface::RegisterLocalPlayer(const FUniqueNetId& PlayerId, FName SessionName, const FOnRegisterLocalPlayerCompleteDelegate& Delegate)
+{
+	Delegate.ExecuteIfBound(PlayerId, EOnJoinSessionCompleteResult::Success);
+}
+
+void FMultiplayerSimulatedSessionInterface::UnregisterLocalPlayer(const FUniqueNetId& PlayerId, FName SessionName, const FOnUnregisterLocalPlayerCompleteDelegate& Delegate)
+{
+	Delegate.ExecuteIfBound(PlayerId, true);
+}
+
+int32 FMultiplayerSimulatedSessionInterface::GetNumSessions()
+{
+	return Sessions.Num();
+}
+
+void FMultiplayerSimulatedSessionInterface::DumpSessionState()
+{
+	UE_LOG(LogTemp, Display, TEXT("Simulated sessions: %d advertised, %d local"), AdvertisedSessions.Num(), Sessions.Num());
+	for (const FNamedOnlineSession& Session : Sessions)
+	{
+		UE_LOG(LogTemp, Display, TEXT("  %s id=%s state=%s"), *Session.SessionName.ToString(), *Session.GetSessionIdStr(), EOnlineSessionState::ToString(Session.SessionState));
+	}
+}
@@ -27,6 +27,7 @@ protected:
 	void OnCreateSession(bool bWasSuccessful);
 	void OnFindSession(const TArray<FOnlineSessionSearchResult>& SearchResults,bool bWasSuccessful);
 	void OnJoinSession(EOnJoinSessionCompleteResult::Type Result);
+	void OnSessionSearchDelta(const TArray<FOnlineSessionSearchResult>& AddedResults,const TArray<FString>& RemovedSessionIds,const TArray<FOnlineSessionSearchResult>& ChangedResults);
 	UFUNCTION()
 	void OnDestroySession(bool bWasSuccessful);
 	UFUNCTION()
@@ -46,6 +47,26 @@ private:
 	class UMultiplayerSessionsSubsystem* MultiplayerSessionsSubsystem;
 
 	void MenuTearDown();
+	//把候选会话交给子系统测速排序，排序完成后在OnSessionsRanked里加入延迟最低的，有候选时返回true
+	bool RankCandidateSessions(const TArray<FOnlineSessionSearchResult>& SearchResults);
+	void OnSessionsRanked(int32 RequestId, const TArray<struct FMultiplayerRankedSession>& RankedSessions);
+	void OnJoinPipelineComplete(bool bWasSuccessful, int32 Attempts, double SecondsToJoin);
+	//上一局还能回去时先重连，失败了再正常找房
+	void OnRejoinComplete(bool bWasSuccessful);
+	void FindMatchingSessions();
+	//已经在排序或发起了加入，后台刷新的结果就不再处理
+	bool bJoinRequested{false};
+	//菜单自己发起的那一轮排序，其它地方发起的排序结果不处理
+	int32 RankRequestId{0};
+	//是点Join发起的重连，失败后要接着找房；断线后子系统自动发起的重连不用
+	bool bRejoinRequested{false};
+
+	//点击Host/Join时就开始异步加载大厅地图和角色蓝图，和联网的等待时间重叠
+	void PrefetchLobby();
+	FString PathToLobby{TEXT("/Game/ThirdPersonCPP/Maps/Lobby")};
+	//除大厅地图外要一起预加载的包，比如大厅里生成的角色蓝图
+	UPROPERTY(EditDefaultsOnly, Category = "Prefetch")
+	TArray<FString> LobbyPrefetchPackages{TEXT("/Game/ThirdPersonCPP/Blueprints/ThirdPersonCharacter")};
 
 	int32 NumOfPublicConnections{4};
 	FString MatchType{FString(TEXT("FreeForAll"))};
@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "UObject/Package.h"
+
+#include "MultiplayerPreloadSubsystem.generated.h"
+
+/**
+ *在等待网络或者等大厅凑人的时候提前异步加载地图包。
+ *加载出来的世界和资源挂在GameInstance上，跳转过程中旧世界被GC时也不会被释放，跳转时直接用内存里的包。
+ *命令行带 -NoMapPreload 时不预加载，用来和冷加载对比跳转耗时。
+ */
+UCLASS(config=Game)
+class MULTUPLAYERSESSIONS_API UMultiplayerPreloadSubsystem : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//开始异步加载，重复调用同一个包不会重复加载；上次加载失败的会重新加载
+	void PreloadPackage(const FString& PackageName);
+	bool IsPackagePreloaded(const FString& PackageName) const;
+	//跳转开始时调用，记下跳转前已经完成了多少加载，目标地图加载完时再记实际的加载耗时
+	void NotifyTravelStarted(const FString& PackageName);
+	void ReleaseAll();
+
+	//一个包最多加载几次，失败后自动重试
+	UPROPERTY(Config)
+	int32 MaxPreloadAttempts = 3;
+
+private:
+	struct FPreloadEntry
+	{
+		double StartTime{0.0};
+		double FinishTime{0.0};
+		int32 Attempts{0};
+		bool bLoaded{false};
+		bool bFailed{false};
+	};
+
+	void StartLoad(const FName& PackageName, FPreloadEntry& Entry);
+
+	void OnPackageLoaded(const FName& PackageName, UPackage* LoadedPackage, EAsyncLoadingResult::Type Result);
+	void OnPostLoadMapWithWorld(UWorld* LoadedWorld);
+
+	TMap<FName, FPreloadEntry> PreloadEntries;
+	//引用包里的世界和资源本身，只引用UPackage挡不住里面的对象在跳转前被GC
+	UPROPERTY()
+	TArray<UObject*> PreloadedObjects;
+	FDelegateHandle PostLoadMapHandle;
+	//正在跳转去的地图，加载完成后释放预加载的引用
+	FName TravelDestination;
+	double TravelStartTime{0.0};
+	bool bTravelDestinationPreloaded{false};
+	bool bPreloadDisabled{false};
+};
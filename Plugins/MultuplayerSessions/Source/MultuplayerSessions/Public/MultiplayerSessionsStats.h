@@ -0,0 +1,113 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "Trace/Trace.h"
+
+/**
+ *会话各个阶段的耗时统计：stat MultuplayerSessions 看计数和最近一次耗时，CSV里有每次的耗时，
+ *控制台 MultiplayerSessions.DumpLatency 输出 p50/p95/p99
+ */
+DECLARE_STATS_GROUP(TEXT("MultuplayerSessions"), STATGROUP_MultuplayerSessions, STATCAT_Advanced);
+
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Create Session Count"), STAT_MPS_CreateSessionCount, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Find Session Count"), STAT_MPS_FindSessionCount, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Join Session Count"), STAT_MPS_JoinSessionCount, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Resolve Connect String Count"), STAT_MPS_ResolveConnectStringCount, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Client Travel Count"), STAT_MPS_ClientTravelCount, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Server Travel Count"), STAT_MPS_ServerTravelCount, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Failed Operation Count"), STAT_MPS_FailureCount, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Search Cache Hits"), STAT_MPS_SearchCacheHits, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Preloaded Packages"), STAT_MPS_PreloadCount, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("QoS Pings Sent"), STAT_MPS_QosPingsSent, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("QoS Pings Failed"), STAT_MPS_QosPingsFailed, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("QoS Cache Hits"), STAT_MPS_QosCacheHits, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Join Failovers"), STAT_MPS_JoinFailovers, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Last Join Attempts"), STAT_MPS_LastJoinAttempts, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Last Create Session (ms)"), STAT_MPS_CreateSessionMs, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Last Find Session (ms)"), STAT_MPS_FindSessionMs, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Last Join Session (ms)"), STAT_MPS_JoinSessionMs, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Last Resolve Connect String (ms)"), STAT_MPS_ResolveConnectStringMs, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Last Client Travel (ms)"), STAT_MPS_ClientTravelMs, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Last Server Travel (ms)"), STAT_MPS_ServerTravelMs, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Last Preload Ahead Of Travel (ms)"), STAT_MPS_PreloadAheadMs, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Last QoS Ranking (ms)"), STAT_MPS_QosRankingMs, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Best Ranked RTT (ms)"), STAT_MPS_QosBestRttMs, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Last Time To Join (ms)"), STAT_MPS_TimeToJoinMs, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Last Rejoin (ms)"), STAT_MPS_RejoinMs, STATGROUP_MultuplayerSessions, MULTUPLAYERSESSIONS_API);
+
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(MULTUPLAYERSESSIONS_API, MultuplayerSessions);
+
+/**
+ *Insights里的建房/加入/跳转时间线：-trace=cpu,bookmark,MultiplayerSessions 打开。
+ *每次加入有一个加入ID，客户端跳转时放在URL里带给服务器，两边的书签都带着它，按ID就能对上同一次加入
+ */
+UE_TRACE_CHANNEL_EXTERN(MultiplayerSessionsChannel, MULTUPLAYERSESSIONS_API);
+
+#define MULTIPLAYER_SESSIONS_TRACE_SCOPE(Name) TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL(Name, MultiplayerSessionsChannel)
+
+//需要计时的会话阶段
+enum class EMultiplayerSessionsTiming : uint8
+{
+	CreateSession,
+	FindSession,
+	JoinSession,
+	ResolveConnectString,
+	ClientTravel,
+	ServerTravel,
+	QosRanking,
+	TimeToJoin,
+	Rejoin,
+	Num
+};
+
+/**
+ *按指数分桶的延迟直方图，每个桶比上一个宽25%，记录样本时不分配内存，百分位的误差在一个桶宽以内
+ */
+class MULTUPLAYERSESSIONS_API FMultiplayerSessionsLatencyHistogram
+{
+public:
+	FMultiplayerSessionsLatencyHistogram();
+
+	void AddSample(double Milliseconds);
+	//Percentile取0-100，返回对应桶的上界（毫秒）
+	double GetPercentile(double Percentile) const;
+	uint32 GetNumSamples() const { return NumSamples; }
+	double GetMaxMs() const { return MaxMs; }
+	double GetMeanMs() const { return NumSamples > 0 ? TotalMs / NumSamples : 0.0; }
+	void Reset();
+
+private:
+	static constexpr int32 NumBuckets = 64;
+	static int32 GetBucketIndex(double Milliseconds);
+	static double GetBucketUpperBound(int32 BucketIndex);
+
+	uint32 Buckets[NumBuckets];
+	uint32 NumSamples;
+	double TotalMs;
+	double MaxMs;
+};
+
+namespace MultiplayerSessionsStats
+{
+	MULTUPLAYERSESSIONS_API const TCHAR* GetTimingName(EMultiplayerSessionsTiming Timing);
+	//记录一次耗时：更新直方图、stat计数和CSV
+	MULTUPLAYERSESSIONS_API void RecordTiming(EMultiplayerSessionsTiming Timing, double Milliseconds, bool bWasSuccessful);
+	MULTUPLAYERSESSIONS_API const FMultiplayerSessionsLatencyHistogram& GetHistogram(EMultiplayerSessionsTiming Timing);
+	MULTUPLAYERSESSIONS_API void DumpToLog();
+	MULTUPLAYERSESSIONS_API void ResetAll();
+}
+
+namespace MultiplayerSessionsTrace
+{
+	//跳转URL里带加入ID的选项名
+	MULTUPLAYERSESSIONS_API extern const TCHAR* JoinIdOption;
+	MULTUPLAYERSESSIONS_API FString NewJoinId();
+	//通道打开时打一个书签并写一行Log级别的日志；没打开时只写Verbose日志（log LogTemp Verbose 才看得到）。Detail可以为空
+	MULTUPLAYERSESSIONS_API void Bookmark(const TCHAR* Event, const FString& JoinId, const FString& Detail = FString());
+}
@@ -4,11 +4,87 @@
 
 #include "CoreMinimal.h"
 #include "OnlineSessionSettings.h"
+#include "Engine/EngineTypes.h"
+#include "Engine/EngineBaseTypes.h"
+#include "GameFramework/OnlineReplStructs.h"
 #include "Subsystems/GameInstanceSubsystem.h"
 #include "Interfaces/OnlineSessionInterface.h"
+#include "MultiplayerSessionsStats.h"
 
 #include "MultiplayerSessionsSubsystem.generated.h"
 
+/**
+ *FindSession的过滤条件，能放进QuerySettings的都交给后端过滤，后端没过滤干净的在结果回来时再检查一遍
+ */
+USTRUCT(BlueprintType)
+struct MULTUPLAYERSESSIONS_API FMultiplayerSessionSearchFilter
+{
+	GENERATED_BODY()
+
+	//为空表示不按MatchType过滤
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	FString MatchType;
+	//至少还要有这么多空位
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 MinOpenSlots{1};
+	//为0表示不检查版本
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 BuildVersion{0};
+	//搜索专用服务器广播的会话，而不是玩家建的大厅
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bDedicatedServers{false};
+
+	bool Matches(const FOnlineSessionSearchResult& Result) const;
+	void ApplyToQuery(FOnlineSearchSettings& QuerySettings) const;
+
+	bool operator==(const FMultiplayerSessionSearchFilter& Other) const
+	{
+		return MatchType == Other.MatchType && MinOpenSlots == Other.MinOpenSlots && BuildVersion == Other.BuildVersion &&
+			bDedicatedServers == Other.bDedicatedServers;
+	}
+	bool operator!=(const FMultiplayerSessionSearchFilter& Other) const { return !(*this == Other); }
+};
+
+/**
+ *QoS测速后的候选会话，RttMs优先用自己测的ICMP往返，测不了（比如Steam的P2P地址）时用后端给的PingInMs
+ */
+struct MULTUPLAYERSESSIONS_API FMultiplayerRankedSession
+{
+	FOnlineSessionSearchResult Result;
+	float RttMs{static_cast<float>(MAX_QUERY_PING)};
+	//RttMs是否是本次（或缓存里）自己测出来的
+	bool bMeasured{false};
+	//有可信的延迟（自己测的或后端给的），没有的排在最后
+	bool bReachable{false};
+	int32 OpenSlots{0};
+	//已有玩家占总人数的比例，0-1
+	float FillRatio{0.f};
+};
+
+//子系统串行执行的会话操作
+UENUM()
+enum class EMultiplayerSessionOp : uint8
+{
+	None,
+	Destroy,
+	Create,
+	Start,
+	Join
+};
+
+//重连进行到了哪一步
+UENUM()
+enum class EMultiplayerRejoinStage : uint8
+{
+	None,
+	//直接跳转到记下的地址
+	DirectTravel,
+	//按SessionId向后端查询后加入
+	FindById,
+	//完整搜索一次，在结果里找同一个会话
+	FullSearch
+};
+
 /**
  *自定义的对于Menu的委托 
  */
@@ -17,19 +93,48 @@ DECLARE_MULTICAST_DELEGATE_TwoParams(FMultiplayerOnFindSessionComplete,const TAr
 DECLARE_MULTICAST_DELEGATE_OneParam(FMultiplayerOnJoinSessionComplete,EOnJoinSessionCompleteResult::Type Result);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FMultiplayerOnDestroySessionComplete,bool,bWasSuccessful);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FMultiplayerOnStartSessionComplete,bool,bWasSuccessful);
-UCLASS()
+//缓存刷新后只通知变化的部分：新增的、消失的（只给SessionId）、人数等信息有变化的会话
+DECLARE_MULTICAST_DELEGATE_ThreeParams(FMultiplayerOnSessionSearchDelta,const TArray<FOnlineSessionSearchResult>& AddedResults,const TArray<FString>& RemovedSessionIds,const TArray<FOnlineSessionSearchResult>& ChangedResults);
+//QoS排序完成，第一个就是最应该加入的会话，数组为空表示没有候选；RequestId是RankSessions通过OutRequestId给出的那一轮，监听者只处理自己发起的
+DECLARE_MULTICAST_DELEGATE_TwoParams(FMultiplayerOnSessionsRanked,int32 RequestId,const TArray<FMultiplayerRankedSession>& RankedSessions);
+//加入流水线结束：成功时已经发起了跳转；Attempts是尝试过的会话数，SecondsToJoin从开始到发起跳转（或放弃）的时间
+DECLARE_MULTICAST_DELEGATE_ThreeParams(FMultiplayerOnJoinPipelineComplete,bool bWasSuccessful,int32 Attempts,double SecondsToJoin);
+DECLARE_MULTICAST_DELEGATE_OneParam(FMultiplayerOnRejoinComplete,bool bWasSuccessful);
+UCLASS(config=Game)
 class MULTUPLAYERSESSIONS_API UMultiplayerSessionsSubsystem : public UGameInstanceSubsystem
 {
 	GENERATED_BODY()
 public:
 	UMultiplayerSessionsSubsystem();
 
-	//
-	void CreateSession(int32 NumPublicConnections, FString MatchType);
-	void FindSession(int32 MaxSearchResults);
-	void JoinSession(const FOnlineSessionSearchResult& SessionResult);
-	void DestorySession();
-	void StartSession();
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//会话操作按队列串行执行：已有会话时按 销毁 -> 创建 -> 开始 的顺序等上一步完成再做下一步，整条链只广播一次结果。
+	//同样的请求重复调用会合并，和正在进行的操作冲突时返回false并且不会广播。
+	bool CreateSession(int32 NumPublicConnections, FString MatchType);
+	//缓存有效时立即广播缓存的结果，缓存变旧时会在后台刷新，刷新结果通过MultiplayerOnSessionSearchDelta通知
+	void FindSession(int32 MaxSearchResults, const FMultiplayerSessionSearchFilter& Filter = FMultiplayerSessionSearchFilter());
+	bool JoinSession(const FOnlineSessionSearchResult& SessionResult);
+	bool DestorySession();
+	bool StartSession();
+	bool IsSessionOpInProgress() const { return SessionOpChain != EMultiplayerSessionOp::None; }
+	//比赛开始后是否还接受中途加入（补位），会更新广播出去的会话设置
+	bool SetSessionJoinable(bool bJoinable);
+
+	//带计时的连接地址解析和跳转，跳转的耗时一直算到新地图加载完成
+	bool ResolveConnectString(FString& OutAddress);
+	void ClientTravel(const FString& Address);
+	//返回false表示跳转没有发起；无缝跳转之后才失败的从GEngine->OnTravelFailure得知
+	bool ServerTravel(const FString& URL);
+
+	//最近一次建房的参数，大厅用来判断人数是否已满以及要去哪张地图
+	int32 DesiredNumPublicConnections{4};
+	FString DesiredMatchType{TEXT("FreeForAll")};
+
+	//建房成功后是否接着StartSession，整条链完成才广播MultiplayerOnCreateSessionComplete
+	UPROPERTY(Config)
+	bool bStartSessionAfterCreate = false;
 
 	//用于绑定Mnue的委托变量
 	FMultiplayerOnCreateSessionComplete MultiplayerOnCreateSessionComplete;
@@ -37,6 +142,108 @@ public:
 	FMultiplayerOnJoinSessionComplete MultiplayerOnJoinSessionComplete;
 	FMultiplayerOnDestroySessionComplete MultiplayerOnDestroySessionComplete;
 	FMultiplayerOnStartSessionComplete MultiplayerOnStartSessionComplete;
+	FMultiplayerOnSessionSearchDelta MultiplayerOnSessionSearchDelta;
+	FMultiplayerOnSessionsRanked MultiplayerOnSessionsRanked;
+
+	//QoS阶段：并行ping候选会话（同时最多QosMaxConcurrentPings个，整体不超过QosDeadlineSeconds），
+	//再按RTT分档、人数比例、空位排序，结果通过MultiplayerOnSessionsRanked广播。正在排序时再调用会放弃上一轮
+	//OutRequestId在开始测速前写入这一轮的请求ID，候选都不用ping时结果会在调用返回前就广播出来
+	bool RankSessions(const TArray<FOnlineSessionSearchResult>& Candidates, int32* OutRequestId = nullptr);
+	bool IsRankingInProgress() const { return bQosInProgress; }
+	void CancelRanking();
+
+	//加入流水线：按顺序逐个加入候选会话，失败、已满或超过JoinAttemptTimeoutSeconds就换下一个，
+	//加入成功后解析地址并跳转。ExpectedMap是跳转的目标地图，用来通知预加载，可以为空
+	bool JoinRankedSessions(const TArray<FMultiplayerRankedSession>& RankedSessions, const FString& ExpectedMap = FString());
+	bool JoinCandidateSessions(const TArray<FOnlineSessionSearchResult>& Candidates, const FString& ExpectedMap = FString());
+	bool IsJoinPipelineActive() const { return bJoinPipelineActive; }
+	void CancelJoinPipeline();
+	FMultiplayerOnJoinPipelineComplete MultiplayerOnJoinPipelineComplete;
+
+	//断线或崩溃后回到上一局：先直接ClientTravel到记下的地址，连不上再按SessionId查询后加入，
+	//都不行才完整搜索一次找同一个会话。断线时如果bAutoRejoinOnDisconnect会自动调用
+	bool Rejoin();
+	bool CanRejoin() const;
+	bool IsRejoinInProgress() const { return RejoinStage != EMultiplayerRejoinStage::None; }
+	//主动离开比赛时调用，之后不会再重连这一局
+	void ClearRejoinInfo();
+	FMultiplayerOnRejoinComplete MultiplayerOnRejoinComplete;
+
+	//无界面的自动加入：找房 -> 加入 -> 跳转，给 -nullrhi 的压测客户端用，命令行带 -AutoJoin 时自动开始
+	void StartAutoJoin(const FMultiplayerSessionSearchFilter& Filter, int32 MaxAttempts);
+
+	//丢弃缓存，下一次FindSession会重新发起完整的搜索
+	void InvalidateSearchCache();
+	const TArray<FOnlineSessionSearchResult>& GetCachedSearchResults() const { return CachedSearchResults; }
+	//后台周期刷新只在菜单显示期间打开，菜单关闭或开始跳转时关掉，否则对局里还会一直查询后端
+	void SetSearchCacheBackgroundRefresh(bool bEnabled);
+
+	//本地的版本号，建房时写进会话设置，找房时用来过滤不兼容的会话
+	static int32 GetLocalBuildVersion();
+
+	//换掉底层的会话接口，命令行带 -SimulatedSessions 时换成进程内的模拟后端，压测时也用它临时替换。
+	//有操作进行中时返回false
+	bool UseSessionInterface(IOnlineSessionPtr InSessionInterface);
+	IOnlineSessionPtr GetSessionInterface() const { return OnlineInterface; }
+
+	//Insights时间线：点Join、自动加入、建房时开始一次新的追踪，之后各阶段的书签和跳转URL都带着这个加入ID
+	const FString& BeginJoinTrace(const TCHAR* Reason);
+	const FString& GetJoinTraceId() const { return JoinTraceId; }
+	//服务器记下每个玩家连进来时带的加入ID，无缝跳转到比赛地图后还能按玩家查到
+	void SetRemoteJoinId(const FUniqueNetIdRepl& PlayerId, const FString& JoinId);
+	FString GetRemoteJoinId(const FUniqueNetIdRepl& PlayerId) const;
+	void RemoveRemoteJoinId(const FUniqueNetIdRepl& PlayerId);
+
+	//缓存的有效时间（秒），超过之后FindSession不再使用缓存
+	UPROPERTY(Config)
+	float SearchCacheTTL = 30.f;
+	//缓存超过这个时间（秒）后，命中缓存的同时会在后台刷新
+	UPROPERTY(Config)
+	float SearchCacheRefreshAge = 5.f;
+	//菜单停留期间后台周期刷新的间隔（秒），0表示不周期刷新；要由菜单调用SetSearchCacheBackgroundRefresh打开
+	UPROPERTY(Config)
+	float SearchCacheBackgroundRefreshInterval = 0.f;
+
+	//同时在途的ping数量上限
+	UPROPERTY(Config)
+	int32 QosMaxConcurrentPings = 8;
+	//单个ping的超时（秒）
+	UPROPERTY(Config)
+	float QosPingTimeoutSeconds = 1.f;
+	//整个QoS阶段的截止时间（秒），到点后还没测完的会话用后端的延迟
+	UPROPERTY(Config)
+	float QosDeadlineSeconds = 1.5f;
+	//RTT按这个宽度（毫秒）分档，同一档内人多的会话优先，避免为几毫秒的差别挑一个空房
+	UPROPERTY(Config)
+	float QosRttBucketMs = 20.f;
+	//测过的RTT缓存多久（秒），重复找房时不用再ping一遍
+	UPROPERTY(Config)
+	float QosCacheTTL = 60.f;
+
+	//单个会话的加入超时（秒），后端一直不回调时放弃它换下一个
+	UPROPERTY(Config)
+	float JoinAttemptTimeoutSeconds = 10.f;
+	//一次加入流水线最多尝试几个会话
+	UPROPERTY(Config)
+	int32 JoinPipelineMaxAttempts = 5;
+
+	//上一次成功加入的会话，加入时SaveConfig写进配置文件，崩溃重启后也能读到
+	UPROPERTY(Config)
+	FString LastJoinedSessionId;
+	UPROPERTY(Config)
+	FString LastConnectString;
+	UPROPERTY(Config)
+	FString LastJoinedMatchType;
+	UPROPERTY(Config)
+	int64 LastJoinedUnixTime = 0;
+	//记录超过这个时间（秒）就不再重连，那一局多半已经结束了
+	UPROPERTY(Config)
+	float RejoinMaxAgeSeconds = 900.f;
+	//直接跳转这么久（秒）还没进入地图就改用SessionId查询
+	UPROPERTY(Config)
+	float RejoinDirectTravelTimeoutSeconds = 8.f;
+	UPROPERTY(Config)
+	bool bAutoRejoinOnDisconnect = true;
 	
 protected:
 
@@ -49,11 +256,140 @@ protected:
 	
 private:
 	IOnlineSessionPtr OnlineInterface;
+
+	//各阶段的计时
+	void BeginTiming(EMultiplayerSessionsTiming Timing);
+	void EndTiming(EMultiplayerSessionsTiming Timing, bool bWasSuccessful);
+	void OnPostLoadMapWithWorld(UWorld* LoadedWorld);
+	double TimingStartSeconds[static_cast<int32>(EMultiplayerSessionsTiming::Num)] = {};
+	FDelegateHandle PostLoadMapHandle;
+	FString JoinTraceId;
+	//玩家的UniqueNetId -> 加入ID，只在服务器上有
+	TMap<FString, FString> RemoteJoinIds;
+
+	//自动加入
+	void OnAutoJoinFindComplete(const TArray<FOnlineSessionSearchResult>& SearchResults, bool bWasSuccessful);
+	void OnAutoJoinPipelineComplete(bool bWasSuccessful, int32 Attempts, double SecondsToJoin);
+	void RetryAutoJoin();
+	void FinishAutoJoin(bool bWasSuccessful);
+	bool bAutoJoinActive{false};
+	int32 AutoJoinAttempts{0};
+	int32 AutoJoinMaxAttempts{0};
+	double AutoJoinStartTime{0.0};
+	FMultiplayerSessionSearchFilter AutoJoinFilter;
+	FTimerHandle AutoJoinRetryTimer;
+	FDelegateHandle AutoJoinFindHandle;
+	FDelegateHandle AutoJoinPipelineHandle;
+	FDelegateHandle AutoJoinRankedHandle;
+	void OnAutoJoinSessionsRanked(int32 RequestId, const TArray<FMultiplayerRankedSession>& RankedSessions);
+	int32 AutoJoinRankRequestId{0};
+
+	//QoS测速和排序
+	void StartNextQosPings();
+	void OnQosPingComplete(int32 Generation, int32 CandidateIndex, bool bSuccess, float RttMs);
+	void OnQosDeadline();
+	void FinishRanking();
+	void SortRankedSessions(TArray<FMultiplayerRankedSession>& Sessions) const;
+	struct FQosCacheEntry
+	{
+		float RttMs;
+		double Time;
+	};
+	TArray<FMultiplayerRankedSession> QosCandidates;
+	//每个候选要ping的主机，空表示不能ping
+	TArray<FString> QosPingHosts;
+	TMap<FString, FQosCacheEntry> QosRttCache;
+	int32 QosNextCandidate{0};
+	int32 QosPingsInFlight{0};
+	//每一轮加一，上一轮迟到的ping回调据此丢弃
+	int32 QosGeneration{0};
+	//每次RankSessions加一，随广播一起发出，监听者据此认出自己发起的那一轮
+	int32 QosRequestId{0};
+	bool bQosInProgress{false};
+	FTimerHandle QosDeadlineTimer;
+
+	//加入流水线
+	void TryNextJoinCandidate();
+	void OnJoinPipelineAttemptComplete(EOnJoinSessionCompleteResult::Type Result);
+	void OnJoinAttemptTimeout();
+	void FinishJoinPipeline(bool bWasSuccessful);
+	TArray<FOnlineSessionSearchResult> JoinPipelineCandidates;
+	FString JoinPipelineExpectedMap;
+	int32 JoinPipelineNextCandidate{0};
+	int32 JoinPipelineAttempts{0};
+	double JoinPipelineStartTime{0.0};
+	bool bJoinPipelineActive{false};
+	//当前这个候选的加入还没有结果，用来忽略不属于流水线的加入回调
+	bool bJoinAttemptInFlight{false};
+	FTimerHandle JoinAttemptTimer;
+	FDelegateHandle JoinPipelineJoinHandle;
+
+	//重连
+	void RememberJoinedSession(const FOnlineSessionSearchResult& SessionResult, const FString& ConnectString);
+	void RejoinFindById();
+	void RejoinFullSearch();
+	void OnRejoinFindByIdComplete(int32 LocalUserNum, bool bWasSuccessful, const FOnlineSessionSearchResult& SearchResult);
+	void OnRejoinFindComplete(const TArray<FOnlineSessionSearchResult>& SearchResults, bool bWasSuccessful);
+	void OnRejoinPipelineComplete(bool bWasSuccessful, int32 Attempts, double SecondsToJoin);
+	void OnRejoinDirectTravelTimeout();
+	void OnNetworkFailure(UWorld* World, UNetDriver* NetDriver, ENetworkFailure::Type FailureType, const FString& ErrorString);
+	void OnTravelFailure(UWorld* World, ETravelFailure::Type FailureType, const FString& ErrorString);
+	void FinishRejoin(bool bWasSuccessful);
+	EMultiplayerRejoinStage RejoinStage{EMultiplayerRejoinStage::None};
+	//断线后引擎会先回到默认地图，等它加载完再开始重连
+	bool bRejoinAfterMapLoad{false};
+	FTimerHandle RejoinTimer;
+	FDelegateHandle RejoinFindHandle;
+	FDelegateHandle RejoinPipelineHandle;
+	FDelegateHandle NetworkFailureHandle;
+	FDelegateHandle TravelFailureHandle;
+
+	//会话操作队列
+	void RunNextSessionOp();
+	void FinishSessionOpChain(bool bWasSuccessful);
+	//后端迟迟不回调时放弃当前的操作链，按失败广播
+	void AbortSessionOpChain();
+	bool BeginCreateSession();
+	bool BeginDestroySession();
+	bool BeginStartSession();
+	bool BeginJoinSession();
+	//整条链是由哪个公开接口发起的，决定完成时广播哪个委托
+	EMultiplayerSessionOp SessionOpChain{EMultiplayerSessionOp::None};
+	EMultiplayerSessionOp CurrentSessionOp{EMultiplayerSessionOp::None};
+	TArray<EMultiplayerSessionOp, TInlineAllocator<4>> PendingSessionOps;
+	int32 PendingNumPublicConnections{4};
+	FString PendingMatchType;
+	FOnlineSessionSearchResult PendingJoinResult;
+	EOnJoinSessionCompleteResult::Type LastJoinResult{EOnJoinSessionCompleteResult::UnknownError};
 	//用于保存之前设置过的sessionSettings。
 	TSharedPtr<FOnlineSessionSettings> LastSessionSettings;
 	//和上面类似，在FIndSession时使用
 	TSharedPtr<FOnlineSessionSearch> LastSessionSearch;
 
+	//FindSession的结果缓存
+	FUniqueNetIdRepl GetLocalPlayerId() const;
+	void StartSessionSearch(int32 MaxSearchResults, const FMultiplayerSessionSearchFilter& Filter, bool bBackgroundRefresh);
+	bool IsSearchCacheValid(int32 MaxSearchResults, const FMultiplayerSessionSearchFilter& Filter) const;
+	void BroadcastSearchDelta(const TArray<FOnlineSessionSearchResult>& OldResults);
+	void OnSearchCacheRefreshTimer();
+	//打开了后台刷新时定下一次刷新；bRestart为false时已经在等的不重新计时
+	void ScheduleSearchCacheRefresh(bool bRestart);
+	void StopSearchCacheRefresh();
+	TArray<FOnlineSessionSearchResult> CachedSearchResults;
+	double CachedSearchTime{0.0};
+	int32 CachedMaxSearchResults{0};
+	int32 RefreshMaxSearchResults{0};
+	FMultiplayerSessionSearchFilter CachedSearchFilter;
+	FMultiplayerSessionSearchFilter RefreshSearchFilter;
+	//搜索进行中又来了不同过滤条件的前台请求，当前这次完成后用新条件重搜
+	bool bRestartSearchWithPendingFilter{false};
+	int32 PendingMaxSearchResults{0};
+	FMultiplayerSessionSearchFilter PendingSearchFilter;
+	bool bSearchInProgress{false};
+	bool bSearchIsBackgroundRefresh{false};
+	bool bBackgroundRefreshEnabled{false};
+	FTimerHandle SearchCacheRefreshTimer;
+
 	//创建委托变量
 	FOnCreateSessionCompleteDelegate CreateSessionCompleteDelegate;
 	FDelegateHandle CreateSessionCompleteDelegateHandle;
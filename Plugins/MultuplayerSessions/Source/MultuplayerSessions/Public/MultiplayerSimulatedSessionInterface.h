@@ -0,0 +1,122 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OnlineSessionSettings.h"
+#include "OnlineSubsystemTypes.h"
+#include "Interfaces/OnlineSessionInterface.h"
+#include "Math/RandomStream.h"
+
+//模拟后端的参数，命令行：-SimulatedSessions=10000 [-SimulatedLatencyMs=50] [-SimulatedFailureRate=0.1] [-SimulatedConnectAddress=127.0.0.1:7777]
+struct MULTUPLAYERSESSIONS_API FMultiplayerSimulatedSessionParams
+{
+	//后端里广播的会话数量
+	int32 NumSessions{1000};
+	//每个请求的完成延迟（毫秒），在两者之间随机；都为0时在调用里同步完成
+	float MinLatencyMs{0.f};
+	float MaxLatencyMs{0.f};
+	//请求失败的概率，0-1
+	float FailureRate{0.f};
+	//加入成功后解析出来的地址，指向本机的监听服务器时可以真正跳转过去
+	FString ConnectAddress{TEXT("127.0.0.1:7777")};
+	int32 Seed{1234};
+
+	//命令行没有 -SimulatedSessions 时返回false
+	static bool FromCommandLine(FMultiplayerSimulatedSessionParams& OutParams);
+};
+
+/**
+ *模拟的会话ID和会话信息，只用来让搜索结果通过IsValid和GetSessionIdStr
+ */
+class FMultiplayerSimulatedSessionInfo : public FOnlineSessionInfo
+{
+public:
+	explicit FMultiplayerSimulatedSessionInfo(const FString& InSessionId);
+
+	virtual const uint8* GetBytes() const override { return nullptr; }
+	virtual int32 GetSize() const override { return 0; }
+	virtual bool IsValid() const override { return true; }
+	virtual const FUniqueNetId& GetSessionId() const override { return SessionId; }
+	virtual FString ToString() const override { return SessionId.ToString(); }
+	virtual FString ToDebugString() const override { return FString::Printf(TEXT("Simulated SessionId: %s"), *SessionId.ToDebugString()); }
+
+private:
+	FUniqueNetIdString SessionId;
+};
+
+/**
+ *进程内的模拟会话后端，替换Steam/NULL的会话接口，用来离线压测子系统和菜单：
+ *会话数量、延迟和失败率都可以配置，搜索时像Steam大厅一样在后端按QuerySettings过滤。
+ *只实现了子系统用到的接口，其余的直接返回失败。
+ */
+class MULTUPLAYERSESSIONS_API FMultiplayerSimulatedSessionInterface : public IOnlineSession, public TSharedFromThis<FMultiplayerSimulatedSessionInterface, ESPMode::ThreadSafe>
+{
+public:
+	explicit FMultiplayerSimulatedSessionInterface(const FMultiplayerSimulatedSessionParams& InParams);
+	virtual ~FMultiplayerSimulatedSessionInterface() override;
+
+	const FMultiplayerSimulatedSessionParams& GetParams() const { return Params; }
+	const TArray<FOnlineSessionSearchResult>& GetAdvertisedSessions() const { return AdvertisedSessions; }
+	void SetFailureRate(float InFailureRate) { Params.FailureRate = FMath::Clamp(InFailureRate, 0.f, 1.f); }
+
+	virtual TSharedPtr<const FUniqueNetId> CreateSessionIdFromString(const FString& SessionIdStr) override;
+	virtual FNamedOnlineSession* GetNamedSession(FName SessionName) override;
+	virtual void RemoveNamedSession(FName SessionName) override;
+	virtual bool HasPresenceSession() override;
+	virtual EOnlineSessionState::Type GetSessionState(FName SessionName) const override;
+	virtual bool CreateSession(int32 HostingPlayerNum, FName SessionName, const FOnlineSessionSettings& NewSessionSettings) override;
+	virtual bool CreateSession(const FUniqueNetId& HostingPlayerId, FName SessionName, const FOnlineSessionSettings& NewSessionSettings) override;
+	virtual bool StartSession(FName SessionName) override;
+	virtual bool UpdateSession(FName SessionName, FOnlineSessionSettings& UpdatedSessionSettings, bool bShouldRefreshOnlineData = true) override;
+	virtual bool EndSession(FName SessionName) override;
+	virtual bool DestroySession(FName SessionName, const FOnDestroySessionCompleteDelegate& CompletionDelegate = FOnDestroySessionCompleteDelegate()) override;
+	virtual bool IsPlayerInSession(FName SessionName, const FUniqueNetId& UniqueId) override;
+	virtual bool StartMatchmaking(const TArray<TSharedRef<const FUniqueNetId>>& LocalPlayers, FName SessionName, const FOnlineSessionSettings& NewSessionSettings, TSharedRef<FOnlineSessionSearch>& SearchSettings) override;
+	virtual bool CancelMatchmaking(int32 SearchingPlayerNum, FName SessionName) override;
+	virtual bool CancelMatchmaking(const FUniqueNetId& SearchingPlayerId, FName SessionName) override;
+	virtual bool FindSessions(int32 SearchingPlayerNum, const TSharedRef<FOnlineSessionSearch>& SearchSettings) override;
+	virtual bool FindSessions(const FUniqueNetId& SearchingPlayerId, const TSharedRef<FOnlineSessionSearch>& SearchSettings) override;
+	virtual bool FindSessionById(const FUniqueNetId& SearchingUserId, const FUniqueNetId& SessionId, const FUniqueNetId& FriendId, const FOnSingleSessionResultCompleteDelegate& CompletionDelegate) override;
+	virtual bool CancelFindSessions() override;
+	virtual bool PingSearchResults(const FOnlineSessionSearchResult& SearchResult) override;
+	virtual bool JoinSession(int32 LocalUserNum, FName SessionName, const FOnlineSessionSearchResult& DesiredSession) override;
+	virtual bool JoinSession(const FUniqueNetId& LocalUserId, FName SessionName, const FOnlineSessionSearchResult& DesiredSession) override;
+	virtual bool FindFriendSession(int32 LocalUserNum, const FUniqueNetId& Friend) override;
+	virtual bool FindFriendSession(const FUniqueNetId& LocalUserId, const FUniqueNetId& Friend) override;
+	virtual bool FindFriendSession(const FUniqueNetId& LocalUserId, const TArray<TSharedRef<const FUniqueNetId>>& FriendList) override;
+	virtual bool SendSessionInviteToFriend(int32 LocalUserNum, FName SessionName, const FUniqueNetId& Friend) override;
+	virtual bool SendSessionInviteToFriend(const FUniqueNetId& LocalUserId, FName SessionName, const FUniqueNetId& Friend) override;
+	virtual bool SendSessionInviteToFriends(int32 LocalUserNum, FName SessionName, const TArray<TSharedRef<const FUniqueNetId>>& Friends) override;
+	virtual bool SendSessionInviteToFriends(const FUniqueNetId& LocalUserId, FName SessionName, const TArray<TSharedRef<const FUniqueNetId>>& Friends) override;
+	virtual bool GetResolvedConnectString(FName SessionName, FString& ConnectInfo, FName PortType = NAME_GamePort) override;
+	virtual bool GetResolvedConnectString(const FOnlineSessionSearchResult& SearchResult, FName PortType, FString& ConnectInfo) override;
+	virtual FOnlineSessionSettings* GetSessionSettings(FName SessionName) override;
+	virtual bool RegisterPlayer(FName SessionName, const FUniqueNetId& PlayerId, bool bWasInvited) override;
+	virtual bool RegisterPlayers(FName SessionName, const TArray<TSharedRef<const FUniqueNetId>>& Players, bool bWasInvited = false) override;
+	virtual bool UnregisterPlayer(FName SessionName, const FUniqueNetId& PlayerId) override;
+	virtual bool UnregisterPlayers(FName SessionName, const TArray<TSharedRef<const FUniqueNetId>>& Players) override;
+	virtual void RegisterLocalPlayer(const FUniqueNetId& PlayerId, FName SessionName, const FOnRegisterLocalPlayerCompleteDelegate& Delegate) override;
+	virtual void UnregisterLocalPlayer(const FUniqueNetId& PlayerId, FName SessionName, const FOnUnregisterLocalPlayerCompleteDelegate& Delegate) override;
+	virtual int32 GetNumSessions() override;
+	virtual void DumpSessionState() override;
+
+protected:
+	virtual FNamedOnlineSession* AddNamedSession(FName SessionName, const FOnlineSessionSettings& SessionSettings) override;
+	virtual FNamedOnlineSession* AddNamedSession(FName SessionName, const FOnlineSession& Session) override;
+
+private:
+	void GenerateSessions();
+	//按配置的延迟完成请求，延迟为0时立即执行
+	void Complete(TFunction<void()>&& Callback);
+	bool RollFailure();
+	bool MatchesQuery(const FOnlineSessionSearchResult& Result, const FOnlineSearchSettings& QuerySettings) const;
+
+	FMultiplayerSimulatedSessionParams Params;
+	FRandomStream Random;
+	TArray<FOnlineSessionSearchResult> AdvertisedSessions;
+	TMap<FString, int32> SessionIndexById;
+	//本地的命名会话，和NULL子系统一样放在数组里
+	TArray<FNamedOnlineSession> Sessions;
+	int32 NextLocalSessionId{0};
+};
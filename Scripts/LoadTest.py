@@ -0,0 +1,640 @@
+#!/usr/bin/env python3
+"""
+多人压测脚本：启动一个专用服务器和N个无头客户端，等它们跑完，把结果合并成一份报告。
+
+  # 打包好的版本
+  python Scripts/LoadTest.py lobby --server-exe <...>/MultiPlayerGameServer.exe --client-exe <...>/MultiPlayerGame.exe --clients 4
+  # 直接用编辑器跑
+  python Scripts/LoadTest.py lobby --editor <UE_4.27>/Engine/Binaries/Win64/UE4Editor.exe --clients 4
+  # 复制图开/关，在16/64/128个连接下对比服务器的复制开销
+  python Scripts/LoadTest.py repgraph --server-exe <...> --client-exe <...> --connections 16,64,128
+  # 引擎默认的移动RPC和压缩格式（MultiPlayerGame.CompactMoves 0/1）的上行带宽对比
+  python Scripts/LoadTest.py compactmoves --server-exe <...> --client-exe <...> --clients 16
+  # 专用服务器上推送模式关/开（net.IsPushModelEnabled 0/1），同样人数下对比复制耗时
+  python Scripts/LoadTest.py pushmodel --server-exe <...> --client-exe <...> --clients 32
+  # 单机性能测试（-PerfTest）：在 --map 上按数量生成角色，记录帧时间、线程时间和各Tick组耗时
+  python Scripts/LoadTest.py perf --client-exe <...> --map <地图> --counts 1,50,200
+  # 同一张图上换不同的动画类，对比游戏线程耗时
+  python Scripts/LoadTest.py anim --client-exe <...> --map <地图> --anim-class <类路径> --counts 50,200
+  # 带宽检查：在参考版本上记录基线（写回Config/DefaultGame.ini），之后每次跑gate和基线比较
+  # 仓库里还没有提交记录好的基线，没有基线时gate退出码为2，不算通过也不算失败
+  python Scripts/LoadTest.py baseline --server-exe <...> --client-exe <...> --clients 16
+  python Scripts/LoadTest.py gate --server-exe <...> --client-exe <...> --clients 16 --netprofile
+  # 专用服务器和单机客户端上各跑一次 MultiPlayerGame.BenchmarkCharacterSpawn，对比单个角色的生成耗时和内存；
+  # 再让服务器留下这些角色，客户端连上去测模拟代理注销摄像机前后的游戏线程耗时
+  python Scripts/LoadTest.py spawn --server-exe <...> --client-exe <...> --count 200
+
+lobby 走会话和大厅；其它对比模式让服务器直接开地图，客户端用IP直连并按脚本跑动（-AutoMove），
+服务器跑完 -BandwidthGate 后写出带宽和复制耗时的json，脚本把每一组的结果汇总成一张表。
+所有进程都用NULL在线子系统和IpNetDriver，在同一台机器上跑；日志、服务器的json和合并后的报告都写在 --out 目录里。
+"""
+
+import argparse
+import json
+import math
+import os
+import re
+import statistics
+import subprocess
+import sys
+import time
+
+PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+UPROJECT = os.path.join(PROJECT_DIR, "MultiPlayerGame.uproject")
+DEFAULT_GAME_INI = os.path.join(PROJECT_DIR, "Config", "DefaultGame.ini")
+LOBBY_MAP = "/Game/ThirdPersonCPP/Maps/Lobby"
+# 对比模式用大厅地图换成比赛的GameMode，不会满员后跳图
+BENCH_MAP = LOBBY_MAP + "?game=/Script/MultiPlayerGame.MultiPlayerGameGameMode"
+
+# 不连Steam，本机直连；SteamNetDriver在没有Steam时会退回IpNetDriver
+NULL_OSS_ARGS = ["-ini:Engine:[OnlineSubsystem]:DefaultPlatformService=Null"]
+COMMON_ARGS = ["-log", "-unattended", "-nosplash", "-nopause"]
+# 清空复制图的类名，服务器退回引擎默认的逐Actor复制
+REPGRAPH_OFF_ARGS = [
+    "-ini:Engine:[/Script/OnlineSubsystemUtils.IpNetDriver]:ReplicationDriverClassName=",
+    "-ini:Engine:[/Script/OnlineSubsystemSteam.SteamNetDriver]:ReplicationDriverClassName=",
+]
+
+AUTO_JOIN_RE = re.compile(r"MultiplayerSessions AutoJoin result=(\w+) attempts=(\d+) seconds=([\d.]+)")
+SPAWN_RE = re.compile(r"BenchmarkCharacterSpawn (\S+) x(\d+) \(([^)]+)\): ([\d.]+) ms/spawn, ([\d.]+) components, ([\d.]+) KB exclusive, (-?[\d.]+) KB physical per character")
+PROXY_RE = re.compile(r"BenchmarkProxyCharacters (\d+) proxies: ([\d.]+) ms game thread with cameras unregistered, ([\d.]+) ms with cameras registered, ([\d.]+) vs ([\d.]+) registered components per proxy, (\d+) registered camera booms")
+LATENCY_RE = re.compile(r"MultiplayerSessions (\w+)\s+n=(\d+)\s+mean=\s*([\d.]+) p50=\s*([\d.]+) p95=\s*([\d.]+) p99=\s*([\d.]+) max=\s*([\d.]+) ms")
+
+
+class Launcher:
+    """按 --editor 或 --server-exe/--client-exe 拼出服务器和客户端的命令行"""
+
+    def __init__(self, args):
+        self.args = args
+        self.out_dir = os.path.abspath(args.out)
+        os.makedirs(self.out_dir, exist_ok=True)
+        self.processes = []
+
+    def server_command(self, map_name, extra):
+        if self.args.editor:
+            command = [self.args.editor, UPROJECT, map_name, "-server"]
+        else:
+            command = [self.args.server_exe, map_name]
+        return command + COMMON_ARGS + NULL_OSS_ARGS + ["-port=%d" % self.args.port] + extra + self.args.server_arg
+
+    def client_command(self, extra):
+        if self.args.editor:
+            command = [self.args.editor, UPROJECT, "-game"]
+        else:
+            command = [self.args.client_exe]
+        return command + COMMON_ARGS + NULL_OSS_ARGS + ["-nullrhi", "-nosound", "-windowed", "-ResX=320", "-ResY=240"] + extra + self.args.client_arg
+
+    def game_command(self, map_name, extra):
+        """单机跑 --map，带渲染，性能测试用"""
+        if self.args.editor:
+            command = [self.args.editor, UPROJECT, map_name, "-game"]
+        else:
+            command = [self.args.client_exe, map_name]
+        return command + COMMON_ARGS + NULL_OSS_ARGS + ["-windowed", "-ResX=1280", "-ResY=720", "-nosound"] + extra + self.args.client_arg
+
+    def log_path(self, name):
+        return os.path.join(self.out_dir, name + ".log")
+
+    def start(self, name, command):
+        log = self.log_path(name)
+        if os.path.exists(log):
+            os.remove(log)
+        command = command + ["-abslog=%s" % log]
+        print("[%s] %s" % (name, " ".join(command)))
+        process = subprocess.Popen(command, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        self.processes.append((name, process))
+        return process
+
+    def stop_all(self):
+        for name, process in self.processes:
+            if process.poll() is None:
+                process.terminate()
+        deadline = time.time() + 10
+        for name, process in self.processes:
+            try:
+                process.wait(max(0.1, deadline - time.time()))
+            except subprocess.TimeoutExpired:
+                process.kill()
+        self.processes = []
+
+
+def read_log(path):
+    try:
+        with open(path, encoding="utf-8", errors="replace") as f:
+            return f.read()
+    except OSError:
+        return ""
+
+
+def read_json(path):
+    try:
+        with open(path, encoding="utf-8") as f:
+            return json.load(f)
+    except (OSError, ValueError):
+        return None
+
+
+def write_json(path, data):
+    with open(path, "w", encoding="utf-8") as f:
+        json.dump(data, f, indent=2)
+    print("report written to %s" % path)
+
+
+def parse_client_log(text):
+    result = {"result": "missing"}
+    match = AUTO_JOIN_RE.search(text)
+    if match:
+        result.update(result=match.group(1), attempts=int(match.group(2)), seconds=float(match.group(3)))
+        # AutoJoin结束后紧跟着输出各阶段的延迟直方图
+        latency = {}
+        for m in LATENCY_RE.finditer(text, match.end()):
+            latency[m.group(1)] = {
+                "n": int(m.group(2)), "mean_ms": float(m.group(3)), "p50_ms": float(m.group(4)),
+                "p95_ms": float(m.group(5)), "p99_ms": float(m.group(6)), "max_ms": float(m.group(7)),
+            }
+        result["latency"] = latency
+    return result
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    return values[max(0, math.ceil(p / 100.0 * len(values)) - 1)]
+
+
+def run_lobby(launcher, args, server_extra=None, client_extra=None):
+    """一个服务器 + N个 -AutoJoin 客户端，等所有客户端出结果、大厅写完报告后合并"""
+    lobby_report = os.path.join(launcher.out_dir, "lobby.json")
+    if os.path.exists(lobby_report):
+        os.remove(lobby_report)
+    launcher.start("server", launcher.server_command(LOBBY_MAP, [
+        "-NumPlayers=%d" % args.clients, "-MatchType=%s" % args.match_type, "-LobbyReport=%s" % lobby_report,
+    ] + (server_extra or [])))
+    # 等服务器建好会话再启动客户端，否则第一轮找房必然落空
+    time.sleep(args.server_startup)
+    for index in range(args.clients):
+        launcher.start("client_%d" % index, launcher.client_command([
+            "-AutoJoin", "-AutoJoinDedicated", "-MatchType=%s" % args.match_type, "-AutoJoinAttempts=%d" % args.attempts,
+        ] + (client_extra or [])))
+        time.sleep(args.client_stagger)
+
+    deadline = time.time() + args.timeout
+    clients = []
+    while True:
+        clients = [parse_client_log(read_log(launcher.log_path("client_%d" % i))) for i in range(args.clients)]
+        done = all(c["result"] != "missing" for c in clients) and os.path.exists(lobby_report)
+        if done or time.time() > deadline:
+            break
+        time.sleep(1)
+
+    # 大厅满员后会跳到比赛地图，报告在跳转前写出；给它一点时间落盘
+    settle_deadline = time.time() + 5
+    while not os.path.exists(lobby_report) and time.time() < settle_deadline:
+        time.sleep(0.5)
+
+    seconds = [c["seconds"] for c in clients if c["result"] == "success"]
+    summary = {
+        "clients": args.clients,
+        "succeeded": sum(1 for c in clients if c["result"] == "success"),
+        "failed": sum(1 for c in clients if c["result"] == "failure"),
+        "missing": sum(1 for c in clients if c["result"] == "missing"),
+        "join_seconds_mean": statistics.mean(seconds) if seconds else None,
+        "join_seconds_p50": percentile(seconds, 50),
+        "join_seconds_p95": percentile(seconds, 95),
+        "join_seconds_max": max(seconds) if seconds else None,
+        "timed_out": time.time() > deadline,
+    }
+    return {"summary": summary, "lobby": read_json(lobby_report), "clients": clients}
+
+
+def run_direct(launcher, args, clients, server_extra=None, client_extra=None):
+    """服务器开 --map，N个客户端直连并按脚本跑动；连接到齐、预热完后采样 --seconds 秒，返回服务器写出的带宽报告"""
+    report_path = os.path.join(launcher.out_dir, "bandwidth.json")
+    if os.path.exists(report_path):
+        os.remove(report_path)
+    server = launcher.start("server", launcher.server_command(args.map, [
+        "-BandwidthGate=%d" % args.seconds, "-BandwidthClients=%d" % clients, "-BandwidthReport=%s" % report_path,
+    ] + (["-BandwidthNetProfile"] if args.netprofile else []) + (server_extra or [])))
+    time.sleep(args.server_startup)
+    for index in range(clients):
+        launcher.start("client_%d" % index, launcher.client_command(
+            ["127.0.0.1:%d" % args.port, "-AutoMove"] + (client_extra or [])))
+        time.sleep(args.client_stagger)
+
+    # 服务器写完报告就退出；客户端到齐之后还要预热（默认10秒）再采样
+    deadline = time.time() + args.timeout + args.seconds
+    while not os.path.exists(report_path) and server.poll() is None and time.time() < deadline:
+        time.sleep(1)
+    time.sleep(1)
+    report = read_json(report_path)
+    if report is None:
+        print("no bandwidth report from the server (see %s)" % launcher.log_path("server"))
+    return report
+
+
+def run_cases(args, cases):
+    """依次跑每一组 (名字, 连接数, 服务器参数, 客户端参数)，每组之间关掉全部进程"""
+    results = []
+    for name, clients, server_extra, client_extra in cases:
+        print("=== %s, %d clients ===" % (name, clients))
+        launcher = Launcher(args)
+        try:
+            report = run_direct(launcher, args, clients, server_extra, client_extra)
+        finally:
+            launcher.stop_all()
+        results.append({"case": name, "clients": clients, "report": report})
+    return results
+
+
+def print_table(results, columns):
+    widths = [max(10, len(c)) for c in columns]
+    print("%-24s %8s" % ("case", "clients") + "".join(" %*s" % (w, c) for w, c in zip(widths, columns)))
+    for result in results:
+        report = result["report"] or {}
+        cells = []
+        for width, column in zip(widths, columns):
+            value = report.get(column)
+            text = "-" if value is None else ("%.3f" % value if isinstance(value, float) else str(value))
+            cells.append(" %*s" % (width, text))
+        print("%-24s %8d" % (result["case"], result["clients"]) + "".join(cells))
+
+
+def run_perf(launcher, args, name, extra=None):
+    """单机跑一次 -PerfTest，等进程测完所有数量自己退出，返回每个数量的json摘要"""
+    report_dir = os.path.join(launcher.out_dir, "perf_" + name)
+    os.makedirs(report_dir, exist_ok=True)
+    for entry in os.listdir(report_dir):
+        os.remove(os.path.join(report_dir, entry))
+    process = launcher.start(name, launcher.game_command(args.map, [
+        "-PerfTest=%s" % args.counts, "-PerfTestMap=%s" % args.map, "-PerfTestSeconds=%d" % args.seconds, "-PerfTestDir=%s" % report_dir,
+    ] + (extra or [])))
+    try:
+        process.wait(args.timeout)
+    except subprocess.TimeoutExpired:
+        print("%s did not finish in %.0f s" % (name, args.timeout))
+    reports = []
+    for entry in sorted(os.listdir(report_dir)):
+        report = read_json(os.path.join(report_dir, entry))
+        if report is not None:
+            reports.append(report)
+    return sorted(reports, key=lambda r: r.get("characters", 0))
+
+
+def print_perf_table(results):
+    print("%-40s %10s %12s %12s %12s %14s" % ("case", "characters", "frame avg", "game avg", "game p95", "PrePhysics avg"))
+    for result in results:
+        for report in result["reports"]:
+            print("%-40s %10d %12.3f %12.3f %12.3f %14.3f" % (
+                result["case"], report.get("characters", 0),
+                report.get("frame_ms", {}).get("avg", 0.0), report.get("game_thread_ms", {}).get("avg", 0.0),
+                report.get("game_thread_ms", {}).get("p95", 0.0), report.get("tick_group_avg_ms", {}).get("PrePhysics", 0.0)))
+
+
+def parse_counts(text):
+    return [int(x) for x in text.split(",") if x.strip()]
+
+
+def add_launcher_args(parser):
+    group = parser.add_mutually_exclusive_group()
+    group.add_argument("--editor", help="UE4Editor executable; runs the project with -server / -game")
+    group.add_argument("--server-exe", help="packaged MultiPlayerGameServer executable (needs --client-exe)")
+    parser.add_argument("--client-exe", help="packaged MultiPlayerGame executable")
+    parser.add_argument("--out", default=os.path.join(PROJECT_DIR, "Saved", "LoadTest"), help="directory for logs and reports")
+    parser.add_argument("--port", type=int, default=7777)
+    parser.add_argument("--server-arg", action="append", default=[], help="extra argument for the server (repeatable)")
+    parser.add_argument("--client-arg", action="append", default=[], help="extra argument for every client (repeatable)")
+
+
+def add_lobby_args(parser):
+    parser.add_argument("--clients", type=int, default=4, help="number of headless clients")
+    parser.add_argument("--match-type", default="FreeForAll")
+    parser.add_argument("--attempts", type=int, default=10, help="-AutoJoinAttempts for each client")
+    parser.add_argument("--server-startup", type=float, default=15.0, help="seconds to wait before starting clients")
+    parser.add_argument("--client-stagger", type=float, default=0.5, help="seconds between client launches")
+    parser.add_argument("--timeout", type=float, default=180.0, help="give up after this many seconds")
+
+
+def add_direct_args(parser):
+    parser.add_argument("--map", default=BENCH_MAP, help="map URL the server opens")
+    parser.add_argument("--seconds", type=int, default=30, help="-BandwidthGate: seconds sampled after warmup")
+    parser.add_argument("--server-startup", type=float, default=15.0, help="seconds to wait before starting clients")
+    parser.add_argument("--client-stagger", type=float, default=0.5, help="seconds between client launches")
+    parser.add_argument("--timeout", type=float, default=300.0, help="extra seconds to wait for the server report")
+    parser.add_argument("--netprofile", action="store_true",
+                        help="record a netprofile on the server while sampling; open the .nprof under Saved/Profiling in NetworkProfiler for per-class and per-RPC bytes")
+
+
+def add_perf_args(parser):
+    parser.add_argument("--map", required=True, help="perf test map, opened standalone")
+    parser.add_argument("--counts", default="1,50,200", help="comma-separated character counts")
+    parser.add_argument("--seconds", type=int, default=30, help="-PerfTestSeconds for each count")
+    parser.add_argument("--timeout", type=float, default=900.0, help="give up on a run after this many seconds")
+
+
+def command_repgraph(args):
+    cases = []
+    for clients in parse_counts(args.connections):
+        cases.append(("repgraph", clients, [], []))
+        cases.append(("legacy", clients, REPGRAPH_OFF_ARGS, []))
+    results = run_cases(args, cases)
+
+    # 开关没生效时两组量的是同一条路径，对比没有意义
+    ok = True
+    for result in results:
+        report = result["report"]
+        if report is None or report.get("replication_graph") != (result["case"] == "repgraph"):
+            print("%s x%d: replication graph state not as requested" % (result["case"], result["clients"]))
+            ok = False
+    write_json(os.path.join(os.path.abspath(args.out), "repgraph_report.json"), results)
+    print_table(results, ["connections", "server_net_flush_ms", "server_replicate_actors_avg_ms", "out_bytes_per_character"])
+    return 0 if ok else 1
+
+
+def command_compactmoves(args):
+    cases = [
+        ("stock", args.clients, [], ["-ExecCmds=MultiPlayerGame.CompactMoves 0"]),
+        ("compact", args.clients, [], ["-ExecCmds=MultiPlayerGame.CompactMoves 1"]),
+    ]
+    # 发送间隔默认用引擎的60Hz；想看降低发送频率能再省多少，就加一组
+    if args.send_interval:
+        cases.append(("compact_%gs" % args.send_interval, args.clients, [], [
+            "-ExecCmds=MultiPlayerGame.CompactMoves 1",
+            "-ini:Game:[/Script/Engine.GameNetworkManager]:ClientNetSendMoveDeltaTime=%g" % args.send_interval,
+        ]))
+    results = run_cases(args, cases)
+    write_json(os.path.join(os.path.abspath(args.out), "compactmoves_report.json"), results)
+    print_table(results, ["move_rpc_bytes_per_character", "in_bytes_per_connection", "out_bytes_per_character"])
+    return 0 if all(r["report"] is not None for r in results) else 1
+
+
+def command_pushmodel(args):
+    # 推送模式只编进了专用服务器目标，编辑器的 -server 进程里这个开关不起作用
+    cases = [
+        ("polling", args.clients, ["-ini:Engine:[SystemSettings]:net.IsPushModelEnabled=0"], []),
+        ("push_model", args.clients, ["-ini:Engine:[SystemSettings]:net.IsPushModelEnabled=1"], []),
+    ]
+    results = run_cases(args, cases)
+    ok = True
+    for result in results:
+        report = result["report"]
+        if report is None or report.get("push_model") != (result["case"] == "push_model"):
+            print("%s: push model state not as requested (the server target must be built with bWithPushModel)" % result["case"])
+            ok = False
+    write_json(os.path.join(os.path.abspath(args.out), "pushmodel_report.json"), results)
+    print_table(results, ["server_net_flush_ms", "server_replicate_actors_avg_ms", "out_bytes_per_character"])
+    return 0 if ok else 1
+
+
+def command_perf(args):
+    launcher = Launcher(args)
+    try:
+        reports = run_perf(launcher, args, "perf")
+    finally:
+        launcher.stop_all()
+    results = [{"case": "perf", "reports": reports}]
+    write_json(os.path.join(os.path.abspath(args.out), "perf_report.json"), results)
+    if reports:
+        print("map %s, pawn %s, controller %s, anim %s" % (
+            reports[0].get("map"), reports[0].get("pawn_class"), reports[0].get("controller_class"), reports[0].get("anim_class")))
+    print_perf_table(results)
+    # 每个数量都要有结果，少了说明中途退出或者地图没对上（看日志）
+    return 0 if len(reports) == len(parse_counts(args.counts)) else 1
+
+
+def command_anim(args):
+    # 第一组用角色蓝图自己的动画类，后面每组换成 --anim-class 指定的类
+    cases = [("default", [])] + [(path.rsplit(".", 1)[-1], ["-PerfTestAnimClass=%s" % path]) for path in args.anim_class]
+    results = []
+    for name, extra in cases:
+        launcher = Launcher(args)
+        try:
+            reports = run_perf(launcher, args, name, extra)
+        finally:
+            launcher.stop_all()
+        results.append({"case": name, "reports": reports})
+    write_json(os.path.join(os.path.abspath(args.out), "anim_report.json"), results)
+    print_perf_table(results)
+    return 0 if all(r["reports"] for r in results) else 1
+
+
+# 报告里的字段 -> DefaultGame.ini 里的基线
+BASELINE_KEYS = [
+    ("out_bytes_per_character", "BaselineOutBytesPerCharacter"),
+    ("in_bytes_per_connection", "BaselineInBytesPerConnection"),
+    ("move_rpc_bytes_per_character", "BaselineMoveRPCBytesPerCharacter"),
+]
+
+
+def write_baseline(report):
+    """把报告里的平均值写回 DefaultGame.ini，换行符保持原样"""
+    with open(DEFAULT_GAME_INI, encoding="utf-8", newline="") as f:
+        text = f.read()
+    for field, key in BASELINE_KEYS:
+        text, count = re.subn(r"(?m)^%s=[^\r\n]*" % key, "%s=%.1f" % (key, report[field]), text)
+        if count != 1:
+            raise RuntimeError("%s not found once in %s" % (key, DEFAULT_GAME_INI))
+    with open(DEFAULT_GAME_INI, "w", encoding="utf-8", newline="") as f:
+        f.write(text)
+    print("baseline written to %s" % DEFAULT_GAME_INI)
+
+
+def command_baseline(args):
+    results = run_cases(args, [("baseline", args.clients, ["-BandwidthRecordBaseline"], [])])
+    report = results[0]["report"]
+    write_json(os.path.join(os.path.abspath(args.out), "baseline_report.json"), results)
+    print_table(results, [field for field, key in BASELINE_KEYS])
+    if report is None or not report.get("record_baseline"):
+        print("the server did not record a baseline")
+        return 1
+    write_baseline(report)
+    return 0
+
+
+def read_baseline():
+    with open(DEFAULT_GAME_INI, encoding="utf-8") as f:
+        text = f.read()
+    baseline = {}
+    for field, key in BASELINE_KEYS:
+        match = re.search(r"(?m)^%s=([-\d.]+)" % key, text)
+        baseline[key] = float(match.group(1)) if match else 0.0
+    return baseline
+
+
+def command_gate(args):
+    # 打包的服务器用的是烘焙时的配置，基线从工作区的ini里读出来用命令行传进去
+    section = "/Script/MultiPlayerGame.MultiPlayerGameBandwidthSubsystem"
+    server_extra = ["-ini:Game:[%s]:%s=%g" % (section, key, value) for key, value in read_baseline().items()]
+    results = run_cases(args, [("gate", args.clients, server_extra, [])])
+    report = results[0]["report"]
+    write_json(os.path.join(os.path.abspath(args.out), "gate_report.json"), results)
+    print_table(results, [field for field, key in BASELINE_KEYS] + ["server_net_flush_ms"])
+    if report is None:
+        return 1
+    if not report.get("baseline_recorded"):
+        print("no baseline recorded in %s; run the baseline mode on a reference build first" % DEFAULT_GAME_INI)
+        return 2
+    if report.get("netprofile_dir"):
+        print("netprofile written under %s" % report["netprofile_dir"])
+    print("gate %s" % ("passed" if report.get("passed") else "FAILED"))
+    return 0 if report.get("passed") else 1
+
+
+def run_proxy_spawn(launcher, args):
+    """单机生成的角色都有权威，走不到模拟代理的路径；这里服务器留下角色，客户端连上去等它们复制过来再采样"""
+    launcher.start("spawn_proxy_server", launcher.server_command(args.map, [
+        "-ExecCmds=MultiPlayerGame.BenchmarkCharacterSpawn %d Keep" % args.count]))
+    time.sleep(args.server_startup)
+    client = launcher.start("spawn_proxy_client", launcher.game_command("127.0.0.1:%d" % args.port, [
+        "-ExecCmds=MultiPlayerGame.BenchmarkProxyCharacters %d Seconds=%d Quit" % (args.count, args.seconds)]))
+    try:
+        client.wait(args.timeout)
+    except subprocess.TimeoutExpired:
+        print("spawn_proxy_client did not finish in %.0f s" % args.timeout)
+    match = PROXY_RE.search(read_log(launcher.log_path("spawn_proxy_client")))
+    if match is None:
+        print("spawn_proxy_client: no BenchmarkProxyCharacters line in %s" % launcher.log_path("spawn_proxy_client"))
+        return None
+    return {
+        "proxies": int(match.group(1)),
+        "game_thread_ms_cameras_unregistered": float(match.group(2)),
+        "game_thread_ms_cameras_registered": float(match.group(3)),
+        "registered_components_unregistered": float(match.group(4)),
+        "registered_components_registered": float(match.group(5)),
+        "registered_camera_booms": int(match.group(6)),
+    }
+
+
+def command_spawn(args):
+    # 控制台命令跑完就退出，每一端只起一个进程；客户端是单机模式，本地有权威可以生成角色
+    exec_cmds = "-ExecCmds=MultiPlayerGame.BenchmarkCharacterSpawn %d, quit" % args.count
+    launcher = Launcher(args)
+    results = []
+    proxy = None
+    try:
+        for name, command in (
+            ("spawn_server", launcher.server_command(args.map, [exec_cmds])),
+            ("spawn_client", launcher.game_command(args.map, [exec_cmds])),
+        ):
+            process = launcher.start(name, command)
+            try:
+                process.wait(args.timeout)
+            except subprocess.TimeoutExpired:
+                print("%s did not finish in %.0f s" % (name, args.timeout))
+            match = SPAWN_RE.search(read_log(launcher.log_path(name)))
+            if match is None:
+                print("%s: no BenchmarkCharacterSpawn line in %s" % (name, launcher.log_path(name)))
+                results.append({"case": name, "report": None})
+                continue
+            results.append({"case": name, "report": {
+                "pawn_class": match.group(1), "characters": int(match.group(2)), "net_mode": match.group(3),
+                "spawn_ms": float(match.group(4)), "components": float(match.group(5)),
+                "exclusive_kb": float(match.group(6)), "physical_kb": float(match.group(7)),
+            }})
+        proxy = run_proxy_spawn(launcher, args)
+    finally:
+        launcher.stop_all()
+    write_json(os.path.join(launcher.out_dir, "spawn_report.json"), {"spawn": results, "proxy": proxy})
+    print("%-14s %-18s %-30s %10s %10s %12s %12s" % ("case", "net mode", "pawn class", "ms/spawn", "components", "KB exclusive", "KB physical"))
+    for result in results:
+        report = result["report"]
+        if report is None:
+            print("%-14s %s" % (result["case"], "no result"))
+            continue
+        print("%-14s %-18s %-30s %10.3f %10.1f %12.1f %12.1f" % (
+            result["case"], report["net_mode"], report["pawn_class"], report["spawn_ms"],
+            report["components"], report["exclusive_kb"], report["physical_kb"]))
+    if proxy is not None:
+        print("simulated proxies on a connected client (%d): game thread %.3f ms with cameras unregistered, %.3f ms registered; "
+              "%.1f vs %.1f registered components per proxy, %d registered camera booms" % (
+                  proxy["proxies"], proxy["game_thread_ms_cameras_unregistered"], proxy["game_thread_ms_cameras_registered"],
+                  proxy["registered_components_unregistered"], proxy["registered_components_registered"], proxy["registered_camera_booms"]))
+    return 0 if proxy is not None and all(r["report"] is not None for r in results) else 1
+
+
+def command_lobby(args):
+    launcher = Launcher(args)
+    try:
+        report = run_lobby(launcher, args)
+    finally:
+        launcher.stop_all()
+    write_json(os.path.join(launcher.out_dir, "loadtest_report.json"), report)
+    summary = report["summary"]
+    print("clients %d: %d succeeded, %d failed, %d missing; join p50 %s s, p95 %s s" % (
+        summary["clients"], summary["succeeded"], summary["failed"], summary["missing"],
+        summary["join_seconds_p50"], summary["join_seconds_p95"]))
+    return 0 if summary["succeeded"] == summary["clients"] and report["lobby"] is not None else 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    lobby = commands.add_parser("lobby", help="one dedicated server and N -AutoJoin clients, merged into one report")
+    add_launcher_args(lobby)
+    add_lobby_args(lobby)
+    lobby.set_defaults(func=command_lobby)
+
+    repgraph = commands.add_parser("repgraph", help="server net flush cost with the replication graph on and off")
+    add_launcher_args(repgraph)
+    add_direct_args(repgraph)
+    repgraph.add_argument("--connections", default="16,64,128", help="comma-separated client counts")
+    repgraph.set_defaults(func=command_repgraph)
+
+    compactmoves = commands.add_parser("compactmoves", help="upstream move RPC bandwidth, engine format vs compact format")
+    add_launcher_args(compactmoves)
+    add_direct_args(compactmoves)
+    compactmoves.add_argument("--clients", type=int, default=16)
+    compactmoves.add_argument("--send-interval", type=float, help="also run compact moves with this ClientNetSendMoveDeltaTime")
+    compactmoves.set_defaults(func=command_compactmoves)
+
+    pushmodel = commands.add_parser("pushmodel", help="server replication cost with push model off and on")
+    add_launcher_args(pushmodel)
+    add_direct_args(pushmodel)
+    pushmodel.add_argument("--clients", type=int, default=32)
+    pushmodel.set_defaults(func=command_pushmodel)
+
+    perf = commands.add_parser("perf", help="standalone -PerfTest on --map for each character count")
+    add_launcher_args(perf)
+    add_perf_args(perf)
+    perf.set_defaults(func=command_perf, needs_server=False)
+
+    anim = commands.add_parser("anim", help="standalone -PerfTest with different anim instance classes on the same map")
+    add_launcher_args(anim)
+    add_perf_args(anim)
+    anim.add_argument("--anim-class", action="append", required=True,
+                      help="anim instance class path to compare against the character's own, e.g. /Game/Mannequin/Animations/ThirdPerson_AnimBP.ThirdPerson_AnimBP_C (repeatable)")
+    anim.set_defaults(func=command_anim, needs_server=False)
+
+    baseline = commands.add_parser("baseline", help="record the bandwidth baseline into Config/DefaultGame.ini")
+    add_launcher_args(baseline)
+    add_direct_args(baseline)
+    baseline.add_argument("--clients", type=int, default=16)
+    baseline.set_defaults(func=command_baseline)
+
+    gate = commands.add_parser("gate", help="bandwidth regression check against the recorded baseline")
+    add_launcher_args(gate)
+    add_direct_args(gate)
+    gate.add_argument("--clients", type=int, default=16)
+    gate.set_defaults(func=command_gate)
+
+    spawn = commands.add_parser("spawn", help="per-character spawn time and memory on a dedicated server and a client, and simulated proxy cost on a connected client")
+    add_launcher_args(spawn)
+    spawn.add_argument("--map", default=BENCH_MAP, help="map both processes open before the benchmark runs")
+    spawn.add_argument("--count", type=int, default=200, help="characters spawned by BenchmarkCharacterSpawn")
+    spawn.add_argument("--timeout", type=float, default=300.0, help="give up on a process after this many seconds")
+    spawn.add_argument("--server-startup", type=float, default=15.0, help="seconds to wait before the proxy client connects")
+    spawn.add_argument("--seconds", type=int, default=10, help="seconds sampled on the proxy client in each camera state")
+    spawn.set_defaults(func=command_spawn)
+
+    args = parser.parse_args()
+    # 单机的性能测试只需要客户端，其它模式都要起服务器
+    if getattr(args, "needs_server", True) and not args.editor and not (args.server_exe and args.client_exe):
+        parser.error("needs --editor, or --server-exe together with --client-exe")
+    if not args.editor and not args.client_exe:
+        parser.error("needs --editor or --client-exe")
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
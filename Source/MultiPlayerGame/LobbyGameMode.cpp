@@ -2,42 +2,409 @@
 
 
 #include "LobbyGameMode.h"
+#include "LobbyGameState.h"
+#include "OnlineSubsystem.h"
+#include "Interfaces/OnlineSessionInterface.h"
 #include "GameFramework/GameStateBase.h"
 #include "MultiplayerSessionsSubsystem.h"
+#include "MatchTypeSettings.h"
+#include "MultiPlayerGameReplicationGraph.h"
+#include "MultiPlayerGamePawnPoolSubsystem.h"
+#include "MultiPlayerGamePlayerController.h"
+#include "Engine/NetDriver.h"
+#include "Net/Core/PushModel/PushModel.h"
+#include "MultiplayerPreloadSubsystem.h"
+#include "GameMapsSettings.h"
+#include "GameFramework/PlayerState.h"
+#include "TimerManager.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Engine/Engine.h"
+#include "Kismet/GameplayStatics.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonWriter.h"
+#include "Serialization/JsonSerializer.h"
+
+ALobbyGameMode::ALobbyGameMode()
+{
+	GameStateClass = ALobbyGameState::StaticClass();
+	PlayerControllerClass = AMultiPlayerGamePlayerController::StaticClass();
+}
+
+void ALobbyGameMode::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (GEngine)
+	{
+		NetworkFailureHandle = GEngine->OnNetworkFailure().AddUObject(this, &ThisClass::OnNetworkFailure);
+		TravelFailureHandle = GEngine->OnTravelFailure().AddUObject(this, &ThisClass::OnTravelFailure);
+	}
+
+	if (GetNetMode() == NM_DedicatedServer)
+	{
+		CreateDedicatedServerSession();
+	}
+
+	if (UMultiPlayerGamePawnPoolSubsystem* PawnPool = GetWorld()->GetSubsystem<UMultiPlayerGamePawnPoolSubsystem>())
+	{
+		PawnPool->Prewarm(DefaultPawnClass);
+	}
+}
+
+void ALobbyGameMode::CreateDedicatedServerSession()
+{
+	UGameInstance* GameInstance = GetGameInstance();
+	if (GameInstance == nullptr)
+	{
+		return;
+	}
+	UMultiplayerSessionsSubsystem* Subsystem = GameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>();
+	if (Subsystem == nullptr || Subsystem->IsSessionOpInProgress())
+	{
+		return;
+	}
+	//比赛结束回到大厅时会话还在，不用重新建
+	IOnlineSubsystem* OnlineSubsystem = IOnlineSubsystem::Get();
+	IOnlineSessionPtr SessionInterface = OnlineSubsystem ? OnlineSubsystem->GetSessionInterface() : nullptr;
+	if (SessionInterface.IsValid() && SessionInterface->GetNamedSession(NAME_GameSession) != nullptr)
+	{
+		return;
+	}
+
+	//人数和模式从命令行读，例如 MultiPlayerGameServer -log -NumPlayers=4 -MatchType=FreeForAll
+	int32 NumPublicConnections = Subsystem->DesiredNumPublicConnections;
+	FString MatchType = Subsystem->DesiredMatchType;
+	FParse::Value(FCommandLine::Get(), TEXT("NumPlayers="), NumPublicConnections);
+	FParse::Value(FCommandLine::Get(), TEXT("MatchType="), MatchType);
+	Subsystem->CreateSession(NumPublicConnections, MatchType);
+}
+
+void ALobbyGameMode::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (GEngine)
+	{
+		GEngine->OnNetworkFailure().Remove(NetworkFailureHandle);
+		GEngine->OnTravelFailure().Remove(TravelFailureHandle);
+	}
+	WriteLoadReport();
+	Super::EndPlay(EndPlayReason);
+}
+
+void ALobbyGameMode::PreLogin(const FString& Options, const FString& Address, const FUniqueNetIdRepl& UniqueId, FString& ErrorMessage)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(ALobbyGameMode::PreLogin);
+	Super::PreLogin(Options, Address, UniqueId, ErrorMessage);
+	//客户端跳转时在URL里带了加入ID，记下来，PostLogin和无缝跳转时按玩家查
+	const FString JoinId = UGameplayStatics::ParseOption(Options, MultiplayerSessionsTrace::JoinIdOption);
+	MultiplayerSessionsTrace::Bookmark(TEXT("PreLogin"), JoinId, ErrorMessage.IsEmpty() ? Address : ErrorMessage);
+	//ErrorMessage不为空表示这次连接被拒绝了
+	if (!ErrorMessage.IsEmpty())
+	{
+		++NumLoginsRejected;
+		return;
+	}
+	UGameInstance* GameInstance = GetGameInstance();
+	if (UMultiplayerSessionsSubsystem* Subsystem = GameInstance ? GameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr)
+	{
+		Subsystem->SetRemoteJoinId(UniqueId, JoinId);
+	}
+}
+
+void ALobbyGameMode::OnNetworkFailure(UWorld* World, UNetDriver* NetDriver, ENetworkFailure::Type FailureType, const FString& ErrorString)
+{
+	if (World == GetWorld())
+	{
+		++NumNetworkFailures;
+	}
+}
+
+void ALobbyGameMode::TravelToMatch(const FMatchTypeDefinition& Definition)
+{
+	UGameInstance* GameInstance = GetGameInstance();
+	UMultiplayerSessionsSubsystem* Subsystem = GameInstance ? GameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr;
+	const FString MapPath = Definition.Map.GetLongPackageName();
+	if (Subsystem == nullptr || MapPath.IsEmpty())
+	{
+		return;
+	}
+	bMatchStarting = true;
+	GetWorldTimerManager().ClearTimer(FillTimeoutTimer);
+	if (ALobbyGameState* LobbyGameState = GetGameState<ALobbyGameState>())
+	{
+		LobbyGameState->SetFillDeadline(0.f);
+		LobbyGameState->SetMatchStarting();
+	}
+	//不允许补位的模式开始后就不再接受新玩家
+	Subsystem->SetSessionJoinable(Definition.bAllowBackfill);
+	bUseSeamlessTravel = true;
+	ServerTravelTime = FPlatformTime::Seconds();
+	//无缝跳转时大厅的GameMode会被销毁，在跳转前先把报告写出去
+	WriteLoadReport();
+	if (UMultiplayerPreloadSubsystem* PreloadSubsystem = GameInstance->GetSubsystem<UMultiplayerPreloadSubsystem>())
+	{
+		PreloadSubsystem->NotifyTravelStarted(MapPath);
+	}
+	MultiplayerSessionsTrace::Bookmark(TEXT("TravelToMatch"), Subsystem->GetJoinTraceId(), FString::Printf(TEXT("%s %d players"), *MapPath, GetNumPlayersInLobby()));
+	if (!Subsystem->ServerTravel(MakeTravelURL(MapPath)))
+	{
+		AbortTravelToMatch(FString::Printf(TEXT("ServerTravel to %s was rejected"), *MapPath));
+	}
+}
+
+void ALobbyGameMode::OnTravelFailure(UWorld* World, ETravelFailure::Type FailureType, const FString& ErrorString)
+{
+	//无缝跳转失败时大厅的世界和GameMode都还在
+	if (World == GetWorld() && bMatchStarting)
+	{
+		AbortTravelToMatch(FString::Printf(TEXT("%s %s"), ETravelFailure::ToString(FailureType), *ErrorString));
+	}
+}
+
+void ALobbyGameMode::AbortTravelToMatch(const FString& Reason)
+{
+	UE_LOG(LogTemp, Warning, TEXT("Lobby travel to match failed: %s"), *Reason);
+	bMatchStarting = false;
+	if (ALobbyGameState* LobbyGameState = GetGameState<ALobbyGameState>())
+	{
+		LobbyGameState->SetMatchStarting(false);
+	}
+	UGameInstance* GameInstance = GetGameInstance();
+	if (UMultiplayerSessionsSubsystem* Subsystem = GameInstance ? GameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr)
+	{
+		Subsystem->SetSessionJoinable(true);
+		MultiplayerSessionsTrace::Bookmark(TEXT("TravelToMatchFailed"), Subsystem->GetJoinTraceId(), Reason);
+	}
+	//报告里不能记成已经跳转，下次跳转或者结束时重新写
+	ServerTravelTime = 0.0;
+	bLoadReportWritten = false;
+	//满员时重新判断会立即再跳一次，同步失败的话会一直递归下去，隔一会儿再判断
+	GetWorldTimerManager().SetTimer(TravelRetryTimer, this, &ThisClass::EvaluateFillPolicy, TravelRetryDelaySeconds);
+}
+
+void ALobbyGameMode::WriteLoadReport()
+{
+	FString ReportPath;
+	if (bLoadReportWritten || !FParse::Value(FCommandLine::Get(), TEXT("LobbyReport="), ReportPath))
+	{
+		return;
+	}
+	bLoadReportWritten = true;
+
+	const int32 NumAttempts = NumLoginsAccepted + NumLoginsRejected;
+	const double LoginWindow = LastPostLoginTime - FirstPostLoginTime;
+
+	TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+	Report->SetStringField(TEXT("map"), GetWorld() ? GetWorld()->GetMapName() : FString());
+	Report->SetNumberField(TEXT("logins_accepted"), NumLoginsAccepted);
+	Report->SetNumberField(TEXT("logins_rejected"), NumLoginsRejected);
+	Report->SetNumberField(TEXT("network_failures"), NumNetworkFailures);
+	Report->SetNumberField(TEXT("accept_ratio"), NumAttempts > 0 ? static_cast<double>(NumLoginsAccepted) / NumAttempts : 0.0);
+	Report->SetNumberField(TEXT("accepts_per_second"), LoginWindow > 0.0 ? (NumLoginsAccepted - 1) / LoginWindow : 0.0);
+	Report->SetNumberField(TEXT("login_window_ms"), LoginWindow * 1000.0);
+	Report->SetBoolField(TEXT("server_travel"), ServerTravelTime > 0.0);
+	if (ServerTravelTime > 0.0 && FirstPostLoginTime > 0.0)
+	{
+		Report->SetNumberField(TEXT("first_post_login_to_server_travel_ms"), (ServerTravelTime - FirstPostLoginTime) * 1000.0);
+		Report->SetNumberField(TEXT("last_post_login_to_server_travel_ms"), (ServerTravelTime - LastPostLoginTime) * 1000.0);
+	}
+	//专用服务器上同样人数下分别用 -ini:Engine:[SystemSettings]:net.IsPushModelEnabled=0/1 跑一次（LoadTest.py pushmodel），对比复制的耗时
+	Report->SetBoolField(TEXT("push_model"), IS_PUSH_MODEL_ENABLED());
+	UNetDriver* NetDriver = GetWorld() ? GetWorld()->GetNetDriver() : nullptr;
+	if (UMultiPlayerGameReplicationGraph* RepGraph = NetDriver ? NetDriver->GetReplicationDriver<UMultiPlayerGameReplicationGraph>() : nullptr)
+	{
+		Report->SetNumberField(TEXT("server_replicate_actors_avg_ms"), RepGraph->GetAverageServerReplicateActorsMs());
+	}
+
+	FString Json;
+	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(Report, Writer);
+	if (FPaths::IsRelative(ReportPath))
+	{
+		ReportPath = FPaths::ProjectSavedDir() / ReportPath;
+	}
+	FFileHelper::SaveStringToFile(Json, *ReportPath);
+	UE_LOG(LogTemp, Display, TEXT("Lobby load report written to %s"), *ReportPath);
+}
+
+FString ALobbyGameMode::MakeTravelURL(const FString& MapPath) const
+{
+	return GetNetMode() == NM_DedicatedServer ? MapPath : MapPath + TEXT("?listen");
+}
 
 void ALobbyGameMode::PostLogin(APlayerController* NewPlayer)
 {
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(ALobbyGameMode::PostLogin);
 	Super::PostLogin(NewPlayer);
 
-	int32 NumberOfPlayers = GameState.Get()->PlayerArray.Num();
+	UGameInstance* GameInstance = GetGameInstance();
+	UMultiplayerSessionsSubsystem* Subsystem = GameInstance ? GameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr;
+	if (Subsystem && NewPlayer)
+	{
+		//房主自己的控制器没有经过PreLogin，用它自己的加入ID
+		const FString JoinId = NewPlayer->IsLocalController() ? Subsystem->GetJoinTraceId() :
+			Subsystem->GetRemoteJoinId(NewPlayer->PlayerState ? NewPlayer->PlayerState->GetUniqueId() : FUniqueNetIdRepl());
+		MultiplayerSessionsTrace::Bookmark(TEXT("PostLogin"), JoinId, FString::Printf(TEXT("%d players"), GetNumPlayersInLobby()));
+	}
+
+	++NumLoginsAccepted;
+	LastPostLoginTime = FPlatformTime::Seconds();
+	if (FirstPostLoginTime <= 0.0)
+	{
+		FirstPostLoginTime = LastPostLoginTime;
+	}
+
+	EvaluateFillPolicy();
+}
+
+void ALobbyGameMode::Logout(AController* Exiting)
+{
+	UGameInstance* GameInstance = GetGameInstance();
+	UMultiplayerSessionsSubsystem* Subsystem = GameInstance ? GameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr;
+	if (Subsystem && Exiting && Exiting->PlayerState)
+	{
+		Subsystem->RemoveRemoteJoinId(Exiting->PlayerState->GetUniqueId());
+	}
+	Super::Logout(Exiting);
+	//Logout时离开的玩家还在PlayerArray里，等下一帧再重新判断
+	GetWorldTimerManager().SetTimerForNextTick(this, &ThisClass::EvaluateFillPolicy);
+}
+
+APawn* ALobbyGameMode::SpawnDefaultPawnAtTransform_Implementation(AController* NewPlayer, const FTransform& SpawnTransform)
+{
+	UMultiPlayerGamePawnPoolSubsystem* PawnPool = GetWorld()->GetSubsystem<UMultiPlayerGamePawnPoolSubsystem>();
+	if (PawnPool == nullptr)
+	{
+		return Super::SpawnDefaultPawnAtTransform_Implementation(NewPlayer, SpawnTransform);
+	}
+	return PawnPool->AcquireOrSpawn(GetDefaultPawnClassForController(NewPlayer), SpawnTransform, [&]()
+	{
+		return Super::SpawnDefaultPawnAtTransform_Implementation(NewPlayer, SpawnTransform);
+	});
+}
 
+const FMatchTypeDefinition* ALobbyGameMode::GetMatchTypeDefinition() const
+{
 	UGameInstance* GameInstance = GetGameInstance();
-	if (GameInstance)
+	UMultiplayerSessionsSubsystem* Subsystem = GameInstance ? GameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr;
+	if (Subsystem == nullptr)
 	{
-		UMultiplayerSessionsSubsystem* Subsystem = GameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>();
-		check(Subsystem);
+		return nullptr;
+	}
+	return GetDefault<UMatchTypeSettings>()->FindMatchType(Subsystem->DesiredMatchType);
+}
 
-		if (NumberOfPlayers == Subsystem->DesiredNumPublicConnections)
+int32 ALobbyGameMode::GetNumPlayersInLobby() const
+{
+	int32 NumberOfPlayers = 0;
+	if (GameState)
+	{
+		for (const APlayerState* PlayerState : GameState->PlayerArray)
 		{
-			UWorld* World = GetWorld();
-			if (World)
+			if (PlayerState && !PlayerState->IsPendingKill())
 			{
-				bUseSeamlessTravel = true;
-
-				FString MatchType = Subsystem->DesiredMatchType;
-				if (MatchType == "FreeForAll")
-				{
-					World->ServerTravel(FString("/Game/Maps/BlasterMap?listen"));
-				}
-				else if (MatchType == "Teams")
-				{
-					World->ServerTravel(FString("/Game/Maps/Teams?listen"));
-				}
-				else if (MatchType == "CaptureTheFlag")
-				{
-					World->ServerTravel(FString("/Game/Maps/CaptureTheFlag?listen"));
-				}
+				++NumberOfPlayers;
 			}
 		}
 	}
-}
\ No newline at end of file
+	return NumberOfPlayers;
+}
+
+void ALobbyGameMode::GetPlayerLimits(const FMatchTypeDefinition& Definition, int32& OutMinPlayers, int32& OutMaxPlayers) const
+{
+	//房主设置的人数比模式允许的少时，以房主的为准
+	UGameInstance* GameInstance = GetGameInstance();
+	UMultiplayerSessionsSubsystem* Subsystem = GameInstance ? GameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr;
+	OutMaxPlayers = Subsystem && Subsystem->DesiredNumPublicConnections > 0 ?
+		FMath::Min(Definition.MaxPlayers, Subsystem->DesiredNumPublicConnections) : Definition.MaxPlayers;
+	OutMinPlayers = FMath::Min(Definition.MinPlayers, OutMaxPlayers);
+}
+
+void ALobbyGameMode::EvaluateFillPolicy()
+{
+	if (bMatchStarting)
+	{
+		return;
+	}
+	const FMatchTypeDefinition* Definition = GetMatchTypeDefinition();
+	UGameInstance* GameInstance = GetGameInstance();
+	UMultiplayerSessionsSubsystem* Subsystem = GameInstance ? GameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr;
+	if (Definition == nullptr || Subsystem == nullptr)
+	{
+		return;
+	}
+
+	const int32 NumberOfPlayers = GetNumPlayersInLobby();
+	int32 MinPlayers = 0;
+	int32 MaxPlayers = 0;
+	GetPlayerLimits(*Definition, MinPlayers, MaxPlayers);
+	ALobbyGameState* LobbyGameState = GetGameState<ALobbyGameState>();
+	if (LobbyGameState)
+	{
+		LobbyGameState->SetLobbyStatus(Definition->MatchType, MinPlayers, MaxPlayers);
+	}
+
+	if (NumberOfPlayers >= MaxPlayers)
+	{
+		PreloadMatchMap(*Definition);
+		TravelToMatch(*Definition);
+	}
+	else if (NumberOfPlayers >= MinPlayers)
+	{
+		//人数够了，比赛迟早要开始，趁等人的时候把地图先加载好
+		PreloadMatchMap(*Definition);
+		//已经在倒计时的话不要重置，否则陆续进来的玩家会让大厅一直等下去
+		if (!GetWorldTimerManager().IsTimerActive(FillTimeoutTimer))
+		{
+			const float FillTimeout = FMath::Max(Definition->FillTimeoutSeconds, KINDA_SMALL_NUMBER);
+			GetWorldTimerManager().SetTimer(FillTimeoutTimer, this, &ThisClass::OnFillTimeout, FillTimeout);
+			if (LobbyGameState)
+			{
+				LobbyGameState->SetFillDeadline(LobbyGameState->GetServerWorldTimeSeconds() + FillTimeout);
+			}
+		}
+	}
+	else
+	{
+		GetWorldTimerManager().ClearTimer(FillTimeoutTimer);
+		if (LobbyGameState)
+		{
+			LobbyGameState->SetFillDeadline(0.f);
+		}
+	}
+}
+
+void ALobbyGameMode::PreloadMatchMap(const FMatchTypeDefinition& Definition)
+{
+	UGameInstance* GameInstance = GetGameInstance();
+	UMultiplayerPreloadSubsystem* PreloadSubsystem = GameInstance ? GameInstance->GetSubsystem<UMultiplayerPreloadSubsystem>() : nullptr;
+	if (PreloadSubsystem == nullptr)
+	{
+		return;
+	}
+	//无缝跳转先进过渡地图，再进目标地图，两个都提前加载
+	const FSoftObjectPath& TransitionMap = GetDefault<UGameMapsSettings>()->TransitionMap;
+	if (TransitionMap.IsValid())
+	{
+		PreloadSubsystem->PreloadPackage(TransitionMap.GetLongPackageName());
+	}
+	PreloadSubsystem->PreloadPackage(Definition.Map.GetLongPackageName());
+}
+
+void ALobbyGameMode::OnFillTimeout()
+{
+	const FMatchTypeDefinition* Definition = GetMatchTypeDefinition();
+	if (Definition == nullptr || bMatchStarting)
+	{
+		return;
+	}
+	//和EvaluateFillPolicy用同样的人数限制，否则最少人数比最多人数还大的模式永远等不到开始
+	int32 MinPlayers = 0;
+	int32 MaxPlayers = 0;
+	GetPlayerLimits(*Definition, MinPlayers, MaxPlayers);
+	if (GetNumPlayersInLobby() >= MinPlayers)
+	{
+		TravelToMatch(*Definition);
+	}
+}
@@ -4,8 +4,11 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/GameModeBase.h"
+#include "Engine/EngineBaseTypes.h"
 #include "LobbyGameMode.generated.h"
 
+struct FMatchTypeDefinition;
+
 /**
  * 
  */
@@ -13,5 +16,53 @@ UCLASS()
 class MULTIPLAYERGAME_API ALobbyGameMode : public AGameModeBase
 {
 	GENERATED_BODY()
+public:
+	ALobbyGameMode();
+
+private:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void PreLogin(const FString& Options, const FString& Address, const FUniqueNetIdRepl& UniqueId, FString& ErrorMessage) override;
 	virtual void PostLogin(APlayerController* NewPlayer) override;
+	virtual void Logout(AController* Exiting) override;
+	//玩家的Pawn从池里取，登出时由AMultiPlayerGamePlayerController收回
+	virtual APawn* SpawnDefaultPawnAtTransform_Implementation(AController* NewPlayer, const FTransform& SpawnTransform) override;
+
+	//按比赛模式表里的规则判断大厅是否可以开始：满员立即开始，达到最少人数后等到超时再开始
+	void EvaluateFillPolicy();
+	void OnFillTimeout();
+	//大厅确定了模式并且人数够了就开始异步加载比赛地图，跳转时直接用加载好的包
+	void PreloadMatchMap(const FMatchTypeDefinition& Definition);
+	const FMatchTypeDefinition* GetMatchTypeDefinition() const;
+	//实际生效的最少/最多人数，EvaluateFillPolicy和OnFillTimeout共用
+	void GetPlayerLimits(const FMatchTypeDefinition& Definition, int32& OutMinPlayers, int32& OutMaxPlayers) const;
+	int32 GetNumPlayersInLobby() const;
+	FTimerHandle FillTimeoutTimer;
+	bool bMatchStarting{false};
+
+	//带统计的跳转到比赛地图
+	void TravelToMatch(const FMatchTypeDefinition& Definition);
+	//跳转没发起或者无缝跳转中途失败时撤销TravelToMatch做的事，重新按人数判断
+	void AbortTravelToMatch(const FString& Reason);
+	void OnTravelFailure(UWorld* World, ETravelFailure::Type FailureType, const FString& ErrorString);
+	FTimerHandle TravelRetryTimer;
+	static constexpr float TravelRetryDelaySeconds = 5.f;
+
+	//专用服务器上没有玩家点Host，由大厅自己建房并广播会话
+	void CreateDedicatedServerSession();
+	//listen服务器的地址要带?listen，专用服务器本来就在监听
+	FString MakeTravelURL(const FString& MapPath) const;
+
+	//压测用的大厅统计，命令行带 -LobbyReport=<文件> 时写成json
+	void OnNetworkFailure(UWorld* World, class UNetDriver* NetDriver, ENetworkFailure::Type FailureType, const FString& ErrorString);
+	void WriteLoadReport();
+	int32 NumLoginsAccepted{0};
+	int32 NumLoginsRejected{0};
+	int32 NumNetworkFailures{0};
+	double FirstPostLoginTime{0.0};
+	double LastPostLoginTime{0.0};
+	double ServerTravelTime{0.0};
+	FDelegateHandle NetworkFailureHandle;
+	FDelegateHandle TravelFailureHandle;
+	bool bLoadReportWritten{false};
 };
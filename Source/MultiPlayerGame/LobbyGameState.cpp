@@ -0,0 +1,61 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LobbyGameState.h"
+#include "Net/UnrealNetwork.h"
+#include "Net/Core/PushModel/PushModel.h"
+
+void ALobbyGameState::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	FDoRepLifetimeParams Params;
+	Params.bIsPushBased = true;
+	DOREPLIFETIME_WITH_PARAMS_FAST(ALobbyGameState, MatchType, Params);
+	DOREPLIFETIME_WITH_PARAMS_FAST(ALobbyGameState, MinPlayers, Params);
+	DOREPLIFETIME_WITH_PARAMS_FAST(ALobbyGameState, MaxPlayers, Params);
+	DOREPLIFETIME_WITH_PARAMS_FAST(ALobbyGameState, FillDeadline, Params);
+	DOREPLIFETIME_WITH_PARAMS_FAST(ALobbyGameState, bMatchStarting, Params);
+}
+
+void ALobbyGameState::SetLobbyStatus(const FString& InMatchType, int32 InMinPlayers, int32 InMaxPlayers)
+{
+	if (MatchType != InMatchType)
+	{
+		MatchType = InMatchType;
+		MARK_PROPERTY_DIRTY_FROM_NAME(ALobbyGameState, MatchType, this);
+	}
+	if (MinPlayers != InMinPlayers)
+	{
+		MinPlayers = InMinPlayers;
+		MARK_PROPERTY_DIRTY_FROM_NAME(ALobbyGameState, MinPlayers, this);
+	}
+	if (MaxPlayers != InMaxPlayers)
+	{
+		MaxPlayers = InMaxPlayers;
+		MARK_PROPERTY_DIRTY_FROM_NAME(ALobbyGameState, MaxPlayers, this);
+	}
+}
+
+void ALobbyGameState::SetFillDeadline(float InServerTime)
+{
+	if (FillDeadline != InServerTime)
+	{
+		FillDeadline = InServerTime;
+		MARK_PROPERTY_DIRTY_FROM_NAME(ALobbyGameState, FillDeadline, this);
+	}
+}
+
+void ALobbyGameState::SetMatchStarting(bool bInMatchStarting)
+{
+	if (bMatchStarting != bInMatchStarting)
+	{
+		bMatchStarting = bInMatchStarting;
+		MARK_PROPERTY_DIRTY_FROM_NAME(ALobbyGameState, bMatchStarting, this);
+	}
+}
+
+float ALobbyGameState::GetFillSecondsRemaining() const
+{
+	return FillDeadline > 0.f ? FMath::Max(0.f, FillDeadline - GetServerWorldTimeSeconds()) : -1.f;
+}
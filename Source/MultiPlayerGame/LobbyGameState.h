@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/GameStateBase.h"
+#include "LobbyGameState.generated.h"
+
+/**
+ * 大厅的状态：比赛模式、人数限制和满员倒计时，复制给客户端显示。
+ * 这些值只在有人进出或者倒计时开始/取消时才变，用推送模式复制，没有标脏的帧不做属性比较。
+ */
+UCLASS()
+class MULTIPLAYERGAME_API ALobbyGameState : public AGameStateBase
+{
+	GENERATED_BODY()
+
+public:
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	//服务器：值和当前一样时不标脏
+	void SetLobbyStatus(const FString& InMatchType, int32 InMinPlayers, int32 InMaxPlayers);
+	//倒计时结束的服务器时间，取消倒计时传0
+	void SetFillDeadline(float InServerTime);
+	//跳转失败时传false，大厅回到等人的状态
+	void SetMatchStarting(bool bInMatchStarting = true);
+
+	const FString& GetMatchType() const { return MatchType; }
+	int32 GetMinPlayers() const { return MinPlayers; }
+	int32 GetMaxPlayers() const { return MaxPlayers; }
+	bool IsMatchStarting() const { return bMatchStarting; }
+	//倒计时还剩多少秒，没有在倒计时返回-1
+	float GetFillSecondsRemaining() const;
+
+private:
+	UPROPERTY(Replicated)
+	FString MatchType;
+
+	UPROPERTY(Replicated)
+	int32 MinPlayers = 0;
+
+	UPROPERTY(Replicated)
+	int32 MaxPlayers = 0;
+
+	UPROPERTY(Replicated)
+	float FillDeadline = 0.f;
+
+	UPROPERTY(Replicated)
+	bool bMatchStarting = false;
+};
@@ -0,0 +1,12 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MatchTypeSettings.h"
+
+const FMatchTypeDefinition* UMatchTypeSettings::FindMatchType(const FString& MatchType) const
+{
+	return MatchTypes.FindByPredicate([&MatchType](const FMatchTypeDefinition& Definition)
+	{
+		return Definition.MatchType == MatchType;
+	});
+}
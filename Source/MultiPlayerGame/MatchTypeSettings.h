@@ -0,0 +1,55 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DeveloperSettings.h"
+#include "MatchTypeSettings.generated.h"
+
+/**
+ * 一种比赛模式：去哪张地图、多少人能开、人不满时等多久、开始后能不能补位
+ */
+USTRUCT()
+struct FMatchTypeDefinition
+{
+	GENERATED_BODY()
+
+	//和建房时写进会话的MatchType一致
+	UPROPERTY(EditAnywhere, Category = "Match")
+	FString MatchType;
+
+	UPROPERTY(EditAnywhere, Category = "Match", meta = (AllowedClasses = "World"))
+	FSoftObjectPath Map;
+
+	//达到这个人数后开始倒计时
+	UPROPERTY(EditAnywhere, Category = "Lobby", meta = (ClampMin = "1"))
+	int32 MinPlayers{2};
+
+	//达到这个人数（或者房主设置的人数，取较小的）立即开始
+	UPROPERTY(EditAnywhere, Category = "Lobby", meta = (ClampMin = "1"))
+	int32 MaxPlayers{4};
+
+	//人数达到MinPlayers后最多再等多少秒
+	UPROPERTY(EditAnywhere, Category = "Lobby", meta = (ClampMin = "0"))
+	float FillTimeoutSeconds{30.f};
+
+	//比赛开始后会话是否继续接受中途加入来补满空位
+	UPROPERTY(EditAnywhere, Category = "Lobby")
+	bool bAllowBackfill{true};
+};
+
+/**
+ * 比赛模式表，在DefaultGame.ini里配置，大厅按这里的规则决定什么时候开始、去哪张地图
+ */
+UCLASS(config = Game, defaultconfig, meta = (DisplayName = "Match Types"))
+class MULTIPLAYERGAME_API UMatchTypeSettings : public UDeveloperSettings
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(Config, EditAnywhere, Category = "Match")
+	TArray<FMatchTypeDefinition> MatchTypes;
+
+	//找不到时返回nullptr
+	const FMatchTypeDefinition* FindMatchType(const FString& MatchType) const;
+};
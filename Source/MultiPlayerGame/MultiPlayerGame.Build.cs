@@ -6,7 +6,7 @@ public class MultiPlayerGame : ModuleRules
 {
 	public MultiPlayerGame(ReadOnlyTargetRules Target) : base(Target)
 	{
-		PrivateDependencyModuleNames.AddRange(new string[] { "MultuplayerSessions" });
+		PrivateDependencyModuleNames.AddRange(new string[] { "MultuplayerSessions", "Json", "DeveloperSettings", "EngineSettings", "ReplicationGraph", "NetCore", "SignificanceManager", "AnimationBudgetAllocator", "RenderCore", "RHI" });
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
 		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay" ,"OnlineSubsystemSteam","OnlineSubsystem","UMG"});
@@ -0,0 +1,45 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultiPlayerGameAnimInstance.h"
+#include "MultiPlayerGameStats.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+
+void FMultiPlayerGameAnimInstanceProxy::PreUpdate(UAnimInstance* InAnimInstance, float DeltaSeconds)
+{
+	SCOPE_CYCLE_COUNTER(STAT_MPG_AnimPreUpdate);
+	FAnimInstanceProxy::PreUpdate(InAnimInstance, DeltaSeconds);
+
+	// 游戏线程上只做拷贝
+	const APawn* Pawn = InAnimInstance->TryGetPawnOwner();
+	if (Pawn == nullptr)
+	{
+		Velocity = FVector::ZeroVector;
+		bIsFalling = false;
+		return;
+	}
+	Velocity = Pawn->GetVelocity();
+	ActorRotation = Pawn->GetActorRotation();
+	const ACharacter* Character = Cast<ACharacter>(Pawn);
+	bIsFalling = Character && Character->GetCharacterMovement() && Character->GetCharacterMovement()->IsFalling();
+}
+
+void FMultiPlayerGameAnimInstanceProxy::Update(float DeltaSeconds)
+{
+	SCOPE_CYCLE_COUNTER(STAT_MPG_AnimProxyUpdate);
+	FAnimInstanceProxy::Update(DeltaSeconds);
+
+	// 工作线程上计算，动画图在同一线程里紧接着读取这些值
+	UMultiPlayerGameAnimInstance* AnimInstance = CastChecked<UMultiPlayerGameAnimInstance>(GetAnimInstanceObject());
+	const FVector HorizontalVelocity(Velocity.X, Velocity.Y, 0.f);
+	AnimInstance->Speed = HorizontalVelocity.Size();
+	AnimInstance->bIsInAir = bIsFalling;
+	AnimInstance->Direction = HorizontalVelocity.IsNearlyZero()
+		? 0.f
+		: FRotator::NormalizeAxis(HorizontalVelocity.Rotation().Yaw - ActorRotation.Yaw);
+}
+
+FAnimInstanceProxy* UMultiPlayerGameAnimInstance::CreateAnimInstanceProxy()
+{
+	return new FMultiPlayerGameAnimInstanceProxy(this);
+}
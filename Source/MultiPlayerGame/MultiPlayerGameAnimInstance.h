@@ -0,0 +1,59 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Animation/AnimInstance.h"
+#include "Animation/AnimInstanceProxy.h"
+#include "MultiPlayerGameAnimInstance.generated.h"
+
+/**
+ * 动画代理：PreUpdate在游戏线程上只拷贝角色的速度、朝向、是否在空中，
+ * Update在动画工作线程上算出动画图要用的变量，游戏线程上不再跑蓝图的事件图表
+ */
+USTRUCT()
+struct MULTIPLAYERGAME_API FMultiPlayerGameAnimInstanceProxy : public FAnimInstanceProxy
+{
+	GENERATED_BODY()
+
+	FMultiPlayerGameAnimInstanceProxy() = default;
+	FMultiPlayerGameAnimInstanceProxy(UAnimInstance* InAnimInstance)
+		: FAnimInstanceProxy(InAnimInstance)
+	{
+	}
+
+protected:
+	virtual void PreUpdate(UAnimInstance* InAnimInstance, float DeltaSeconds) override;
+	virtual void Update(float DeltaSeconds) override;
+
+private:
+	FVector Velocity = FVector::ZeroVector;
+	FRotator ActorRotation = FRotator::ZeroRotator;
+	bool bIsFalling = false;
+};
+
+/**
+ * 人物的原生动画实例，ThirdPerson_AnimBP 以它为父类：
+ * 动画图直接绑定 Speed、bIsInAir、Direction 这几个成员（走快速路径），删掉事件图表，
+ * 再勾选 Use Multi Threaded Animation Update，整个更新就都在工作线程上了
+ */
+UCLASS(Transient, Blueprintable)
+class MULTIPLAYERGAME_API UMultiPlayerGameAnimInstance : public UAnimInstance
+{
+	GENERATED_BODY()
+
+public:
+	//水平速度
+	UPROPERTY(BlueprintReadOnly, Category = Movement)
+	float Speed = 0.f;
+
+	UPROPERTY(BlueprintReadOnly, Category = Movement)
+	bool bIsInAir = false;
+
+	//速度方向相对角色朝向的角度，-180到180
+	UPROPERTY(BlueprintReadOnly, Category = Movement)
+	float Direction = 0.f;
+
+protected:
+	virtual FAnimInstanceProxy* CreateAnimInstanceProxy() override;
+};
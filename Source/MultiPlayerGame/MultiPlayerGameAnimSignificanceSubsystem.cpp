@@ -0,0 +1,185 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultiPlayerGameAnimSignificanceSubsystem.h"
+#include "MultiPlayerGameCharacter.h"
+#include "MultiPlayerGameStats.h"
+#include "SignificanceManager.h"
+#include "IAnimationBudgetAllocator.h"
+#include "SkeletalMeshComponentBudgeted.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+
+namespace MultiPlayerGameAnimSignificance
+{
+	static const FName CharacterTag(TEXT("MultiPlayerGameCharacter"));
+}
+
+bool UMultiPlayerGameAnimSignificanceSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	// 专用服务器不渲染，动画降级由服务器自己的设置决定
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld() && !IsRunningDedicatedServer() && Super::ShouldCreateSubsystem(Outer);
+}
+
+void UMultiPlayerGameAnimSignificanceSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	IAnimationBudgetAllocator* Allocator = IAnimationBudgetAllocator::Get(GetWorld());
+	if (Allocator == nullptr)
+	{
+		return;
+	}
+	Allocator->SetEnabled(bEnableAnimationBudget);
+	if (bEnableAnimationBudget)
+	{
+		FAnimationBudgetAllocatorParameters Parameters;
+		Parameters.BudgetInMs = AnimationBudgetMs;
+		Allocator->SetParameters(Parameters);
+	}
+}
+
+bool UMultiPlayerGameAnimSignificanceSubsystem::IsTickable() const
+{
+	return !IsTemplate() && GetWorld() != nullptr;
+}
+
+TStatId UMultiPlayerGameAnimSignificanceSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMultiPlayerGameAnimSignificanceSubsystem, STATGROUP_Tickables);
+}
+
+void UMultiPlayerGameAnimSignificanceSubsystem::RegisterCharacter(AMultiPlayerGameCharacter* Character)
+{
+	USignificanceManager* SignificanceManager = USignificanceManager::Get(GetWorld());
+	if (SignificanceManager == nullptr || Character == nullptr)
+	{
+		return;
+	}
+
+	// 重要度函数会在多个线程上并行调用，只能读数据；结果在游戏线程上按顺序应用
+	SignificanceManager->RegisterObject(
+		Character,
+		MultiPlayerGameAnimSignificance::CharacterTag,
+		[this](USignificanceManager::FManagedObjectInfo* ObjectInfo, const FTransform& Viewpoint)
+		{
+			return CalculateSignificance(CastChecked<AMultiPlayerGameCharacter>(ObjectInfo->GetObject()), Viewpoint);
+		},
+		USignificanceManager::EPostSignificanceType::Sequential,
+		[this](USignificanceManager::FManagedObjectInfo* ObjectInfo, float OldSignificance, float Significance, bool bFinal)
+		{
+			ApplySignificance(CastChecked<AMultiPlayerGameCharacter>(ObjectInfo->GetObject()), Significance);
+		});
+}
+
+void UMultiPlayerGameAnimSignificanceSubsystem::UnregisterCharacter(AMultiPlayerGameCharacter* Character)
+{
+	if (USignificanceManager* SignificanceManager = USignificanceManager::Get(GetWorld()))
+	{
+		SignificanceManager->UnregisterObject(Character);
+	}
+}
+
+void UMultiPlayerGameAnimSignificanceSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_MPG_AnimSignificance);
+	CSV_SCOPED_TIMING_STAT(MultiPlayerGame, AnimSignificance);
+
+	USignificanceManager* SignificanceManager = USignificanceManager::Get(GetWorld());
+	if (SignificanceManager == nullptr)
+	{
+		return;
+	}
+
+	// 分屏时有多个本地玩家，重要度取所有视点里最大的
+	Viewpoints.Reset();
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		APlayerController* PC = It->Get();
+		if (PC && PC->IsLocalController())
+		{
+			FVector ViewLocation;
+			FRotator ViewRotation;
+			PC->GetPlayerViewPoint(ViewLocation, ViewRotation);
+			Viewpoints.Emplace(ViewRotation, ViewLocation);
+		}
+	}
+	if (Viewpoints.Num() == 0)
+	{
+		return;
+	}
+
+	FMemory::Memzero(NumCharactersPerTier);
+	SignificanceManager->Update(Viewpoints);
+
+	SET_DWORD_STAT(STAT_MPG_AnimHighCharacters, NumCharactersPerTier[static_cast<int32>(ETier::High)]);
+	SET_DWORD_STAT(STAT_MPG_AnimOffCharacters, NumCharactersPerTier[static_cast<int32>(ETier::Off)]);
+	CSV_CUSTOM_STAT(MultiPlayerGame, AnimHighCharacters, NumCharactersPerTier[static_cast<int32>(ETier::High)], ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(MultiPlayerGame, AnimOffCharacters, NumCharactersPerTier[static_cast<int32>(ETier::Off)], ECsvCustomStatOp::Set);
+}
+
+float UMultiPlayerGameAnimSignificanceSubsystem::CalculateSignificance(const AMultiPlayerGameCharacter* Character, const FTransform& Viewpoint) const
+{
+	// 自己控制的角色始终最重要；单机和服务器上AI控制的角色也算本地控制，不能算进来
+	if (Character->IsLocallyPlayerControlled())
+	{
+		return 1.f;
+	}
+
+	const float Distance = FVector::Dist(Character->GetActorLocation(), Viewpoint.GetLocation());
+	float Significance = 1.f - FMath::Clamp(Distance / MaxSignificanceDistance, 0.f, 1.f);
+	if (!Character->WasRecentlyRendered(0.2f))
+	{
+		Significance *= NotRenderedScale;
+	}
+	return Significance;
+}
+
+UMultiPlayerGameAnimSignificanceSubsystem::ETier UMultiPlayerGameAnimSignificanceSubsystem::GetTier(float Significance) const
+{
+	if (Significance > HighSignificance)
+	{
+		return ETier::High;
+	}
+	if (Significance > MediumSignificance)
+	{
+		return ETier::Medium;
+	}
+	return Significance > 0.f ? ETier::Low : ETier::Off;
+}
+
+void UMultiPlayerGameAnimSignificanceSubsystem::ApplySignificance(AMultiPlayerGameCharacter* Character, float Significance)
+{
+	const ETier Tier = GetTier(Significance);
+	++NumCharactersPerTier[static_cast<int32>(Tier)];
+
+	const bool bLocal = Character->IsLocallyPlayerControlled();
+	const float TickIntervals[] = { 0.f, MediumTickInterval, LowTickInterval, OffTickInterval };
+	const float TickInterval = TickIntervals[static_cast<int32>(Tier)];
+	Character->SetActorTickInterval(TickInterval);
+
+	USkeletalMeshComponent* Mesh = Character->GetMesh();
+	if (Mesh == nullptr)
+	{
+		return;
+	}
+	// 看不见的远端角色只更新蒙太奇（通知不丢），不计算骨骼
+	Mesh->VisibilityBasedAnimTickOption = bLocal
+		? EVisibilityBasedAnimTickOption::AlwaysTickPose
+		: (Tier == ETier::High ? EVisibilityBasedAnimTickOption::OnlyTickPoseWhenRendered : EVisibilityBasedAnimTickOption::OnlyTickMontagesWhenNotRendered);
+
+	IAnimationBudgetAllocator* Allocator = IAnimationBudgetAllocator::Get(GetWorld());
+	USkeletalMeshComponentBudgeted* BudgetedMesh = Cast<USkeletalMeshComponentBudgeted>(Mesh);
+	if (Allocator && Allocator->GetEnabled() && BudgetedMesh)
+	{
+		// 预算分配器接管网格体的Tick频率和插值，这里只给它重要度
+		Allocator->SetComponentSignificance(BudgetedMesh, Significance, bLocal);
+		Allocator->SetComponentTickEnabled(BudgetedMesh, bLocal || Tier != ETier::Off);
+		return;
+	}
+
+	// 没开预算时用引擎自带的URO和Tick间隔
+	Mesh->bEnableUpdateRateOptimizations = !bLocal;
+	Mesh->SetComponentTickInterval(TickInterval);
+	Mesh->SetComponentTickEnabled(bLocal || Tier != ETier::Off);
+}
@@ -0,0 +1,84 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "MultiPlayerGameAnimSignificanceSubsystem.generated.h"
+
+class AMultiPlayerGameCharacter;
+
+/**
+ * 客户端上按重要度给角色的动画和Tick降级：
+ * 角色在BeginPlay时注册到 USignificanceManager，每帧用本地玩家的视点更新，重要度由距离和最近是否被渲染决定；
+ * 重要度分成几档，分别设置角色Tick间隔、动画在不可见时是否更新、网格体Tick是否开启；
+ * 骨骼网格体是 USkeletalMeshComponentBudgeted，重要度同时交给动画预算分配器，
+ * 它在 AnimationBudgetMs 内按重要度分配更新频率，人再多游戏线程上动画的耗时也基本不变。
+ * 专用服务器上不创建。
+ */
+UCLASS(config = Game)
+class MULTIPLAYERGAME_API UMultiPlayerGameAnimSignificanceSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+	//FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+
+	void RegisterCharacter(AMultiPlayerGameCharacter* Character);
+	void UnregisterCharacter(AMultiPlayerGameCharacter* Character);
+
+	//每帧所有角色动画的预算（毫秒），交给动画预算分配器
+	UPROPERTY(Config)
+	bool bEnableAnimationBudget = true;
+
+	UPROPERTY(Config)
+	float AnimationBudgetMs = 1.5f;
+
+	//超过这个距离重要度为0
+	UPROPERTY(Config)
+	float MaxSignificanceDistance = 8000.f;
+
+	//最近没有被渲染时的系数
+	UPROPERTY(Config)
+	float NotRenderedScale = 0.25f;
+
+	//重要度高于HighSignificance为第一档，高于MediumSignificance为第二档，大于0为第三档，0为第四档
+	UPROPERTY(Config)
+	float HighSignificance = 0.66f;
+
+	UPROPERTY(Config)
+	float MediumSignificance = 0.33f;
+
+	//第二、三、四档的角色Tick间隔（秒），第一档每帧Tick
+	UPROPERTY(Config)
+	float MediumTickInterval = 1.f / 30.f;
+
+	UPROPERTY(Config)
+	float LowTickInterval = 0.1f;
+
+	UPROPERTY(Config)
+	float OffTickInterval = 0.25f;
+
+private:
+	enum class ETier : uint8
+	{
+		High,
+		Medium,
+		Low,
+		Off,
+	};
+
+	float CalculateSignificance(const AMultiPlayerGameCharacter* Character, const FTransform& Viewpoint) const;
+	void ApplySignificance(AMultiPlayerGameCharacter* Character, float Significance);
+	ETier GetTier(float Significance) const;
+
+	TArray<FTransform> Viewpoints;
+	int32 NumCharactersPerTier[4] = {};
+};
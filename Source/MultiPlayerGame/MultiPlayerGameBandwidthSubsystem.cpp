@@ -0,0 +1,330 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultiPlayerGameBandwidthSubsystem.h"
+#include "MultiPlayerGameCharacter.h"
+#include "MultiPlayerGameMovementComponent.h"
+#include "MultiPlayerGameReplicationGraph.h"
+#include "MultiPlayerGameStats.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/PlayerController.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonWriter.h"
+#include "Serialization/JsonSerializer.h"
+#include "Net/Core/PushModel/PushModel.h"
+#include "Net/NetworkProfiler.h"
+#include "Engine/Engine.h"
+
+bool UMultiPlayerGameBandwidthSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld() && Super::ShouldCreateSubsystem(Outer);
+}
+
+void UMultiPlayerGameBandwidthSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	//服务器：MultiPlayerGameServer -BandwidthGate=60 [-BandwidthClients=16] [-BandwidthReport=Bandwidth.json] [-BandwidthRecordBaseline] [-BandwidthNetProfile]
+	//客户端：MultiPlayerGame -nullrhi -AutoJoin -AutoMove，或者 MultiPlayerGame 127.0.0.1:7777 -nullrhi -AutoMove 直连
+	FParse::Value(FCommandLine::Get(), TEXT("BandwidthGate="), GateSeconds);
+	FParse::Value(FCommandLine::Get(), TEXT("BandwidthClients="), GateConnections);
+	bAutoMove = FParse::Param(FCommandLine::Get(), TEXT("AutoMove"));
+	bRecordBaseline = FParse::Param(FCommandLine::Get(), TEXT("BandwidthRecordBaseline"));
+	bNetProfile = FParse::Param(FCommandLine::Get(), TEXT("BandwidthNetProfile"));
+	LastReceivedMoveBits = UMultiPlayerGameMovementComponent::GetTotalReceivedMoveBits();
+	LastSampleTime = FPlatformTime::Seconds();
+
+	// 网络驱动的TickFlush（ServerReplicateActors就在里面）在所有Actor Tick完之后，复制图开不开都量这一段，两边可以直接比
+	PostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddUObject(this, &ThisClass::OnWorldPostActorTick);
+	PostTickFlushHandle = GetWorld()->OnPostTickFlush().AddUObject(this, &ThisClass::OnPostTickFlush);
+}
+
+void UMultiPlayerGameBandwidthSubsystem::Deinitialize()
+{
+	FWorldDelegates::OnWorldPostActorTick.Remove(PostActorTickHandle);
+	if (UWorld* World = GetWorld())
+	{
+		World->OnPostTickFlush().Remove(PostTickFlushHandle);
+	}
+	SetNetProfileEnabled(false);
+	Super::Deinitialize();
+}
+
+void UMultiPlayerGameBandwidthSubsystem::OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+{
+	if (World == GetWorld())
+	{
+		PostActorTickTime = FPlatformTime::Seconds();
+	}
+}
+
+void UMultiPlayerGameBandwidthSubsystem::OnPostTickFlush(float DeltaSeconds)
+{
+	const UNetDriver* NetDriver = GetWorld()->GetNetDriver();
+	if (PostActorTickTime <= 0.0 || NetDriver == nullptr || NetDriver->ClientConnections.Num() == 0)
+	{
+		PostActorTickTime = 0.0;
+		return;
+	}
+	NetFlushSeconds += FPlatformTime::Seconds() - PostActorTickTime;
+	++NetFlushFrames;
+	PostActorTickTime = 0.0;
+}
+
+bool UMultiPlayerGameBandwidthSubsystem::IsTickable() const
+{
+	return !IsTemplate() && GetWorld() != nullptr;
+}
+
+TStatId UMultiPlayerGameBandwidthSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMultiPlayerGameBandwidthSubsystem, STATGROUP_Tickables);
+}
+
+void UMultiPlayerGameBandwidthSubsystem::Tick(float DeltaTime)
+{
+	const ENetMode NetMode = GetWorld()->GetNetMode();
+	if (NetMode == NM_DedicatedServer || NetMode == NM_ListenServer)
+	{
+		TickServer(DeltaTime);
+	}
+	if (bAutoMove && NetMode != NM_DedicatedServer)
+	{
+		TickAutoMove(DeltaTime);
+	}
+}
+
+void UMultiPlayerGameBandwidthSubsystem::TickServer(float DeltaTime)
+{
+	TimeUntilSample -= DeltaTime;
+	if (TimeUntilSample > 0.f)
+	{
+		return;
+	}
+	TimeUntilSample = SampleInterval;
+	TakeSample();
+}
+
+void UMultiPlayerGameBandwidthSubsystem::TakeSample()
+{
+	UNetDriver* NetDriver = GetWorld()->GetNetDriver();
+	const int64 ReceivedMoveBits = UMultiPlayerGameMovementComponent::GetTotalReceivedMoveBits();
+	const int64 MoveBitsDelta = ReceivedMoveBits - LastReceivedMoveBits;
+	LastReceivedMoveBits = ReceivedMoveBits;
+	const double Now = FPlatformTime::Seconds();
+	const double ElapsedSeconds = Now - LastSampleTime;
+	LastSampleTime = Now;
+	const float NetFlushMs = NetFlushFrames > 0 ? static_cast<float>(NetFlushSeconds * 1000.0 / NetFlushFrames) : 0.f;
+	NetFlushSeconds = 0.0;
+	NetFlushFrames = 0;
+	if (NetDriver == nullptr || NetDriver->ClientConnections.Num() == 0)
+	{
+		return;
+	}
+
+	// 连接上的每秒字节数由引擎每个统计周期（默认1秒）更新一次
+	FBandwidthSample Sample;
+	float TotalOutBytes = 0.f;
+	float TotalInBytes = 0.f;
+	for (const UNetConnection* Connection : NetDriver->ClientConnections)
+	{
+		TotalOutBytes += Connection->OutBytesPerSecond;
+		TotalInBytes += Connection->InBytesPerSecond;
+		Sample.MaxOutBytesPerConnection = FMath::Max(Sample.MaxOutBytesPerConnection, static_cast<float>(Connection->OutBytesPerSecond));
+	}
+
+	int32 NumCharacters = 0;
+	for (const AMultiPlayerGameCharacter* Character : TActorRange<AMultiPlayerGameCharacter>(GetWorld()))
+	{
+		// 池里隐藏的角色不复制
+		NumCharacters += Character->IsHidden() ? 0 : 1;
+	}
+
+	const int32 NumConnections = NetDriver->ClientConnections.Num();
+	Sample.OutBytesPerCharacter = NumCharacters > 0 ? TotalOutBytes / (NumConnections * NumCharacters) : 0.f;
+	Sample.InBytesPerConnection = TotalInBytes / NumConnections;
+	// 每个连接控制一个角色
+	Sample.MoveRPCBytesPerCharacter = ElapsedSeconds > 0.0 ? static_cast<float>(MoveBitsDelta / 8.0 / ElapsedSeconds / NumConnections) : 0.f;
+	Sample.NetFlushMs = NetFlushMs;
+
+	SET_FLOAT_STAT(STAT_MPG_OutBytesPerCharacter, Sample.OutBytesPerCharacter);
+	SET_FLOAT_STAT(STAT_MPG_InBytesPerConnection, Sample.InBytesPerConnection);
+	SET_FLOAT_STAT(STAT_MPG_MoveRPCBytesPerCharacter, Sample.MoveRPCBytesPerCharacter);
+	SET_FLOAT_STAT(STAT_MPG_ServerNetFlushMs, Sample.NetFlushMs);
+	CSV_CUSTOM_STAT(MultiPlayerGame, OutBytesPerCharacter, Sample.OutBytesPerCharacter, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(MultiPlayerGame, InBytesPerConnection, Sample.InBytesPerConnection, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(MultiPlayerGame, MoveRPCBytesPerCharacter, Sample.MoveRPCBytesPerCharacter, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(MultiPlayerGame, MaxOutBytesPerConnection, Sample.MaxOutBytesPerConnection, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(MultiPlayerGame, ServerNetFlushMs, Sample.NetFlushMs, ECsvCustomStatOp::Set);
+
+	if (GateSeconds <= 0.f || bGateFinished)
+	{
+		return;
+	}
+	if (NumConnections < GateConnections)
+	{
+		// 客户端还没到齐，预热从到齐那一刻算起
+		FirstConnectionTime = -1.0;
+		Samples.Reset();
+		GateSampledSeconds = 0.0;
+		SetNetProfileEnabled(false);
+		return;
+	}
+	if (FirstConnectionTime < 0.0)
+	{
+		FirstConnectionTime = Now;
+	}
+	if (Now - FirstConnectionTime < WarmupSeconds)
+	{
+		return;
+	}
+	if (Samples.Num() == 0)
+	{
+		// 预热结束，netprofile从这里录到检查结束
+		SetNetProfileEnabled(bNetProfile);
+	}
+	Samples.Add(Sample);
+	GateSampledSeconds += ElapsedSeconds;
+	if (GateSampledSeconds >= GateSeconds)
+	{
+		FinishGate();
+	}
+}
+
+void UMultiPlayerGameBandwidthSubsystem::FinishGate()
+{
+	bGateFinished = true;
+	SetNetProfileEnabled(false);
+
+	FBandwidthSample Average;
+	for (const FBandwidthSample& Sample : Samples)
+	{
+		Average.OutBytesPerCharacter += Sample.OutBytesPerCharacter / Samples.Num();
+		Average.InBytesPerConnection += Sample.InBytesPerConnection / Samples.Num();
+		Average.MoveRPCBytesPerCharacter += Sample.MoveRPCBytesPerCharacter / Samples.Num();
+		Average.MaxOutBytesPerConnection = FMath::Max(Average.MaxOutBytesPerConnection, Sample.MaxOutBytesPerConnection);
+		Average.NetFlushMs += Sample.NetFlushMs / Samples.Num();
+	}
+
+	const float Limit = 1.f + AllowedRegression;
+	const bool bBaselineRecorded = BaselineOutBytesPerCharacter > 0.f && BaselineInBytesPerConnection > 0.f && BaselineMoveRPCBytesPerCharacter > 0.f;
+	const bool bOutOk = Average.OutBytesPerCharacter <= BaselineOutBytesPerCharacter * Limit;
+	const bool bInOk = Average.InBytesPerConnection <= BaselineInBytesPerConnection * Limit;
+	const bool bMoveOk = Average.MoveRPCBytesPerCharacter <= BaselineMoveRPCBytesPerCharacter * Limit;
+	const bool bCompared = bBaselineRecorded && !bRecordBaseline;
+	const bool bPassed = bCompared && bOutOk && bInOk && bMoveOk;
+
+	TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+	Report->SetStringField(TEXT("map"), GetWorld()->GetMapName());
+	Report->SetNumberField(TEXT("connections"), GetWorld()->GetNetDriver() ? GetWorld()->GetNetDriver()->ClientConnections.Num() : 0);
+	Report->SetNumberField(TEXT("samples"), Samples.Num());
+	Report->SetNumberField(TEXT("sampled_seconds"), GateSampledSeconds);
+	Report->SetNumberField(TEXT("out_bytes_per_character"), Average.OutBytesPerCharacter);
+	Report->SetNumberField(TEXT("in_bytes_per_connection"), Average.InBytesPerConnection);
+	Report->SetNumberField(TEXT("move_rpc_bytes_per_character"), Average.MoveRPCBytesPerCharacter);
+	Report->SetNumberField(TEXT("max_out_bytes_per_connection"), Average.MaxOutBytesPerConnection);
+	Report->SetNumberField(TEXT("server_net_flush_ms"), Average.NetFlushMs);
+
+	// 记下复制图和推送模式是否真的开着，脚本靠它确认命令行开关生效了
+	const UNetDriver* NetDriver = GetWorld()->GetNetDriver();
+	const UMultiPlayerGameReplicationGraph* RepGraph = NetDriver ? Cast<UMultiPlayerGameReplicationGraph>(NetDriver->GetReplicationDriver()) : nullptr;
+	Report->SetBoolField(TEXT("replication_graph"), RepGraph != nullptr);
+	Report->SetBoolField(TEXT("push_model"), IS_PUSH_MODEL_ENABLED());
+	if (RepGraph)
+	{
+		Report->SetNumberField(TEXT("server_replicate_actors_avg_ms"), RepGraph->GetAverageServerReplicateActorsMs());
+	}
+	Report->SetNumberField(TEXT("baseline_out_bytes_per_character"), BaselineOutBytesPerCharacter);
+	Report->SetNumberField(TEXT("baseline_in_bytes_per_connection"), BaselineInBytesPerConnection);
+	Report->SetNumberField(TEXT("baseline_move_rpc_bytes_per_character"), BaselineMoveRPCBytesPerCharacter);
+	Report->SetNumberField(TEXT("allowed_regression"), AllowedRegression);
+	Report->SetBoolField(TEXT("baseline_recorded"), bBaselineRecorded);
+	Report->SetBoolField(TEXT("record_baseline"), bRecordBaseline);
+	Report->SetBoolField(TEXT("passed"), bPassed);
+	if (bNetProfile)
+	{
+		Report->SetStringField(TEXT("netprofile_dir"), FPaths::ConvertRelativePathToFull(FPaths::ProfilingDir()));
+	}
+
+	FString ReportPath = TEXT("BandwidthReport.json");
+	FParse::Value(FCommandLine::Get(), TEXT("BandwidthReport="), ReportPath);
+	if (FPaths::IsRelative(ReportPath))
+	{
+		ReportPath = FPaths::ProjectSavedDir() / ReportPath;
+	}
+	FString Json;
+	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(Report, Writer);
+	FFileHelper::SaveStringToFile(Json, *ReportPath);
+
+	if (!bCompared)
+	{
+		// 没有基线时不能算通过，CI里要能看出来是没比较而不是没回归
+		UE_LOG(LogTemp, Warning, TEXT("Bandwidth gate %s: out %.0f B/char/s, in %.0f B/conn/s, move %.0f B/char/s (report %s)"),
+			bRecordBaseline ? TEXT("recorded baseline") : TEXT("baseline not recorded, nothing compared"),
+			Average.OutBytesPerCharacter, Average.InBytesPerConnection, Average.MoveRPCBytesPerCharacter, *ReportPath);
+		FPlatformMisc::RequestExitWithStatus(false, bRecordBaseline ? 0 : 2);
+		return;
+	}
+	if (bPassed)
+	{
+		UE_LOG(LogTemp, Display, TEXT("Bandwidth gate passed: out %.0f B/char/s, in %.0f B/conn/s, move %.0f B/char/s (report %s)"),
+			Average.OutBytesPerCharacter, Average.InBytesPerConnection, Average.MoveRPCBytesPerCharacter, *ReportPath);
+	}
+	else
+	{
+		UE_LOG(LogTemp, Error, TEXT("Bandwidth gate FAILED: out %.0f/%.0f B/char/s, in %.0f/%.0f B/conn/s, move %.0f/%.0f B/char/s (report %s)"),
+			Average.OutBytesPerCharacter, BaselineOutBytesPerCharacter * Limit,
+			Average.InBytesPerConnection, BaselineInBytesPerConnection * Limit,
+			Average.MoveRPCBytesPerCharacter, BaselineMoveRPCBytesPerCharacter * Limit,
+			*ReportPath);
+	}
+	FPlatformMisc::RequestExitWithStatus(false, bPassed ? 0 : 1);
+}
+
+void UMultiPlayerGameBandwidthSubsystem::SetNetProfileEnabled(bool bEnabled)
+{
+#if USE_NETWORK_PROFILER
+	if (bNetProfileRunning == bEnabled || GEngine == nullptr)
+	{
+		return;
+	}
+	// 关掉时引擎把.nprof写到Saved/Profiling，里面有每个Actor类、每个属性和RPC的字节数
+	bNetProfileRunning = bEnabled;
+	GEngine->Exec(GetWorld(), bEnabled ? TEXT("netprofile enable") : TEXT("netprofile disable"));
+#endif
+}
+
+void UMultiPlayerGameBandwidthSubsystem::TickAutoMove(float DeltaTime)
+{
+	// 固定脚本：匀速转向绕圈，定时跳一下，每次跑出来的移动RPC都差不多
+	const float PreviousTime = AutoMoveTime;
+	AutoMoveTime += DeltaTime;
+	const FVector Direction = FRotator(0.f, AutoMoveTime * AutoMoveTurnRate, 0.f).Vector();
+	const bool bJump = AutoMoveJumpInterval > 0.f && FMath::FloorToInt(AutoMoveTime / AutoMoveJumpInterval) != FMath::FloorToInt(PreviousTime / AutoMoveJumpInterval);
+
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		APlayerController* PC = It->Get();
+		ACharacter* Character = PC && PC->IsLocalController() ? Cast<ACharacter>(PC->GetPawn()) : nullptr;
+		if (Character == nullptr)
+		{
+			continue;
+		}
+		Character->AddMovementInput(Direction);
+		if (bJump)
+		{
+			Character->Jump();
+		}
+		else
+		{
+			Character->StopJumping();
+		}
+	}
+}
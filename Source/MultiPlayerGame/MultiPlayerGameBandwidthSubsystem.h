@@ -0,0 +1,107 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "MultiPlayerGameBandwidthSubsystem.generated.h"
+
+/**
+ * 复制带宽的回归检查：
+ * 服务器每秒采样所有连接的收发字节数和收到的移动RPC位数，换算成 每个角色每秒 的数值，写进stat和CSV；
+ * 命令行带 -BandwidthGate=<秒> 时，跳过预热后采样这么长时间，把平均值和DefaultGame.ini里的基线比较，
+ * 写出json报告（-BandwidthReport=<文件>），超过基线就以非0退出码退出，可以直接放进CI。
+ * 基线为0表示还没记录，这时不做比较，报告里标成未记录并以退出码2退出；
+ * 带 -BandwidthRecordBaseline 时只记录不比较，LoadTest.py baseline 用它把参考版本的数值写回DefaultGame.ini。
+ * 带 -BandwidthNetProfile 时采样期间打开 netprofile，按Actor类和RPC的明细用NetworkProfiler打开Saved/Profiling下的.nprof查看。
+ * 客户端带 -AutoMove 时本地角色按固定脚本绕圈跑并定时跳跃，配合 -AutoJoin 或直连服务器组成N个客户端的压测。
+ * 同时统计服务器每帧网络驱动TickFlush（复制和发包）的耗时，开关复制图、推送模式时用它对比服务器的复制开销。
+ */
+UCLASS(config = Game)
+class MULTIPLAYERGAME_API UMultiPlayerGameBandwidthSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+
+	UPROPERTY(Config)
+	float SampleInterval = 1.f;
+
+	//第一个客户端连进来之后多久开始计入检查，跳过登录和初始复制的峰值
+	UPROPERTY(Config)
+	float WarmupSeconds = 10.f;
+
+	//基线：每个连接每秒收到的每个角色的字节数、每个连接每秒发给服务器的字节数、每个角色每秒的移动RPC字节数，0表示还没记录
+	UPROPERTY(Config)
+	float BaselineOutBytesPerCharacter = 0.f;
+
+	UPROPERTY(Config)
+	float BaselineInBytesPerConnection = 0.f;
+
+	UPROPERTY(Config)
+	float BaselineMoveRPCBytesPerCharacter = 0.f;
+
+	//超过基线多少比例算回归
+	UPROPERTY(Config)
+	float AllowedRegression = 0.2f;
+
+	//-AutoMove 客户端绕圈的角速度（度/秒）和跳跃间隔
+	UPROPERTY(Config)
+	float AutoMoveTurnRate = 45.f;
+
+	UPROPERTY(Config)
+	float AutoMoveJumpInterval = 3.f;
+
+private:
+	struct FBandwidthSample
+	{
+		float OutBytesPerCharacter = 0.f;
+		float InBytesPerConnection = 0.f;
+		float MoveRPCBytesPerCharacter = 0.f;
+		float MaxOutBytesPerConnection = 0.f;
+		float NetFlushMs = 0.f;
+	};
+
+	void TickServer(float DeltaTime);
+	void TickAutoMove(float DeltaTime);
+	void TakeSample();
+	void FinishGate();
+	void OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+	void OnPostTickFlush(float DeltaSeconds);
+
+	void SetNetProfileEnabled(bool bEnabled);
+
+	bool bAutoMove = false;
+	bool bRecordBaseline = false;
+	bool bNetProfile = false;
+	bool bNetProfileRunning = false;
+	float GateSeconds = 0.f;
+	//-BandwidthClients=N：连接数到N之后才开始预热和计入检查
+	int32 GateConnections = 0;
+	float TimeUntilSample = 0.f;
+	double FirstConnectionTime = -1.0;
+	int64 LastReceivedMoveBits = 0;
+	//上次采样的实际时间，帧率低时采样间隔会比SampleInterval长
+	double LastSampleTime = 0.0;
+	//预热之后实际采样了多长时间
+	double GateSampledSeconds = 0.0;
+	float AutoMoveTime = 0.f;
+	TArray<FBandwidthSample> Samples;
+	bool bGateFinished = false;
+
+	//从Actor都Tick完到网络驱动TickFlush结束，上次采样以来的总耗时和帧数
+	FDelegateHandle PostActorTickHandle;
+	FDelegateHandle PostTickFlushHandle;
+	double PostActorTickTime = 0.0;
+	double NetFlushSeconds = 0.0;
+	int32 NetFlushFrames = 0;
+};
@@ -0,0 +1,423 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultiPlayerGameCharacter.h"
+#include "MultiPlayerGameLagCompensationSubsystem.h"
+#include "MultiPlayerGameStats.h"
+#include "Camera/CameraComponent.h"
+#include "Containers/Ticker.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/SpringArmComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "Math/RandomStream.h"
+#include "RenderCore.h"
+
+namespace MultiPlayerGameBenchmarks
+{
+	// 一个角色自身和所有组件独占的内存
+	static SIZE_T GetCharacterResourceSize(AActor* Actor)
+	{
+		SIZE_T Size = Actor->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+		TInlineComponentArray<UActorComponent*> Components(Actor);
+		for (UActorComponent* Component : Components)
+		{
+			Size += Component->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+		}
+		return Size;
+	}
+
+	// MultiPlayerGame.BenchmarkCharacterSpawn [Count] [Keep]
+	// 生成Count个默认Pawn，统计平均生成耗时、每个角色的组件数和内存，然后全部销毁；
+	// 在专用服务器（-server）和客户端上各跑一次对比精简构造的效果。
+	// 单机客户端上生成的角色都有权威，走不到模拟代理的路径；带Keep时角色留在出生点周围，
+	// 客户端连上来后用 MultiPlayerGame.BenchmarkProxyCharacters 测模拟代理的开销
+	static void BenchmarkCharacterSpawn(const TArray<FString>& Args, UWorld* World)
+	{
+		if (World == nullptr || World->GetAuthGameMode() == nullptr)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("BenchmarkCharacterSpawn needs a world with authority"));
+			return;
+		}
+		int32 Count = 100;
+		bool bKeep = false;
+		for (const FString& Arg : Args)
+		{
+			if (Arg.Equals(TEXT("Keep"), ESearchCase::IgnoreCase))
+			{
+				bKeep = true;
+			}
+			else if (Arg.IsNumeric())
+			{
+				Count = FMath::Max(1, FCString::Atoi(*Arg));
+			}
+		}
+		UClass* PawnClass = World->GetAuthGameMode()->DefaultPawnClass;
+		if (PawnClass == nullptr || !PawnClass->IsChildOf<AMultiPlayerGameCharacter>())
+		{
+			PawnClass = AMultiPlayerGameCharacter::StaticClass();
+		}
+
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+		// 留下来给客户端看的角色要在剔除距离以内，排成方阵放在出生点周围；只测生成的话排成一行放在高处
+		const AActor* PlayerStart = bKeep ? World->GetAuthGameMode()->FindPlayerStart(nullptr) : nullptr;
+		const FVector Origin = PlayerStart ? PlayerStart->GetActorLocation() : FVector(0.f, 0.f, 10000.f);
+		const int32 RowLength = bKeep ? FMath::CeilToInt(FMath::Sqrt(static_cast<float>(Count))) : Count;
+
+		TArray<AActor*> Spawned;
+		Spawned.Reserve(Count);
+		const uint64 StartPhysical = FPlatformMemory::GetStats().UsedPhysical;
+		const double StartTime = FPlatformTime::Seconds();
+		for (int32 Index = 0; Index < Count; ++Index)
+		{
+			// 间隔200，避免重叠
+			const FVector Location = Origin + FVector((Index % RowLength) * 200.f, (Index / RowLength) * 200.f, 0.f);
+			Spawned.Add(World->SpawnActor<AActor>(PawnClass, Location, FRotator::ZeroRotator, SpawnParams));
+		}
+		const double SpawnSeconds = FPlatformTime::Seconds() - StartTime;
+		const int64 PhysicalDelta = static_cast<int64>(FPlatformMemory::GetStats().UsedPhysical) - static_cast<int64>(StartPhysical);
+
+		SIZE_T ResourceSize = 0;
+		int32 NumComponents = 0;
+		int32 NumValid = 0;
+		for (AActor* Actor : Spawned)
+		{
+			if (Actor)
+			{
+				ResourceSize += GetCharacterResourceSize(Actor);
+				NumComponents += Actor->GetComponents().Num();
+				++NumValid;
+			}
+		}
+		if (!bKeep)
+		{
+			for (AActor* Actor : Spawned)
+			{
+				if (Actor)
+				{
+					Actor->Destroy();
+				}
+			}
+		}
+
+		if (NumValid == 0)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("BenchmarkCharacterSpawn spawned nothing"));
+			return;
+		}
+		UE_LOG(LogTemp, Display, TEXT("BenchmarkCharacterSpawn %s x%d (%s): %.3f ms/spawn, %.1f components, %.1f KB exclusive, %.1f KB physical per character"),
+			*PawnClass->GetName(), NumValid, IsRunningDedicatedServer() ? TEXT("dedicated server") : TEXT("client"),
+			SpawnSeconds * 1000.0 / NumValid,
+			static_cast<double>(NumComponents) / NumValid,
+			ResourceSize / 1024.0 / NumValid,
+			PhysicalDelta / 1024.0 / NumValid);
+		CSV_CUSTOM_STAT(MultiPlayerGame, CharacterSpawnMs, static_cast<float>(SpawnSeconds * 1000.0 / NumValid), ECsvCustomStatOp::Set);
+		if (bKeep)
+		{
+			UE_LOG(LogTemp, Display, TEXT("BenchmarkCharacterSpawn kept %d characters around %s"), NumValid, *Origin.ToString());
+		}
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchmarkCharacterSpawnCommand(
+		TEXT("MultiPlayerGame.BenchmarkCharacterSpawn"),
+		TEXT("Spawn N default pawns, log the average spawn time and per-character memory, then destroy them (Keep leaves them around the player start for clients). Usage: MultiPlayerGame.BenchmarkCharacterSpawn [Count] [Keep]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkCharacterSpawn));
+
+	// 客户端上的游戏世界；-ExecCmds在连上服务器之前就执行了，之后世界会换，每次都重新找
+	static UWorld* FindGameWorld()
+	{
+		if (GEngine == nullptr)
+		{
+			return nullptr;
+		}
+		for (const FWorldContext& Context : GEngine->GetWorldContexts())
+		{
+			if (Context.WorldType == EWorldType::Game || Context.WorldType == EWorldType::PIE)
+			{
+				return Context.World();
+			}
+		}
+		return nullptr;
+	}
+
+	// 连上服务器的客户端上别人的角色（模拟代理）的开销：BeginPlay里注销了弹簧臂和摄像机，
+	// 先按现在的样子采样游戏线程耗时，再把这两个组件注册回来采样一次，差值就是注销省下的
+	class FProxyCharacterBenchmark
+	{
+	public:
+		FProxyCharacterBenchmark(int32 InExpected, float InSampleSeconds, float InWaitSeconds, bool bInQuit)
+			: Expected(InExpected)
+			, SampleSeconds(InSampleSeconds)
+			, bQuit(bInQuit)
+		{
+			PhaseEndTime = FPlatformTime::Seconds() + InWaitSeconds;
+		}
+
+		bool Tick(float DeltaTime)
+		{
+			UWorld* World = FindGameWorld();
+			const double Now = FPlatformTime::Seconds();
+			switch (Phase)
+			{
+			case EPhase::Waiting:
+			{
+				const TArray<AMultiPlayerGameCharacter*> Proxies = GatherProxies(World);
+				if (Proxies.Num() >= Expected)
+				{
+					BeginSampling(Proxies, Now);
+				}
+				else if (Now > PhaseEndTime)
+				{
+					UE_LOG(LogTemp, Warning, TEXT("BenchmarkProxyCharacters: only %d of %d simulated proxies arrived"), Proxies.Num(), Expected);
+					return Finish();
+				}
+				return true;
+			}
+			case EPhase::CamerasUnregistered:
+			case EPhase::CamerasRegistered:
+				SampledGameThreadMs += FPlatformTime::ToMilliseconds(GGameThreadTime);
+				++NumSampledFrames;
+				if (Now < PhaseEndTime)
+				{
+					return true;
+				}
+				return EndSampling(Now);
+			}
+			return false;
+		}
+
+	private:
+		enum class EPhase : uint8
+		{
+			Waiting,
+			CamerasUnregistered,
+			CamerasRegistered,
+		};
+
+		static TArray<AMultiPlayerGameCharacter*> GatherProxies(UWorld* World)
+		{
+			TArray<AMultiPlayerGameCharacter*> Proxies;
+			if (World && World->GetNetMode() == NM_Client)
+			{
+				for (TActorIterator<AMultiPlayerGameCharacter> It(World); It; ++It)
+				{
+					if (It->GetLocalRole() == ROLE_SimulatedProxy && !It->IsPooled())
+					{
+						Proxies.Add(*It);
+					}
+				}
+			}
+			return Proxies;
+		}
+
+		static void SetCamerasRegistered(AMultiPlayerGameCharacter& Character, bool bRegistered)
+		{
+			for (USceneComponent* Component : { static_cast<USceneComponent*>(Character.GetCameraBoom()), static_cast<USceneComponent*>(Character.GetFollowCamera()) })
+			{
+				if (Component == nullptr || Component->IsRegistered() == bRegistered)
+				{
+					continue;
+				}
+				if (bRegistered)
+				{
+					Component->RegisterComponent();
+				}
+				else
+				{
+					Component->UnregisterComponent();
+				}
+			}
+		}
+
+		void BeginSampling(const TArray<AMultiPlayerGameCharacter*>& InProxies, double Now)
+		{
+			Proxies.Reset();
+			NumRegisteredBooms = 0;
+			for (AMultiPlayerGameCharacter* Proxy : InProxies)
+			{
+				Proxies.Add(Proxy);
+				NumRegisteredBooms += Proxy->GetCameraBoom() && Proxy->GetCameraBoom()->IsRegistered() ? 1 : 0;
+			}
+			RegisteredComponentsPerProxy[0] = CountRegisteredComponents();
+			Phase = EPhase::CamerasUnregistered;
+			SampledGameThreadMs = 0.0;
+			NumSampledFrames = 0;
+			PhaseEndTime = Now + SampleSeconds;
+		}
+
+		bool EndSampling(double Now)
+		{
+			const int32 PhaseIndex = Phase == EPhase::CamerasUnregistered ? 0 : 1;
+			GameThreadMs[PhaseIndex] = NumSampledFrames > 0 ? SampledGameThreadMs / NumSampledFrames : 0.0;
+			if (Phase == EPhase::CamerasUnregistered)
+			{
+				for (const TWeakObjectPtr<AMultiPlayerGameCharacter>& Proxy : Proxies)
+				{
+					if (Proxy.IsValid())
+					{
+						SetCamerasRegistered(*Proxy, true);
+					}
+				}
+				RegisteredComponentsPerProxy[1] = CountRegisteredComponents();
+				Phase = EPhase::CamerasRegistered;
+				SampledGameThreadMs = 0.0;
+				NumSampledFrames = 0;
+				PhaseEndTime = Now + SampleSeconds;
+				return true;
+			}
+
+			for (const TWeakObjectPtr<AMultiPlayerGameCharacter>& Proxy : Proxies)
+			{
+				if (Proxy.IsValid())
+				{
+					SetCamerasRegistered(*Proxy, false);
+				}
+			}
+			UE_LOG(LogTemp, Display, TEXT("BenchmarkProxyCharacters %d proxies: %.3f ms game thread with cameras unregistered, %.3f ms with cameras registered, %.1f vs %.1f registered components per proxy, %d registered camera booms"),
+				Proxies.Num(), GameThreadMs[0], GameThreadMs[1], RegisteredComponentsPerProxy[0], RegisteredComponentsPerProxy[1], NumRegisteredBooms);
+			return Finish();
+		}
+
+		float CountRegisteredComponents() const
+		{
+			int32 NumRegistered = 0;
+			int32 NumValid = 0;
+			for (const TWeakObjectPtr<AMultiPlayerGameCharacter>& Proxy : Proxies)
+			{
+				if (!Proxy.IsValid())
+				{
+					continue;
+				}
+				++NumValid;
+				TInlineComponentArray<UActorComponent*> Components(Proxy.Get());
+				for (const UActorComponent* Component : Components)
+				{
+					NumRegistered += Component->IsRegistered() ? 1 : 0;
+				}
+			}
+			return NumValid > 0 ? static_cast<float>(NumRegistered) / NumValid : 0.f;
+		}
+
+		bool Finish()
+		{
+			if (bQuit)
+			{
+				FPlatformMisc::RequestExit(false);
+			}
+			return false;
+		}
+
+		int32 Expected{0};
+		float SampleSeconds{0.f};
+		bool bQuit{false};
+		EPhase Phase{EPhase::Waiting};
+		double PhaseEndTime{0.0};
+		TArray<TWeakObjectPtr<AMultiPlayerGameCharacter>> Proxies;
+		double SampledGameThreadMs{0.0};
+		int32 NumSampledFrames{0};
+		double GameThreadMs[2]{0.0, 0.0};
+		float RegisteredComponentsPerProxy[2]{0.f, 0.f};
+		int32 NumRegisteredBooms{0};
+	};
+
+	// MultiPlayerGame.BenchmarkProxyCharacters [Count=100] [Seconds=10] [Wait=120] [Quit]
+	// 在连到服务器的客户端上跑，服务器先用 BenchmarkCharacterSpawn Count Keep 生成角色；
+	// 等Count个模拟代理都复制过来后分两段采样，结果在几十秒之后打到日志里，带Quit时跑完退出
+	static void BenchmarkProxyCharacters(const TArray<FString>& Args)
+	{
+		int32 Count = 100;
+		float SampleSeconds = 10.f;
+		float WaitSeconds = 120.f;
+		bool bQuit = false;
+		for (const FString& Arg : Args)
+		{
+			if (FParse::Value(*Arg, TEXT("Seconds="), SampleSeconds) || FParse::Value(*Arg, TEXT("Wait="), WaitSeconds))
+			{
+				continue;
+			}
+			if (Arg.Equals(TEXT("Quit"), ESearchCase::IgnoreCase))
+			{
+				bQuit = true;
+			}
+			else if (Arg.IsNumeric())
+			{
+				Count = FMath::Max(1, FCString::Atoi(*Arg));
+			}
+		}
+		TSharedRef<FProxyCharacterBenchmark> Benchmark = MakeShared<FProxyCharacterBenchmark>(Count, FMath::Max(1.f, SampleSeconds), WaitSeconds, bQuit);
+		// 返回false时FTicker移除这个委托，同时放掉对压测对象的引用
+		FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([Benchmark](float DeltaTime)
+		{
+			return Benchmark->Tick(DeltaTime);
+		}));
+	}
+
+	static FAutoConsoleCommand BenchmarkProxyCharactersCommand(
+		TEXT("MultiPlayerGame.BenchmarkProxyCharacters"),
+		TEXT("On a connected client, wait for N simulated proxy characters and compare game thread time with their cameras unregistered and registered. Usage: MultiPlayerGame.BenchmarkProxyCharacters [Count=100] [Seconds=10] [Wait=120] [Quit]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkProxyCharacters));
+
+	// MultiPlayerGame.BenchmarkLagCompensation [Characters] [Seconds] [TickRate]
+	// 不依赖世界，直接用假数据测命中盒历史的记录和回溯耗时，默认100个角色、1秒历史、60帧
+	static void BenchmarkLagCompensation(const TArray<FString>& Args)
+	{
+		const int32 NumCharacters = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 100;
+		const float HistorySeconds = Args.Num() > 1 ? FMath::Max(0.1f, FCString::Atof(*Args[1])) : 1.f;
+		const int32 TickRate = Args.Num() > 2 ? FMath::Max(1, FCString::Atoi(*Args[2])) : 60;
+		const int32 NumFrames = FMath::CeilToInt(HistorySeconds * TickRate);
+		const double FrameTime = 1.0 / TickRate;
+
+		FMultiPlayerGameHitboxHistory History;
+		History.Init(NumCharacters, NumFrames);
+		FRandomStream Random(1234);
+
+		// 记录：写满两圈，第二圈开始覆盖旧帧
+		const int32 NumRecordFrames = NumFrames * 2;
+		const double RecordStart = FPlatformTime::Seconds();
+		for (int32 Frame = 0; Frame < NumRecordFrames; ++Frame)
+		{
+			History.BeginFrame(Frame * FrameTime);
+			for (int32 Slot = 0; Slot < NumCharacters; ++Slot)
+			{
+				const FVector Location(Slot * 100.f + Frame, Frame * 2.f, 90.f);
+				History.Record(Slot, Location, FQuat(FVector::UpVector, Frame * 0.01f), 42.f, 96.f);
+			}
+		}
+		const double RecordSeconds = FPlatformTime::Seconds() - RecordStart;
+
+		// 回溯：在整段历史里随机挑角色和时间
+		const int32 NumRewinds = 100000;
+		const double OldestTime = (NumRecordFrames - NumFrames) * FrameTime;
+		const double NewestTime = History.GetNewestTime();
+		FMultiPlayerGameHitbox Hitbox;
+		float Checksum = 0.f;
+		const double RewindStart = FPlatformTime::Seconds();
+		for (int32 Index = 0; Index < NumRewinds; ++Index)
+		{
+			const int32 Slot = Random.RandHelper(NumCharacters);
+			const double Time = FMath::Lerp(OldestTime, NewestTime, static_cast<double>(Random.GetFraction()));
+			if (History.Rewind(Slot, Time, Hitbox))
+			{
+				Checksum += Hitbox.Location.X;
+			}
+		}
+		const double RewindSeconds = FPlatformTime::Seconds() - RewindStart;
+
+		UE_LOG(LogTemp, Display, TEXT("BenchmarkLagCompensation %d characters x %d frames: record %.2f us/frame (%.1f ns/character), rewind %.1f ns/query, %.1f KB history (checksum %f)"),
+			NumCharacters, NumFrames,
+			RecordSeconds * 1e6 / NumRecordFrames,
+			RecordSeconds * 1e9 / (NumRecordFrames * static_cast<double>(NumCharacters)),
+			RewindSeconds * 1e9 / NumRewinds,
+			History.GetAllocatedSize() / 1024.0,
+			Checksum);
+	}
+
+	static FAutoConsoleCommand BenchmarkLagCompensationCommand(
+		TEXT("MultiPlayerGame.BenchmarkLagCompensation"),
+		TEXT("Measure hitbox history record and rewind cost with synthetic data. Usage: MultiPlayerGame.BenchmarkLagCompensation [Characters=100] [Seconds=1] [TickRate=60]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkLagCompensation));
+}
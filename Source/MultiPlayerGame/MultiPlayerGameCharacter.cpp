@@ -1,6 +1,12 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "MultiPlayerGameCharacter.h"
+#include "MultiPlayerGameMovementComponent.h"
+#include "MultiPlayerGameAnimSignificanceSubsystem.h"
+#include "MultiPlayerGamePawnPoolSubsystem.h"
+#include "MultiPlayerGameLagCompensationSubsystem.h"
+#include "GameFramework/GameModeBase.h"
+#include "SkeletalMeshComponentBudgeted.h"
 #include "HeadMountedDisplayFunctionLibrary.h"
 #include "Camera/CameraComponent.h"
 #include "Components/CapsuleComponent.h"
@@ -9,14 +15,19 @@
 #include "GameFramework/Controller.h"
 #include "GameFramework/SpringArmComponent.h"
 #include "Kismet/GameplayStatics.h"
+#include "Net/UnrealNetwork.h"
+#include "Net/Core/PushModel/PushModel.h"
 #include "OnlineSubsystem.h"
 #include "OnlineSessionSettings.h"
 
 //////////////////////////////////////////////////////////////////////////
 // AMultiPlayerGameCharacter
 
-AMultiPlayerGameCharacter::AMultiPlayerGameCharacter()
-	: CreateSessionCompleteDelegate(FOnCreateSessionCompleteDelegate::CreateUObject(this,&ThisClass::OnCreateSessionComplete)),
+AMultiPlayerGameCharacter::AMultiPlayerGameCharacter(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer
+		.SetDefaultSubobjectClass<UMultiPlayerGameMovementComponent>(ACharacter::CharacterMovementComponentName)
+		.SetDefaultSubobjectClass<USkeletalMeshComponentBudgeted>(ACharacter::MeshComponentName)),
+		CreateSessionCompleteDelegate(FOnCreateSessionCompleteDelegate::CreateUObject(this,&ThisClass::OnCreateSessionComplete)),
 		FindSessionsCompleteDelegate(FOnFindSessionsCompleteDelegate::CreateUObject(this,&ThisClass::OnFindSessionComplete)),
 		JoinSessionCompleteDelegate(FOnJoinSessionCompleteDelegate::CreateUObject(this,&ThisClass::OnJoinSessionComplete))
 {
@@ -38,6 +49,12 @@ AMultiPlayerGameCharacter::AMultiPlayerGameCharacter()
 	GetCharacterMovement()->JumpZVelocity = 600.f;
 	GetCharacterMovement()->AirControl = 0.2f;
 
+	// 动画预算只在客户端由 UMultiPlayerGameAnimSignificanceSubsystem 管理
+	if (USkeletalMeshComponentBudgeted* BudgetedMesh = Cast<USkeletalMeshComponentBudgeted>(GetMesh()))
+	{
+		BudgetedMesh->SetAutoRegisterWithBudgetAllocator(!IsRunningDedicatedServer());
+	}
+
 	// Create a camera boom (pulls in towards the player if there is a collision)
 	CameraBoom = CreateDefaultSubobject<USpringArmComponent>(TEXT("CameraBoom"));
 	CameraBoom->SetupAttachment(RootComponent);
@@ -49,8 +66,162 @@ AMultiPlayerGameCharacter::AMultiPlayerGameCharacter()
 	FollowCamera->SetupAttachment(CameraBoom, USpringArmComponent::SocketName); // Attach the camera to the end of the boom and let the boom adjust to match the controller orientation
 	FollowCamera->bUsePawnControlRotation = false; // Camera does not rotate relative to arm
 
+	// 子对象在所有端都创建，蓝图和序列化看到的组件一致；专用服务器上没有人看，生成时不注册
+	if (IsRunningDedicatedServer())
+	{
+		CameraBoom->bAutoRegister = false;
+		FollowCamera->bAutoRegister = false;
+	}
+
 	// Note: The skeletal mesh and anim blueprint references on the Mesh component (inherited from Character) 
 	// are set in the derived blueprint asset named MyCharacter (to avoid direct content references in C++)
+	// 会话接口在第一次创建或加入会话时才去取，CDO、服务器上和别人的角色都用不到
+}
+
+void AMultiPlayerGameCharacter::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// 客户端上别人的角色不会用到摄像机，弹簧臂每帧还要做一次碰撞检测，直接注销
+	if (GetLocalRole() == ROLE_SimulatedProxy)
+	{
+		SetCameraComponentsActive(false);
+	}
+
+	UMultiPlayerGameAnimSignificanceSubsystem* AnimSignificance = GetWorld()->GetSubsystem<UMultiPlayerGameAnimSignificanceSubsystem>();
+	if (AnimSignificance && !bPooled)
+	{
+		AnimSignificance->RegisterCharacter(this);
+	}
+	if (HasAuthority() && !bPooled)
+	{
+		if (UMultiPlayerGameLagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<UMultiPlayerGameLagCompensationSubsystem>())
+		{
+			LagCompensation->RegisterCharacter(this);
+		}
+	}
+}
+
+void AMultiPlayerGameCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UMultiPlayerGameAnimSignificanceSubsystem* AnimSignificance = GetWorld()->GetSubsystem<UMultiPlayerGameAnimSignificanceSubsystem>())
+	{
+		AnimSignificance->UnregisterCharacter(this);
+	}
+	if (UMultiPlayerGameLagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<UMultiPlayerGameLagCompensationSubsystem>())
+	{
+		LagCompensation->UnregisterCharacter(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AMultiPlayerGameCharacter::PawnClientRestart()
+{
+	// 本地控制器接管了这个角色，把摄像机加回来
+	SetCameraComponentsActive(true);
+
+	Super::PawnClientRestart();
+}
+
+void AMultiPlayerGameCharacter::FellOutOfWorld(const UDamageType& DmgType)
+{
+	UMultiPlayerGamePawnPoolSubsystem* PawnPool = GetWorld()->GetSubsystem<UMultiPlayerGamePawnPoolSubsystem>();
+	AController* OldController = GetController();
+	AGameModeBase* GameMode = GetWorld()->GetAuthGameMode();
+	if (!HasAuthority() || PawnPool == nullptr || OldController == nullptr || GameMode == nullptr)
+	{
+		Super::FellOutOfWorld(DmgType);
+		return;
+	}
+	PawnPool->ReleaseControllerPawn(OldController);
+	GameMode->RestartPlayer(OldController);
+}
+
+void AMultiPlayerGameCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	FDoRepLifetimeParams Params;
+	Params.bIsPushBased = true;
+	DOREPLIFETIME_WITH_PARAMS_FAST(AMultiPlayerGameCharacter, bPooled, Params);
+}
+
+void AMultiPlayerGameCharacter::SetPooled(bool bInPooled)
+{
+	if (bPooled == bInPooled)
+	{
+		return;
+	}
+	bPooled = bInPooled;
+	MARK_PROPERTY_DIRTY_FROM_NAME(AMultiPlayerGameCharacter, bPooled, this);
+	ApplyPooledState();
+}
+
+void AMultiPlayerGameCharacter::OnRep_Pooled()
+{
+	ApplyPooledState();
+}
+
+void AMultiPlayerGameCharacter::ApplyPooledState()
+{
+	GetMesh()->SetComponentTickEnabled(!bPooled);
+	if (!HasActorBegunPlay())
+	{
+		// 还没BeginPlay的话由BeginPlay按bPooled决定是否注册
+		return;
+	}
+	if (UMultiPlayerGameAnimSignificanceSubsystem* AnimSignificance = GetWorld()->GetSubsystem<UMultiPlayerGameAnimSignificanceSubsystem>())
+	{
+		if (bPooled)
+		{
+			AnimSignificance->UnregisterCharacter(this);
+		}
+		else
+		{
+			AnimSignificance->RegisterCharacter(this);
+		}
+	}
+	// 池里的角色不参与回溯，也不占历史记录的槽位
+	UMultiPlayerGameLagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<UMultiPlayerGameLagCompensationSubsystem>();
+	if (LagCompensation && HasAuthority())
+	{
+		if (bPooled)
+		{
+			LagCompensation->UnregisterCharacter(this);
+		}
+		else
+		{
+			LagCompensation->RegisterCharacter(this);
+		}
+	}
+}
+
+void AMultiPlayerGameCharacter::SetCameraComponentsActive(bool bActive)
+{
+	for (USceneComponent* Component : { static_cast<USceneComponent*>(CameraBoom), static_cast<USceneComponent*>(FollowCamera) })
+	{
+		if (Component->IsRegistered() == bActive)
+		{
+			continue;
+		}
+		if (bActive)
+		{
+			Component->RegisterComponent();
+		}
+		else
+		{
+			Component->UnregisterComponent();
+		}
+	}
+}
+
+bool AMultiPlayerGameCharacter::InitOnlineSessionInterface()
+{
+	if (OnlineSessionInterface.IsValid())
+	{
+		return true;
+	}
 	IOnlineSubsystem* OnlineSubsystem = IOnlineSubsystem::Get();
 	if(OnlineSubsystem)
 	{
@@ -65,7 +236,7 @@ AMultiPlayerGameCharacter::AMultiPlayerGameCharacter()
 			);
 		}
 	}
-	
+	return OnlineSessionInterface.IsValid();
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -188,7 +359,7 @@ void AMultiPlayerGameCharacter::CreateGameSession()
 	//在蓝图中按1访问
 	//此时OnlineSessionInterface持有着会话的子系统
 	//先检查是否为空
-	if(!OnlineSessionInterface.IsValid())return ;
+	if(!InitOnlineSessionInterface())return ;
 	//然后看看是否会话已经开始
 	 auto ExistSession = OnlineSessionInterface->GetNamedSession(NAME_GameSession);
 	//如果会话已经存在，则销毁会话
@@ -254,13 +425,16 @@ void AMultiPlayerGameCharacter::OnCreateSessionComplete(FName SessionName, bool
 void AMultiPlayerGameCharacter::JoinGameSession()
 {
 
-	if(!OnlineSessionInterface.IsValid())return;
+	if(!InitOnlineSessionInterface())return;
 	OnlineSessionInterface->AddOnFindSessionsCompleteDelegate_Handle(FindSessionsCompleteDelegate);
 	//Find Game Session
 	 SessionSearch = MakeShareable(new FOnlineSessionSearch);
 	SessionSearch->MaxSearchResults = 10000;
 	SessionSearch->bIsLanQuery = false;
 	SessionSearch->QuerySettings.Set(SEARCH_PRESENCE,true,EOnlineComparisonOp::Equals);
+	//让后端只返回FreeForAll并且还有空位的会话
+	SessionSearch->QuerySettings.Set(FName("MatchType"),FString("FreeForAll"),EOnlineComparisonOp::Equals);
+	SessionSearch->QuerySettings.Set(SEARCH_MINSLOTSAVAILABLE,1,EOnlineComparisonOp::GreaterThanEquals);
 
 	const ULocalPlayer* LocalPlayer =  GetWorld()->GetFirstLocalPlayerFromController();
 	OnlineSessionInterface->FindSessions(*LocalPlayer->GetPreferredUniqueNetId(),SessionSearch.ToSharedRef());
@@ -274,7 +448,7 @@ void AMultiPlayerGameCharacter::OnFindSessionComplete(bool bWasSucessful)
 	
 	if(bWasSucessful)
 	{
-		for(auto Result: SessionSearch->SearchResults)
+		for(const FOnlineSessionSearchResult& Result: SessionSearch->SearchResults)
 		{
 			auto Id  = Result.GetSessionIdStr();
 			auto Name =  Result.Session.OwningUserName;
@@ -303,6 +477,8 @@ void AMultiPlayerGameCharacter::OnFindSessionComplete(bool bWasSucessful)
 				OnlineSessionInterface->AddOnJoinSessionCompleteDelegate_Handle(JoinSessionCompleteDelegate);
 				const ULocalPlayer* LocalPlayer =  GetWorld()->GetFirstLocalPlayerFromController();
 				OnlineSessionInterface->JoinSession(*LocalPlayer->GetPreferredUniqueNetId(),NAME_GameSession,Result);
+				//只加入第一个匹配的会话
+				break;
 			}
 			
 		}
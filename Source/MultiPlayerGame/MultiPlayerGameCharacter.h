@@ -24,7 +24,7 @@ class AMultiPlayerGameCharacter : public ACharacter
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
 	class UCameraComponent* FollowCamera;
 public:
-	AMultiPlayerGameCharacter();
+	AMultiPlayerGameCharacter(const FObjectInitializer& ObjectInitializer);
 
 	/** Base turn rate, in deg/sec. Other scaling may affect final turn rate. */
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Camera)
@@ -68,12 +68,36 @@ protected:
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 	// End of APawn interface
 
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void PawnClientRestart() override;
+	//掉出世界就是这个游戏里的死亡：服务器把角色收回池里，再让玩家重生
+	virtual void FellOutOfWorld(const class UDamageType& DmgType) override;
+
+	//注册或注销摄像机和弹簧臂，专用服务器上它们生成时就不注册
+	void SetCameraComponentsActive(bool bActive);
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	UFUNCTION()
+	void OnRep_Pooled();
+	//池里的角色不Tick骨骼网格，也不参与动画预算；服务器上直接调用，客户端在OnRep里调用
+	void ApplyPooledState();
+
+	//只在Pawn池收回或取出时变化，用推送模式复制
+	UPROPERTY(ReplicatedUsing = OnRep_Pooled)
+	bool bPooled = false;
+
 public:
-	/** Returns CameraBoom subobject **/
+	/** Returns CameraBoom subobject, not registered on dedicated servers **/
 	FORCEINLINE class USpringArmComponent* GetCameraBoom() const { return CameraBoom; }
-	/** Returns FollowCamera subobject **/
+	/** Returns FollowCamera subobject, not registered on dedicated servers **/
 	FORCEINLINE class UCameraComponent* GetFollowCamera() const { return FollowCamera; }
 
+	//服务器：Pawn池收回或取出这个角色时调用
+	void SetPooled(bool bInPooled);
+	bool IsPooled() const { return bPooled; }
+
 
 	
 	UFUNCTION(BlueprintCallable)
@@ -90,6 +114,9 @@ public:
 	IOnlineSessionPtr OnlineSessionInterface;
 
 protected:
+	//第一次用到时才获取会话接口
+	bool InitOnlineSessionInterface();
+
 	UFUNCTION(BlueprintCallable)
 	void CreateGameSession();
 	
@@ -2,6 +2,12 @@
 
 #include "MultiPlayerGameGameMode.h"
 #include "MultiPlayerGameCharacter.h"
+#include "MultiPlayerGamePawnPoolSubsystem.h"
+#include "MultiPlayerGamePlayerController.h"
+#include "MultiplayerSessionsSubsystem.h"
+#include "Engine/GameInstance.h"
+#include "GameFramework/GameStateBase.h"
+#include "GameFramework/PlayerState.h"
 #include "UObject/ConstructorHelpers.h"
 
 AMultiPlayerGameGameMode::AMultiPlayerGameGameMode()
@@ -12,4 +18,69 @@ AMultiPlayerGameGameMode::AMultiPlayerGameGameMode()
 	{
 		DefaultPawnClass = PlayerPawnBPClass.Class;
 	}
+	PlayerControllerClass = AMultiPlayerGamePlayerController::StaticClass();
+}
+
+void AMultiPlayerGameGameMode::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// 无缝跳转过来的玩家在BeginPlay之后才重生，这时池已经准备好了
+	if (UMultiPlayerGamePawnPoolSubsystem* PawnPool = GetWorld()->GetSubsystem<UMultiPlayerGamePawnPoolSubsystem>())
+	{
+		PawnPool->Prewarm(DefaultPawnClass);
+	}
+}
+
+void AMultiPlayerGameGameMode::Logout(AController* Exiting)
+{
+	UGameInstance* GameInstance = GetGameInstance();
+	UMultiplayerSessionsSubsystem* Subsystem = GameInstance ? GameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr;
+	if (Subsystem && Exiting && Exiting->PlayerState)
+	{
+		Subsystem->RemoveRemoteJoinId(Exiting->PlayerState->GetUniqueId());
+	}
+	Super::Logout(Exiting);
+}
+
+void AMultiPlayerGameGameMode::HandleSeamlessTravelPlayer(AController*& C)
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(AMultiPlayerGameGameMode::HandleSeamlessTravelPlayer);
+	Super::HandleSeamlessTravelPlayer(C);
+
+	UGameInstance* GameInstance = GetGameInstance();
+	UMultiplayerSessionsSubsystem* Subsystem = GameInstance ? GameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr;
+	if (Subsystem && C)
+	{
+		// Super里控制器可能被换成了新的，用换完之后的
+		const FString JoinId = C->IsLocalController() ? Subsystem->GetJoinTraceId() :
+			Subsystem->GetRemoteJoinId(C->PlayerState ? C->PlayerState->GetUniqueId() : FUniqueNetIdRepl());
+		MultiplayerSessionsTrace::Bookmark(TEXT("SeamlessTravelPlayer"), JoinId, GetWorld()->GetMapName());
+	}
+}
+
+void AMultiPlayerGameGameMode::PostSeamlessTravel()
+{
+	MULTIPLAYER_SESSIONS_TRACE_SCOPE(AMultiPlayerGameGameMode::PostSeamlessTravel);
+	Super::PostSeamlessTravel();
+
+	UGameInstance* GameInstance = GetGameInstance();
+	if (UMultiplayerSessionsSubsystem* Subsystem = GameInstance ? GameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr)
+	{
+		MultiplayerSessionsTrace::Bookmark(TEXT("PostSeamlessTravel"), Subsystem->GetJoinTraceId(),
+			FString::Printf(TEXT("%s %d players"), *GetWorld()->GetMapName(), GameState ? GameState->PlayerArray.Num() : 0));
+	}
+}
+
+APawn* AMultiPlayerGameGameMode::SpawnDefaultPawnAtTransform_Implementation(AController* NewPlayer, const FTransform& SpawnTransform)
+{
+	UMultiPlayerGamePawnPoolSubsystem* PawnPool = GetWorld()->GetSubsystem<UMultiPlayerGamePawnPoolSubsystem>();
+	if (PawnPool == nullptr)
+	{
+		return Super::SpawnDefaultPawnAtTransform_Implementation(NewPlayer, SpawnTransform);
+	}
+	return PawnPool->AcquireOrSpawn(GetDefaultPawnClassForController(NewPlayer), SpawnTransform, [&]()
+	{
+		return Super::SpawnDefaultPawnAtTransform_Implementation(NewPlayer, SpawnTransform);
+	});
 }
@@ -13,6 +13,15 @@ class AMultiPlayerGameGameMode : public AGameModeBase
 
 public:
 	AMultiPlayerGameGameMode();
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void Logout(AController* Exiting) override;
+	//无缝跳转过来的玩家在Insights里接上各自在大厅的加入ID
+	virtual void HandleSeamlessTravelPlayer(AController*& C) override;
+	virtual void PostSeamlessTravel() override;
+	//玩家的Pawn从池里取，登出时由AMultiPlayerGamePlayerController收回
+	virtual APawn* SpawnDefaultPawnAtTransform_Implementation(AController* NewPlayer, const FTransform& SpawnTransform) override;
 };
 
 
@@ -0,0 +1,219 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultiPlayerGameLagCompensationSubsystem.h"
+#include "MultiPlayerGameCharacter.h"
+#include "MultiPlayerGameStats.h"
+#include "Components/CapsuleComponent.h"
+#include "Engine/World.h"
+
+void FMultiPlayerGameHitboxHistory::Init(int32 InMaxSlots, int32 InMaxFrames)
+{
+	MaxSlots = FMath::Max(InMaxSlots, 1);
+	MaxFrames = FMath::Max(InMaxFrames, 2);
+	Head = INDEX_NONE;
+	NumFrames = 0;
+
+	const int32 NumEntries = MaxSlots * MaxFrames;
+	FrameTimes.SetNumZeroed(MaxFrames);
+	Locations.SetNumZeroed(NumEntries);
+	Rotations.SetNumZeroed(NumEntries);
+	Radii.SetNumZeroed(NumEntries);
+	HalfHeights.SetNumZeroed(NumEntries);
+	Valid.Init(false, NumEntries);
+}
+
+void FMultiPlayerGameHitboxHistory::BeginFrame(double Time)
+{
+	Head = (Head + 1) % MaxFrames;
+	NumFrames = FMath::Min(NumFrames + 1, MaxFrames);
+	FrameTimes[Head] = Time;
+	Valid.SetRange(GetIndex(Head, 0), MaxSlots, false);
+}
+
+void FMultiPlayerGameHitboxHistory::Record(int32 Slot, const FVector& Location, const FQuat& Rotation, float Radius, float HalfHeight)
+{
+	check(Head != INDEX_NONE && Slot >= 0 && Slot < MaxSlots);
+	const int32 Index = GetIndex(Head, Slot);
+	Locations[Index] = Location;
+	Rotations[Index] = Rotation;
+	Radii[Index] = Radius;
+	HalfHeights[Index] = HalfHeight;
+	Valid[Index] = true;
+}
+
+void FMultiPlayerGameHitboxHistory::InvalidateSlot(int32 Slot)
+{
+	for (int32 Frame = 0; Frame < MaxFrames; ++Frame)
+	{
+		Valid[GetIndex(Frame, Slot)] = false;
+	}
+}
+
+void FMultiPlayerGameHitboxHistory::ReadHitbox(int32 Index, FMultiPlayerGameHitbox& OutHitbox) const
+{
+	OutHitbox.Location = Locations[Index];
+	OutHitbox.Rotation = Rotations[Index];
+	OutHitbox.Radius = Radii[Index];
+	OutHitbox.HalfHeight = HalfHeights[Index];
+}
+
+bool FMultiPlayerGameHitboxHistory::Rewind(int32 Slot, double Time, FMultiPlayerGameHitbox& OutHitbox) const
+{
+	if (NumFrames == 0 || Slot < 0 || Slot >= MaxSlots)
+	{
+		return false;
+	}
+
+	// 从最新的帧往回找第一帧不晚于Time的，它和后面一帧夹住Time
+	int32 NewerFrame = INDEX_NONE;
+	int32 OlderFrame = INDEX_NONE;
+	for (int32 Age = 0; Age < NumFrames; ++Age)
+	{
+		const int32 Frame = (Head - Age + MaxFrames) % MaxFrames;
+		if (!Valid[GetIndex(Frame, Slot)])
+		{
+			// 角色在这一帧之前还没有注册
+			break;
+		}
+		if (FrameTimes[Frame] <= Time)
+		{
+			OlderFrame = Frame;
+			break;
+		}
+		NewerFrame = Frame;
+	}
+
+	if (OlderFrame == INDEX_NONE && NewerFrame == INDEX_NONE)
+	{
+		return false;
+	}
+	if (OlderFrame == INDEX_NONE || NewerFrame == INDEX_NONE)
+	{
+		ReadHitbox(GetIndex(OlderFrame != INDEX_NONE ? OlderFrame : NewerFrame, Slot), OutHitbox);
+		return true;
+	}
+
+	const int32 OlderIndex = GetIndex(OlderFrame, Slot);
+	const int32 NewerIndex = GetIndex(NewerFrame, Slot);
+	const double FrameDelta = FrameTimes[NewerFrame] - FrameTimes[OlderFrame];
+	const float Alpha = FrameDelta > 0.0 ? static_cast<float>((Time - FrameTimes[OlderFrame]) / FrameDelta) : 1.f;
+	OutHitbox.Location = FMath::Lerp(Locations[OlderIndex], Locations[NewerIndex], Alpha);
+	OutHitbox.Rotation = FQuat::Slerp(Rotations[OlderIndex], Rotations[NewerIndex], Alpha);
+	OutHitbox.Radius = FMath::Lerp(Radii[OlderIndex], Radii[NewerIndex], Alpha);
+	OutHitbox.HalfHeight = FMath::Lerp(HalfHeights[OlderIndex], HalfHeights[NewerIndex], Alpha);
+	return true;
+}
+
+SIZE_T FMultiPlayerGameHitboxHistory::GetAllocatedSize() const
+{
+	return FrameTimes.GetAllocatedSize() + Locations.GetAllocatedSize() + Rotations.GetAllocatedSize()
+		+ Radii.GetAllocatedSize() + HalfHeights.GetAllocatedSize() + Valid.GetAllocatedSize();
+}
+
+bool UMultiPlayerGameLagCompensationSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld() && Super::ShouldCreateSubsystem(Outer);
+}
+
+void UMultiPlayerGameLagCompensationSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	History.Init(MaxCharacters, MaxHistoryFrames);
+	CharacterBySlot.SetNum(History.GetMaxSlots());
+	SlotByCharacter.Reserve(History.GetMaxSlots());
+	FreeSlots.Reserve(History.GetMaxSlots());
+	// 倒序放进空闲列表，先分配小的槽位
+	for (int32 Slot = History.GetMaxSlots() - 1; Slot >= 0; --Slot)
+	{
+		FreeSlots.Add(Slot);
+	}
+	SET_MEMORY_STAT(STAT_MPG_LagCompensationMemory, History.GetAllocatedSize());
+}
+
+void UMultiPlayerGameLagCompensationSubsystem::Deinitialize()
+{
+	CharacterBySlot.Empty();
+	SlotByCharacter.Empty();
+	FreeSlots.Empty();
+	SET_MEMORY_STAT(STAT_MPG_LagCompensationMemory, 0);
+	Super::Deinitialize();
+}
+
+bool UMultiPlayerGameLagCompensationSubsystem::IsTickable() const
+{
+	// 只有服务器做命中判定
+	const UWorld* World = GetWorld();
+	return !IsTemplate() && World && (World->GetNetMode() == NM_DedicatedServer || World->GetNetMode() == NM_ListenServer);
+}
+
+TStatId UMultiPlayerGameLagCompensationSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMultiPlayerGameLagCompensationSubsystem, STATGROUP_Tickables);
+}
+
+void UMultiPlayerGameLagCompensationSubsystem::RegisterCharacter(AMultiPlayerGameCharacter* Character)
+{
+	if (Character == nullptr || SlotByCharacter.Contains(Character))
+	{
+		return;
+	}
+	if (FreeSlots.Num() == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Lag compensation is full (%d characters), %s will not be rewound"), MaxCharacters, *Character->GetName());
+		return;
+	}
+	const int32 Slot = FreeSlots.Pop(false);
+	History.InvalidateSlot(Slot);
+	CharacterBySlot[Slot] = Character;
+	SlotByCharacter.Add(Character, Slot);
+}
+
+void UMultiPlayerGameLagCompensationSubsystem::UnregisterCharacter(AMultiPlayerGameCharacter* Character)
+{
+	int32 Slot = INDEX_NONE;
+	if (SlotByCharacter.RemoveAndCopyValue(Character, Slot))
+	{
+		CharacterBySlot[Slot] = nullptr;
+		FreeSlots.Add(Slot);
+	}
+}
+
+void UMultiPlayerGameLagCompensationSubsystem::Tick(float DeltaTime)
+{
+	// 服务器帧率比历史的分辨率高时跳过一些帧，保证历史覆盖HistorySeconds
+	const double Now = GetWorld()->GetTimeSeconds();
+	const double RecordInterval = HistorySeconds / History.GetMaxFrames();
+	if (LastRecordTime >= 0.0 && Now - LastRecordTime < RecordInterval)
+	{
+		return;
+	}
+	LastRecordTime = Now;
+	RecordFrame(Now);
+}
+
+void UMultiPlayerGameLagCompensationSubsystem::RecordFrame(double Time)
+{
+	SCOPE_CYCLE_COUNTER(STAT_MPG_LagCompensationRecord);
+
+	History.BeginFrame(Time);
+	for (int32 Slot = 0; Slot < CharacterBySlot.Num(); ++Slot)
+	{
+		const AMultiPlayerGameCharacter* Character = CharacterBySlot[Slot].Get();
+		const UCapsuleComponent* Capsule = Character ? Character->GetCapsuleComponent() : nullptr;
+		if (Capsule == nullptr || Character->IsHidden())
+		{
+			continue;
+		}
+		History.Record(Slot, Capsule->GetComponentLocation(), Capsule->GetComponentQuat(), Capsule->GetScaledCapsuleRadius(), Capsule->GetScaledCapsuleHalfHeight());
+	}
+}
+
+bool UMultiPlayerGameLagCompensationSubsystem::RewindCharacter(const AMultiPlayerGameCharacter* Character, double Timestamp, FMultiPlayerGameHitbox& OutHitbox) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_MPG_LagCompensationRewind);
+
+	const int32* Slot = SlotByCharacter.Find(Character);
+	return Slot && History.Rewind(*Slot, Timestamp, OutHitbox);
+}
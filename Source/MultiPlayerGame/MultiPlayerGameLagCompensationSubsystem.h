@@ -0,0 +1,109 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "MultiPlayerGameLagCompensationSubsystem.generated.h"
+
+class AMultiPlayerGameCharacter;
+
+//某个时刻角色胶囊体的位置和大小
+struct FMultiPlayerGameHitbox
+{
+	FVector Location = FVector::ZeroVector;
+	FQuat Rotation = FQuat::Identity;
+	float Radius = 0.f;
+	float HalfHeight = 0.f;
+};
+
+/**
+ * 固定大小的命中盒历史，结构体数组按 [帧][槽位] 排列：
+ * 同一帧所有角色的数据连续存放，回溯某个时刻时访问的是连续内存；
+ * 所有数组在Init时一次分配好，记录和回溯都不再分配内存，最旧的帧被循环覆盖。
+ */
+class MULTIPLAYERGAME_API FMultiPlayerGameHitboxHistory
+{
+public:
+	void Init(int32 InMaxSlots, int32 InMaxFrames);
+
+	//开始记录新的一帧，覆盖最旧的一帧
+	void BeginFrame(double Time);
+	void Record(int32 Slot, const FVector& Location, const FQuat& Rotation, float Radius, float HalfHeight);
+
+	//槽位换给新角色时清掉旧角色的历史
+	void InvalidateSlot(int32 Slot);
+
+	//在前后两帧之间插值；早于最旧的一帧时取最旧的，晚于最新的一帧时取最新的
+	bool Rewind(int32 Slot, double Time, FMultiPlayerGameHitbox& OutHitbox) const;
+
+	int32 GetMaxSlots() const { return MaxSlots; }
+	int32 GetMaxFrames() const { return MaxFrames; }
+	int32 GetNumFrames() const { return NumFrames; }
+	double GetNewestTime() const { return NumFrames > 0 ? FrameTimes[Head] : 0.0; }
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	int32 GetIndex(int32 Frame, int32 Slot) const { return Frame * MaxSlots + Slot; }
+	void ReadHitbox(int32 Index, FMultiPlayerGameHitbox& OutHitbox) const;
+
+	int32 MaxSlots = 0;
+	int32 MaxFrames = 0;
+	int32 Head = INDEX_NONE;
+	int32 NumFrames = 0;
+
+	TArray<double> FrameTimes;
+	TArray<FVector> Locations;
+	TArray<FQuat> Rotations;
+	TArray<float> Radii;
+	TArray<float> HalfHeights;
+	TBitArray<> Valid;
+};
+
+/**
+ * 服务器上的延迟补偿：每个服务器Tick记录所有角色的胶囊体，命中判定时回溯到客户端开火时看到的时刻。
+ * 时间用服务器的世界时间，客户端用 AGameStateBase::GetServerWorldTimeSeconds 减去插值延迟后发给服务器。
+ */
+UCLASS(config = Game)
+class MULTIPLAYERGAME_API UMultiPlayerGameLagCompensationSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+
+	void RegisterCharacter(AMultiPlayerGameCharacter* Character);
+	void UnregisterCharacter(AMultiPlayerGameCharacter* Character);
+
+	//回溯到Timestamp时角色的命中盒，角色没有注册或还没有历史时返回false
+	bool RewindCharacter(const AMultiPlayerGameCharacter* Character, double Timestamp, FMultiPlayerGameHitbox& OutHitbox) const;
+
+	//保留多长时间的历史
+	UPROPERTY(Config)
+	float HistorySeconds = 1.f;
+
+	//历史最多保存多少帧，服务器帧率更高时按 HistorySeconds / MaxHistoryFrames 的间隔记录
+	UPROPERTY(Config)
+	int32 MaxHistoryFrames = 64;
+
+	//同时记录的角色数上限
+	UPROPERTY(Config)
+	int32 MaxCharacters = 128;
+
+private:
+	void RecordFrame(double Time);
+
+	FMultiPlayerGameHitboxHistory History;
+	TArray<TWeakObjectPtr<AMultiPlayerGameCharacter>> CharacterBySlot;
+	TMap<TWeakObjectPtr<const AMultiPlayerGameCharacter>, int32> SlotByCharacter;
+	TArray<int32> FreeSlots;
+	double LastRecordTime = -1.0;
+};
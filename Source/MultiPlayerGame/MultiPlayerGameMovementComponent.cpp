@@ -0,0 +1,198 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultiPlayerGameMovementComponent.h"
+#include "MultiPlayerGameStats.h"
+#include "GameFramework/Character.h"
+#include "HAL/IConsoleManager.h"
+#include "Serialization/BitWriter.h"
+#include "Serialization/BitReader.h"
+
+namespace MultiPlayerGameMovement
+{
+	static int32 CompactMoves = 1;
+	static FAutoConsoleVariableRef CVarCompactMoves(
+		TEXT("MultiPlayerGame.CompactMoves"),
+		CompactMoves,
+		TEXT("1: send quantized movement RPCs, 0: send the engine's default move format (for bandwidth comparison)."),
+		ECVF_Default);
+
+	// 服务器收到的移动RPC总位数，带宽监控按时间差计算
+	static int64 TotalReceivedMoveBits = 0;
+
+	// 每轴量化到[-127,127]
+	constexpr float AccelerationScale = 127.f;
+	constexpr uint32 PitchBits = 12;
+
+	int8 QuantizeAxis(float Value, float MaxAcceleration)
+	{
+		return static_cast<int8>(FMath::Clamp(FMath::RoundToInt(Value / MaxAcceleration * AccelerationScale), -127, 127));
+	}
+
+	float DequantizeAxis(int8 Value, float MaxAcceleration)
+	{
+		return Value * MaxAcceleration / AccelerationScale;
+	}
+}
+
+FMultiPlayerGameNetworkMoveDataContainer::FMultiPlayerGameNetworkMoveDataContainer()
+{
+	NewMoveData = &MoveData[0];
+	PendingMoveData = &MoveData[1];
+	OldMoveData = &MoveData[2];
+}
+
+bool FMultiPlayerGameNetworkMoveDataContainer::Serialize(UCharacterMovementComponent& CharacterMovement, FArchive& Ar, UPackageMap* PackageMap)
+{
+	// 引擎发送打包移动时用的是FNetBitWriter，接收时是FNetBitReader，可以直接读出写了或读了多少位
+	const bool bCountBits = Ar.IsSaving() && Ar.IsNetArchive();
+	const bool bCountReceivedBits = Ar.IsLoading() && Ar.IsNetArchive();
+	const int64 StartBits = bCountBits ? static_cast<FBitWriter&>(Ar).GetNumBits() : (bCountReceivedBits ? static_cast<FBitReader&>(Ar).GetPosBits() : 0);
+
+	const bool bSuccess = FCharacterNetworkMoveDataContainer::Serialize(CharacterMovement, Ar, PackageMap);
+
+	if (bCountReceivedBits)
+	{
+		const int64 NumBits = static_cast<FBitReader&>(Ar).GetPosBits() - StartBits;
+		MultiPlayerGameMovement::TotalReceivedMoveBits += NumBits;
+		INC_DWORD_STAT_BY(STAT_MPG_ReceivedMoveRPCBits, static_cast<int32>(NumBits));
+	}
+	if (bCountBits)
+	{
+		const int32 NumBits = static_cast<int32>(static_cast<FBitWriter&>(Ar).GetNumBits() - StartBits);
+		INC_DWORD_STAT(STAT_MPG_MoveRPCs);
+		INC_DWORD_STAT_BY(STAT_MPG_MoveRPCBits, NumBits);
+		CSV_CUSTOM_STAT(MultiPlayerGame, MoveRPCBits, NumBits, ECsvCustomStatOp::Accumulate);
+		CSV_CUSTOM_STAT(MultiPlayerGame, MoveRPCs, 1, ECsvCustomStatOp::Accumulate);
+	}
+	return bSuccess;
+}
+
+bool FMultiPlayerGameNetworkMoveData::Serialize(UCharacterMovementComponent& CharacterMovement, FArchive& Ar, UPackageMap* PackageMap, ENetworkMoveType MoveType)
+{
+	const bool bIsSaving = Ar.IsSaving();
+	bool bCompact = bIsSaving ? UMultiPlayerGameMovementComponent::UseCompactMoves() : false;
+	Ar.SerializeBits(&bCompact, 1);
+	if (!bCompact)
+	{
+		return FCharacterNetworkMoveData::Serialize(CharacterMovement, Ar, PackageMap, MoveType);
+	}
+
+	NetworkMoveType = MoveType;
+	bool bLocalSuccess = true;
+	Ar << TimeStamp;
+
+	// 加速度：为零时只占1位，水平方向每轴8位，竖直方向（游泳、飞行）不为零时再加8位
+	const float MaxAcceleration = FMath::Max(CharacterMovement.GetMaxAcceleration(), KINDA_SMALL_NUMBER);
+	int8 AccelX = bIsSaving ? MultiPlayerGameMovement::QuantizeAxis(Acceleration.X, MaxAcceleration) : 0;
+	int8 AccelY = bIsSaving ? MultiPlayerGameMovement::QuantizeAxis(Acceleration.Y, MaxAcceleration) : 0;
+	int8 AccelZ = bIsSaving ? MultiPlayerGameMovement::QuantizeAxis(Acceleration.Z, MaxAcceleration) : 0;
+	bool bHasAcceleration = (AccelX | AccelY | AccelZ) != 0;
+	bool bHasAccelerationZ = AccelZ != 0;
+	Ar.SerializeBits(&bHasAcceleration, 1);
+	if (bHasAcceleration)
+	{
+		Ar << AccelX;
+		Ar << AccelY;
+		Ar.SerializeBits(&bHasAccelerationZ, 1);
+		if (bHasAccelerationZ)
+		{
+			Ar << AccelZ;
+		}
+	}
+	if (!bIsSaving)
+	{
+		Acceleration = FVector(
+			MultiPlayerGameMovement::DequantizeAxis(AccelX, MaxAcceleration),
+			MultiPlayerGameMovement::DequantizeAxis(AccelY, MaxAcceleration),
+			MultiPlayerGameMovement::DequantizeAxis(AccelZ, MaxAcceleration));
+	}
+
+	Location.NetSerialize(Ar, PackageMap, bLocalSuccess);
+
+	// 控制旋转：玩家控制器不会有Roll，Pitch只需要12位（约0.09度）
+	uint16 Yaw = bIsSaving ? FRotator::CompressAxisToShort(ControlRotation.Yaw) : 0;
+	uint32 Pitch = bIsSaving ? (FMath::RoundToInt(FRotator::ClampAxis(ControlRotation.Pitch) * (1 << MultiPlayerGameMovement::PitchBits) / 360.f) & ((1 << MultiPlayerGameMovement::PitchBits) - 1)) : 0;
+	Ar << Yaw;
+	Ar.SerializeBits(&Pitch, MultiPlayerGameMovement::PitchBits);
+	if (!bIsSaving)
+	{
+		ControlRotation = FRotator(
+			FRotator::NormalizeAxis(Pitch * 360.f / (1 << MultiPlayerGameMovement::PitchBits)),
+			FRotator::DecompressAxisFromShort(Yaw),
+			0.f);
+	}
+
+	SerializeOptionalValue<uint8>(bIsSaving, Ar, CompressedMoveFlags, 0);
+
+	if (MoveType == ENetworkMoveType::NewMove)
+	{
+		// 和引擎一样，基座和移动模式只用于校验最后一个移动
+		SerializeOptionalValue<UPrimitiveComponent*>(bIsSaving, Ar, MovementBase, nullptr);
+		SerializeOptionalValue<FName>(bIsSaving, Ar, MovementBaseBoneName, NAME_None);
+		SerializeOptionalValue<uint8>(bIsSaving, Ar, MovementMode, MOVE_Walking);
+	}
+
+	return !Ar.IsError();
+}
+
+FMultiPlayerGameSavedMove::FMultiPlayerGameSavedMove()
+{
+	// 引擎默认0.996，放宽后方向只有细微变化的相邻移动也能合并成一个
+	AccelDotThresholdCombine = 0.99f;
+}
+
+void FMultiPlayerGameSavedMove::SetMoveFor(ACharacter* C, float InDeltaTime, FVector const& NewAccel, FNetworkPredictionData_Client_Character& ClientData)
+{
+	FSavedMove_Character::SetMoveFor(C, InDeltaTime, NewAccel, ClientData);
+
+	// ReplicateMoveToServer会把组件的加速度设成这里保存的值，客户端就用量化后的加速度模拟
+	if (UMultiPlayerGameMovementComponent::UseCompactMoves() && C && C->GetCharacterMovement())
+	{
+		Acceleration = UMultiPlayerGameMovementComponent::QuantizeAcceleration(Acceleration, C->GetCharacterMovement()->GetMaxAcceleration());
+	}
+}
+
+FMultiPlayerGameNetworkPredictionData_Client::FMultiPlayerGameNetworkPredictionData_Client(const UCharacterMovementComponent& ClientMovement)
+	: FNetworkPredictionData_Client_Character(ClientMovement)
+{
+}
+
+FSavedMovePtr FMultiPlayerGameNetworkPredictionData_Client::AllocateNewMove()
+{
+	return FSavedMovePtr(new FMultiPlayerGameSavedMove());
+}
+
+UMultiPlayerGameMovementComponent::UMultiPlayerGameMovementComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	SetNetworkMoveDataContainer(CompactMoveDataContainer);
+}
+
+FNetworkPredictionData_Client* UMultiPlayerGameMovementComponent::GetPredictionData_Client() const
+{
+	if (ClientPredictionData == nullptr)
+	{
+		UMultiPlayerGameMovementComponent* MutableThis = const_cast<UMultiPlayerGameMovementComponent*>(this);
+		MutableThis->ClientPredictionData = new FMultiPlayerGameNetworkPredictionData_Client(*this);
+	}
+	return ClientPredictionData;
+}
+
+bool UMultiPlayerGameMovementComponent::UseCompactMoves()
+{
+	return MultiPlayerGameMovement::CompactMoves != 0;
+}
+
+FVector UMultiPlayerGameMovementComponent::QuantizeAcceleration(const FVector& Acceleration, float MaxAcceleration)
+{
+	MaxAcceleration = FMath::Max(MaxAcceleration, KINDA_SMALL_NUMBER);
+	return FVector(
+		MultiPlayerGameMovement::DequantizeAxis(MultiPlayerGameMovement::QuantizeAxis(Acceleration.X, MaxAcceleration), MaxAcceleration),
+		MultiPlayerGameMovement::DequantizeAxis(MultiPlayerGameMovement::QuantizeAxis(Acceleration.Y, MaxAcceleration), MaxAcceleration),
+		MultiPlayerGameMovement::DequantizeAxis(MultiPlayerGameMovement::QuantizeAxis(Acceleration.Z, MaxAcceleration), MaxAcceleration));
+}
+
+int64 UMultiPlayerGameMovementComponent::GetTotalReceivedMoveBits()
+{
+	return MultiPlayerGameMovement::TotalReceivedMoveBits;
+}
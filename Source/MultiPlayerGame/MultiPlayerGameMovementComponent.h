@@ -0,0 +1,73 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "MultiPlayerGameMovementComponent.generated.h"
+
+/**
+ * 压缩过的移动数据：加速度按最大加速度量化成每轴8位，控制旋转只发Yaw(16位)和Pitch(12位)。
+ * 每个移动先写1位格式标记，客户端可以用 MultiPlayerGame.CompactMoves 0/1 切回引擎默认格式对比带宽，服务器两种都能读。
+ */
+struct FMultiPlayerGameNetworkMoveData : public FCharacterNetworkMoveData
+{
+	virtual bool Serialize(UCharacterMovementComponent& CharacterMovement, FArchive& Ar, UPackageMap* PackageMap, ENetworkMoveType MoveType) override;
+};
+
+/**
+ * 一次RPC里打包几个移动沿用引擎的做法：新移动、等待合并的移动和需要重发的旧移动，最多3个。
+ * 这里只压缩每个移动的位数，没有往一次RPC里塞更多移动，也没有降低发送频率（ClientNetSendMoveDeltaTime用引擎默认值）。
+ */
+struct FMultiPlayerGameNetworkMoveDataContainer : public FCharacterNetworkMoveDataContainer
+{
+	FMultiPlayerGameNetworkMoveDataContainer();
+
+	// 在父类的基础上统计每次发出去的位数
+	virtual bool Serialize(UCharacterMovementComponent& CharacterMovement, FArchive& Ar, UPackageMap* PackageMap) override;
+
+	FMultiPlayerGameNetworkMoveData MoveData[3];
+};
+
+/**
+ * 客户端保存的移动：加速度在保存时就量化，这样客户端本地模拟用的和服务器收到的完全一致，不会因为量化产生纠正；
+ * 合并相邻移动的方向阈值也放宽了一些。
+ */
+class FMultiPlayerGameSavedMove : public FSavedMove_Character
+{
+public:
+	FMultiPlayerGameSavedMove();
+
+	virtual void SetMoveFor(ACharacter* C, float InDeltaTime, FVector const& NewAccel, class FNetworkPredictionData_Client_Character& ClientData) override;
+};
+
+class FMultiPlayerGameNetworkPredictionData_Client : public FNetworkPredictionData_Client_Character
+{
+public:
+	explicit FMultiPlayerGameNetworkPredictionData_Client(const UCharacterMovementComponent& ClientMovement);
+
+	virtual FSavedMovePtr AllocateNewMove() override;
+};
+
+/**
+ * 角色的移动组件，只改了客户端发给服务器的移动RPC的打包方式，移动逻辑和引擎的一样
+ */
+UCLASS()
+class MULTIPLAYERGAME_API UMultiPlayerGameMovementComponent : public UCharacterMovementComponent
+{
+	GENERATED_BODY()
+
+public:
+	UMultiPlayerGameMovementComponent(const FObjectInitializer& ObjectInitializer);
+
+	virtual FNetworkPredictionData_Client* GetPredictionData_Client() const override;
+
+	static bool UseCompactMoves();
+	static FVector QuantizeAcceleration(const FVector& Acceleration, float MaxAcceleration);
+
+	//服务器上从所有连接收到的移动RPC总位数
+	static int64 GetTotalReceivedMoveBits();
+
+private:
+	FMultiPlayerGameNetworkMoveDataContainer CompactMoveDataContainer;
+};
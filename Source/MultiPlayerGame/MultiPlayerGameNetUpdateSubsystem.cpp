@@ -0,0 +1,162 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultiPlayerGameNetUpdateSubsystem.h"
+#include "MultiPlayerGameCharacter.h"
+#include "MultiPlayerGameReplicationGraph.h"
+#include "MultiPlayerGameStats.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/PlayerController.h"
+
+bool UMultiPlayerGameNetUpdateSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	// 编辑器预览之类的世界不需要
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld() && Super::ShouldCreateSubsystem(Outer);
+}
+
+void UMultiPlayerGameNetUpdateSubsystem::Deinitialize()
+{
+	CharacterStates.Empty();
+	Viewers.Empty();
+	Super::Deinitialize();
+}
+
+bool UMultiPlayerGameNetUpdateSubsystem::IsTickable() const
+{
+	// 只有服务器需要调度，客户端和单机直接跳过
+	const UWorld* World = GetWorld();
+	return !IsTemplate() && World && (World->GetNetMode() == NM_DedicatedServer || World->GetNetMode() == NM_ListenServer);
+}
+
+TStatId UMultiPlayerGameNetUpdateSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMultiPlayerGameNetUpdateSubsystem, STATGROUP_Tickables);
+}
+
+void UMultiPlayerGameNetUpdateSubsystem::Tick(float DeltaTime)
+{
+	TimeUntilUpdate -= DeltaTime;
+	if (TimeUntilUpdate > 0.f)
+	{
+		return;
+	}
+	TimeUntilUpdate = UpdateInterval;
+	UpdateCharacters();
+}
+
+void UMultiPlayerGameNetUpdateSubsystem::UpdateCharacters()
+{
+	SCOPE_CYCLE_COUNTER(STAT_MPG_NetUpdateScheduler);
+	CSV_SCOPED_TIMING_STAT(MultiPlayerGame, NetUpdateScheduler);
+
+	UWorld* World = GetWorld();
+	UNetDriver* NetDriver = World->GetNetDriver();
+	if (NetDriver == nullptr)
+	{
+		return;
+	}
+	UMultiPlayerGameReplicationGraph* RepGraph = NetDriver->GetReplicationDriver<UMultiPlayerGameReplicationGraph>();
+
+	// 观察者只算远端连接，监听服务器房主在本机不走网络
+	Viewers.Reset();
+	for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It; ++It)
+	{
+		APlayerController* PC = It->Get();
+		if (PC == nullptr || PC->IsLocalController() || PC->GetNetConnection() == nullptr)
+		{
+			continue;
+		}
+		FViewer& Viewer = Viewers.AddDefaulted_GetRef();
+		FRotator ViewRotation;
+		PC->GetPlayerViewPoint(Viewer.Location, ViewRotation);
+		Viewer.Direction = ViewRotation.Vector();
+		Viewer.Connection = PC->GetNetConnection();
+		Viewer.Pawn = PC->GetPawn();
+	}
+
+	const float Now = World->GetTimeSeconds();
+	float TotalFrequency = 0.f;
+	int32 NumCharacters = 0;
+	int32 NumIdle = 0;
+
+	for (AMultiPlayerGameCharacter* Character : TActorRange<AMultiPlayerGameCharacter>(World))
+	{
+		if (Character->IsPendingKill())
+		{
+			continue;
+		}
+
+		FCharacterState& State = CharacterStates.FindOrAdd(Character);
+		if (Character->GetVelocity().SizeSquared() > FMath::Square(IdleSpeed))
+		{
+			State.LastMovingTime = Now;
+		}
+		const bool bWasIdle = State.bIdle;
+		State.bIdle = Now - State.LastMovingTime > IdleTime;
+
+		float CharacterFrequency = MinNetUpdateFrequency;
+		for (const FViewer& Viewer : Viewers)
+		{
+			// 自己控制的角色靠移动RPC纠正位置，不参与调度
+			if (Viewer.Pawn == Character)
+			{
+				continue;
+			}
+			const float Frequency = ComputeFrequency(Character, Viewer, State.bIdle);
+			if (RepGraph)
+			{
+				RepGraph->SetActorReplicationFrequency(Character, Viewer.Connection, Frequency);
+			}
+			CharacterFrequency = FMath::Max(CharacterFrequency, Frequency);
+		}
+
+		Character->NetUpdateFrequency = CharacterFrequency;
+		Character->MinNetUpdateFrequency = FMath::Min(MinNetUpdateFrequency, CharacterFrequency);
+		if (bWasIdle && !State.bIdle)
+		{
+			Character->ForceNetUpdate();
+		}
+
+		TotalFrequency += CharacterFrequency;
+		++NumCharacters;
+		NumIdle += State.bIdle ? 1 : 0;
+	}
+
+	// 清掉已经销毁的角色
+	for (auto It = CharacterStates.CreateIterator(); It; ++It)
+	{
+		if (!It.Key().IsValid())
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	const float AverageFrequency = NumCharacters > 0 ? TotalFrequency / NumCharacters : 0.f;
+	SET_FLOAT_STAT(STAT_MPG_AverageCharacterNetUpdateFrequency, AverageFrequency);
+	SET_DWORD_STAT(STAT_MPG_IdleCharacters, NumIdle);
+	CSV_CUSTOM_STAT(MultiPlayerGame, AverageCharacterNetUpdateFrequency, AverageFrequency, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(MultiPlayerGame, IdleCharacters, NumIdle, ECsvCustomStatOp::Set);
+}
+
+float UMultiPlayerGameNetUpdateSubsystem::ComputeFrequency(const AMultiPlayerGameCharacter* Character, const FViewer& Viewer, bool bIdle) const
+{
+	const FVector ToCharacter = Character->GetActorLocation() - Viewer.Location;
+	const float Distance = ToCharacter.Size();
+
+	// 距离：近处为1，远处为0
+	float Significance = 1.f - FMath::Clamp((Distance - NearDistance) / FMath::Max(FarDistance - NearDistance, 1.f), 0.f, 1.f);
+
+	// 近处的角色即使在身后也保持原样，转身时不会看到它卡顿
+	if (Distance > NearDistance && FVector::DotProduct(ToCharacter / Distance, Viewer.Direction) < ViewConeCos)
+	{
+		Significance *= OutOfViewScale;
+	}
+	if (bIdle)
+	{
+		Significance *= IdleScale;
+	}
+
+	return FMath::Lerp(MinNetUpdateFrequency, MaxNetUpdateFrequency, Significance);
+}
@@ -0,0 +1,89 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "MultiPlayerGameNetUpdateSubsystem.generated.h"
+
+class AMultiPlayerGameCharacter;
+
+/**
+ * 服务器上按重要度调整角色的复制频率：
+ * 对每个观察者（远端玩家控制器）按距离、是否在视野前方、角色最近是否在动算出一个频率，
+ * 用了复制图时按连接分别设置，没有复制图时取所有观察者里最高的频率写到NetUpdateFrequency；
+ * 角色从静止开始移动时ForceNetUpdate，避免起步被低频率延迟。
+ */
+UCLASS(config = Game)
+class MULTIPLAYERGAME_API UMultiPlayerGameNetUpdateSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+
+	//多久重新计算一次，不需要每帧
+	UPROPERTY(Config)
+	float UpdateInterval = 0.25f;
+
+	//最高、最低复制频率，最高的应该和复制图里的CharacterNetUpdateFrequency一致
+	UPROPERTY(Config)
+	float MaxNetUpdateFrequency = 100.f;
+
+	UPROPERTY(Config)
+	float MinNetUpdateFrequency = 4.f;
+
+	//近于NearDistance按最高频率，远于FarDistance按最低频率，中间线性插值
+	UPROPERTY(Config)
+	float NearDistance = 1500.f;
+
+	UPROPERTY(Config)
+	float FarDistance = 15000.f;
+
+	//在观察者身后（视野外）时的系数
+	UPROPERTY(Config)
+	float OutOfViewScale = 0.5f;
+
+	//速度低于IdleSpeed超过IdleTime秒算静止，静止时的系数
+	UPROPERTY(Config)
+	float IdleSpeed = 10.f;
+
+	UPROPERTY(Config)
+	float IdleTime = 1.f;
+
+	UPROPERTY(Config)
+	float IdleScale = 0.25f;
+
+	//视野的半角余弦，点积小于它算视野外
+	UPROPERTY(Config)
+	float ViewConeCos = 0.5f;
+
+private:
+	struct FViewer
+	{
+		UNetConnection* Connection = nullptr;
+		APawn* Pawn = nullptr;
+		FVector Location = FVector::ZeroVector;
+		FVector Direction = FVector::ForwardVector;
+	};
+
+	struct FCharacterState
+	{
+		float LastMovingTime = 0.f;
+		bool bIdle = false;
+	};
+
+	void UpdateCharacters();
+	float ComputeFrequency(const AMultiPlayerGameCharacter* Character, const FViewer& Viewer, bool bIdle) const;
+
+	TMap<TWeakObjectPtr<AMultiPlayerGameCharacter>, FCharacterState> CharacterStates;
+	TArray<FViewer> Viewers;
+	float TimeUntilUpdate = 0.f;
+};
@@ -0,0 +1,185 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultiPlayerGamePawnPoolSubsystem.h"
+#include "MultiPlayerGameCharacter.h"
+#include "MultiPlayerGameStats.h"
+#include "Engine/World.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/Controller.h"
+#include "Components/SkeletalMeshComponent.h"
+
+bool UMultiPlayerGamePawnPoolSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld() && Super::ShouldCreateSubsystem(Outer);
+}
+
+void UMultiPlayerGamePawnPoolSubsystem::Deinitialize()
+{
+	// 跳转地图时世界会销毁所有Actor，这里只清引用
+	PooledPawns.Empty();
+	SET_DWORD_STAT(STAT_MPG_PawnPoolSize, 0);
+	Super::Deinitialize();
+}
+
+void UMultiPlayerGamePawnPoolSubsystem::Prewarm(UClass* PawnClass)
+{
+	UWorld* World = GetWorld();
+	if (PawnClass == nullptr || World == nullptr || World->GetNetMode() == NM_Client)
+	{
+		return;
+	}
+
+	int32 NumPooled = 0;
+	for (const APawn* Pawn : PooledPawns)
+	{
+		NumPooled += (Pawn && Pawn->GetClass() == PawnClass) ? 1 : 0;
+	}
+	for (; NumPooled < FMath::Min(PrewarmCount, MaxPooledPawns); ++NumPooled)
+	{
+		if (APawn* Pawn = SpawnPooledPawn(PawnClass))
+		{
+			SetPawnPooled(Pawn, true);
+			PooledPawns.Add(Pawn);
+		}
+	}
+	SET_DWORD_STAT(STAT_MPG_PawnPoolSize, PooledPawns.Num());
+}
+
+APawn* UMultiPlayerGamePawnPoolSubsystem::SpawnPooledPawn(UClass* PawnClass)
+{
+	const double StartTime = FPlatformTime::Seconds();
+	// 预热的Pawn在取出前不复制，客户端连进来时不会收到一堆隐藏的角色
+	const FTransform SpawnTransform(ParkingLocation);
+	APawn* Pawn = GetWorld()->SpawnActorDeferred<APawn>(PawnClass, SpawnTransform, nullptr, nullptr, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+	if (Pawn)
+	{
+		Pawn->SetReplicates(false);
+		// BeginPlay之前就标成在池里，BeginPlay不会去注册回溯和动画重要度，免得注册完马上又注销
+		if (AMultiPlayerGameCharacter* GameCharacter = Cast<AMultiPlayerGameCharacter>(Pawn))
+		{
+			GameCharacter->SetPooled(true);
+		}
+		Pawn->FinishSpawning(SpawnTransform);
+	}
+	TotalSpawnSeconds += FPlatformTime::Seconds() - StartTime;
+	++NumSpawns;
+	return Pawn;
+}
+
+APawn* UMultiPlayerGamePawnPoolSubsystem::AcquireOrSpawn(UClass* PawnClass, const FTransform& SpawnTransform, TFunctionRef<APawn*()> SpawnFresh)
+{
+	const double StartTime = FPlatformTime::Seconds();
+
+	// 从后往前找，取出的是最近收回的
+	int32 PoolIndex = INDEX_NONE;
+	for (int32 Index = PooledPawns.Num() - 1; Index >= 0; --Index)
+	{
+		if (IsValid(PooledPawns[Index]) && PooledPawns[Index]->GetClass() == PawnClass)
+		{
+			PoolIndex = Index;
+			break;
+		}
+	}
+
+	if (PoolIndex == INDEX_NONE)
+	{
+		APawn* Pawn = SpawnFresh();
+		const double SpawnSeconds = FPlatformTime::Seconds() - StartTime;
+		TotalSpawnSeconds += SpawnSeconds;
+		++NumSpawns;
+		INC_DWORD_STAT(STAT_MPG_PawnPoolMisses);
+		SET_FLOAT_STAT(STAT_MPG_PawnSpawnMs, SpawnSeconds * 1000.0);
+		CSV_CUSTOM_STAT(MultiPlayerGame, PawnSpawnMs, static_cast<float>(SpawnSeconds * 1000.0), ECsvCustomStatOp::Set);
+		return Pawn;
+	}
+
+	APawn* Pawn = PooledPawns[PoolIndex];
+	PooledPawns.RemoveAtSwap(PoolIndex);
+	Pawn->SetActorTransform(SpawnTransform, false, nullptr, ETeleportType::ResetPhysics);
+	SetPawnPooled(Pawn, false);
+
+	const double AcquireSeconds = FPlatformTime::Seconds() - StartTime;
+	const double AverageSpawnSeconds = NumSpawns > 0 ? TotalSpawnSeconds / NumSpawns : 0.0;
+	INC_DWORD_STAT(STAT_MPG_PawnPoolHits);
+	SET_DWORD_STAT(STAT_MPG_PawnPoolSize, PooledPawns.Num());
+	SET_FLOAT_STAT(STAT_MPG_PawnPoolAcquireMs, AcquireSeconds * 1000.0);
+	INC_FLOAT_STAT_BY(STAT_MPG_PawnPoolSavedMs, FMath::Max(0.0, AverageSpawnSeconds - AcquireSeconds) * 1000.0);
+	CSV_CUSTOM_STAT(MultiPlayerGame, PawnPoolAcquireMs, static_cast<float>(AcquireSeconds * 1000.0), ECsvCustomStatOp::Set);
+	return Pawn;
+}
+
+void UMultiPlayerGamePawnPoolSubsystem::ReleasePawn(APawn* Pawn)
+{
+	if (!IsValid(Pawn) || PooledPawns.Contains(Pawn))
+	{
+		return;
+	}
+	if (PooledPawns.Num() >= MaxPooledPawns)
+	{
+		Pawn->Destroy();
+		return;
+	}
+	SetPawnPooled(Pawn, true);
+	Pawn->SetActorLocation(ParkingLocation, false, nullptr, ETeleportType::ResetPhysics);
+	PooledPawns.Add(Pawn);
+	SET_DWORD_STAT(STAT_MPG_PawnPoolSize, PooledPawns.Num());
+}
+
+void UMultiPlayerGamePawnPoolSubsystem::ReleaseControllerPawn(AController* Controller)
+{
+	APawn* Pawn = Controller ? Controller->GetPawn() : nullptr;
+	if (Pawn == nullptr)
+	{
+		return;
+	}
+	// 先解除控制，控制器销毁时就不会再去销毁这个Pawn
+	Controller->UnPossess();
+	ReleasePawn(Pawn);
+}
+
+void UMultiPlayerGamePawnPoolSubsystem::SetPawnPooled(APawn* Pawn, bool bPooled)
+{
+	Pawn->SetActorHiddenInGame(bPooled);
+	Pawn->SetActorEnableCollision(!bPooled);
+	Pawn->SetActorTickEnabled(!bPooled);
+
+	if (ACharacter* Character = Cast<ACharacter>(Pawn))
+	{
+		UCharacterMovementComponent* Movement = Character->GetCharacterMovement();
+		if (bPooled)
+		{
+			Character->StopJumping();
+			Movement->StopMovementImmediately();
+			Movement->Deactivate();
+		}
+		else
+		{
+			Movement->Activate(true);
+			Movement->SetMovementMode(Movement->DefaultLandMovementMode);
+		}
+		Character->GetMesh()->SetComponentTickEnabled(!bPooled);
+	}
+	// 客户端靠复制下去的bPooled停掉动画
+	if (AMultiPlayerGameCharacter* GameCharacter = Cast<AMultiPlayerGameCharacter>(Pawn))
+	{
+		GameCharacter->SetPooled(bPooled);
+	}
+
+	if (!bPooled && !Pawn->GetIsReplicated())
+	{
+		// 预热的Pawn第一次取出，从这里开始复制
+		Pawn->SetReplicates(true);
+	}
+	if (!Pawn->GetIsReplicated())
+	{
+		return;
+	}
+	// 休眠前会把隐藏状态再复制一次，之后不再占用任何连接的复制开销
+	Pawn->SetNetDormancy(bPooled ? DORM_DormantAll : DORM_Awake);
+	if (!bPooled)
+	{
+		Pawn->ForceNetUpdate();
+	}
+}
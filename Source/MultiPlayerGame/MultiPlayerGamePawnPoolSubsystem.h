@@ -0,0 +1,59 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Templates/Function.h"
+#include "MultiPlayerGamePawnPoolSubsystem.generated.h"
+
+/**
+ * 服务器上的Pawn池：地图加载时先生成一批隐藏的角色，玩家登录、无缝跳转后重生、掉出世界后重生时直接从池里取，
+ * 登出和掉出世界时收回池里，避免一整个大厅同时跳转时每人都要实例化一次蓝图角色。
+ * 池里的Pawn隐藏、关碰撞、关Tick；预热生成的Pawn取出前不复制，收回的Pawn进入休眠，不再占用复制开销。
+ */
+UCLASS(config = Game)
+class MULTIPLAYERGAME_API UMultiPlayerGamePawnPoolSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Deinitialize() override;
+
+	//预先生成Pawn，直到池里这个类的Pawn达到PrewarmCount个
+	void Prewarm(UClass* PawnClass);
+
+	//给GameMode的SpawnDefaultPawnAtTransform用：池里有就直接取出，没有就调用SpawnFresh并记录耗时
+	APawn* AcquireOrSpawn(UClass* PawnClass, const FTransform& SpawnTransform, TFunctionRef<APawn*()> SpawnFresh);
+
+	//把Pawn收回池里，池满了就销毁；调用前要先UnPossess
+	void ReleasePawn(APawn* Pawn);
+
+	//给玩家控制器的PawnLeavingGame和掉出世界时用，收回控制器的Pawn
+	void ReleaseControllerPawn(AController* Controller);
+
+	bool IsPawnPooled(const APawn* Pawn) const { return PooledPawns.Contains(Pawn); }
+
+	UPROPERTY(Config)
+	int32 PrewarmCount = 8;
+
+	//超过这个数量的Pawn收回时直接销毁
+	UPROPERTY(Config)
+	int32 MaxPooledPawns = 32;
+
+	//池里的Pawn停放的位置，要在所有玩家的剔除距离以外
+	UPROPERTY(Config)
+	FVector ParkingLocation = FVector(0.f, 0.f, 100000.f);
+
+private:
+	APawn* SpawnPooledPawn(UClass* PawnClass);
+	void SetPawnPooled(APawn* Pawn, bool bPooled);
+
+	UPROPERTY(Transient)
+	TArray<APawn*> PooledPawns;
+
+	//新生成一个Pawn的平均耗时，用来估算池子省下的时间
+	double TotalSpawnSeconds = 0.0;
+	int32 NumSpawns = 0;
+};
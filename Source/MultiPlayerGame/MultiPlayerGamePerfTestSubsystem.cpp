@@ -0,0 +1,458 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultiPlayerGamePerfTestSubsystem.h"
+#include "MultiPlayerGameCharacter.h"
+#include "MultiPlayerGameStats.h"
+#include "Engine/World.h"
+#include "Engine/Level.h"
+#include "Animation/AnimInstance.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/PlayerController.h"
+#include "Misc/PackageName.h"
+#include "GameMapsSettings.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "RenderCore.h"
+#include "RHI.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonWriter.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace MultiPlayerGamePerfTest
+{
+	static const ETickingGroup TickGroups[] = { TG_PrePhysics, TG_StartPhysics, TG_DuringPhysics, TG_EndPhysics, TG_PostPhysics, TG_PostUpdateWork };
+	static const TCHAR* TickGroupNames[] = { TEXT("PrePhysics"), TEXT("StartPhysics"), TEXT("DuringPhysics"), TEXT("EndPhysics"), TEXT("PostPhysics"), TEXT("PostUpdateWork") };
+
+	static TArray<int32> ParseCounts(const FString& Value)
+	{
+		TArray<FString> Parts;
+		Value.ParseIntoArray(Parts, TEXT(","));
+		TArray<int32> Counts;
+		for (const FString& Part : Parts)
+		{
+			Counts.Add(FMath::Max(1, FCString::Atoi(*Part)));
+		}
+		return Counts;
+	}
+
+	static void WriteStats(const TSharedRef<FJsonObject>& Report, const TCHAR* Name, TArray<float>& Values)
+	{
+		if (Values.Num() == 0)
+		{
+			return;
+		}
+		Values.Sort();
+		double Sum = 0.0;
+		for (float Value : Values)
+		{
+			Sum += Value;
+		}
+		auto Percentile = [&Values](float P) { return Values[FMath::Clamp(FMath::FloorToInt(P * (Values.Num() - 1)), 0, Values.Num() - 1)]; };
+
+		TSharedRef<FJsonObject> Stats = MakeShared<FJsonObject>();
+		Stats->SetNumberField(TEXT("avg"), Sum / Values.Num());
+		Stats->SetNumberField(TEXT("p50"), Percentile(0.5f));
+		Stats->SetNumberField(TEXT("p95"), Percentile(0.95f));
+		Stats->SetNumberField(TEXT("p99"), Percentile(0.99f));
+		Stats->SetNumberField(TEXT("max"), Values.Last());
+		Report->SetObjectField(Name, Stats);
+	}
+}
+
+void FMultiPlayerGamePerfTestTickMarker::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if (Subsystem)
+	{
+		Subsystem->MarkTickGroupStart(GroupIndex);
+	}
+}
+
+FString FMultiPlayerGamePerfTestTickMarker::DiagnosticMessage()
+{
+	return FString::Printf(TEXT("MultiPlayerGamePerfTestTickMarker[%d]"), GroupIndex);
+}
+
+bool UMultiPlayerGamePerfTestSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld() && !IsRunningDedicatedServer() && Super::ShouldCreateSubsystem(Outer);
+}
+
+void UMultiPlayerGamePerfTestSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	ReportDir = FPaths::ProjectSavedDir() / TEXT("PerfTest");
+	FParse::Value(FCommandLine::Get(), TEXT("PerfTestDir="), ReportDir);
+	FString AnimClassPath;
+	if (FParse::Value(FCommandLine::Get(), TEXT("PerfTestAnimClass="), AnimClassPath))
+	{
+		AnimClassOverride = LoadClass<UAnimInstance>(nullptr, *AnimClassPath);
+		if (AnimClassOverride == nullptr)
+		{
+			UE_LOG(LogTemp, Error, TEXT("PerfTest: anim class %s not found"), *AnimClassPath);
+		}
+	}
+
+	FString CountsValue;
+	if (FParse::Value(FCommandLine::Get(), TEXT("PerfTest="), CountsValue))
+	{
+		FString MapName;
+		if (!FParse::Value(FCommandLine::Get(), TEXT("PerfTestMap="), MapName))
+		{
+			UE_LOG(LogTemp, Error, TEXT("PerfTest: -PerfTest needs -PerfTestMap=<map>, the same map opened on the command line"));
+			FPlatformMisc::RequestExitWithStatus(false, 1);
+			return;
+		}
+		if (!IsPerfTestMap(MapName))
+		{
+			// 启动时先打开的过渡图等不测；打开的不是指定的图说明地图路径写错了
+			if (UWorld::RemovePIEPrefix(GetWorld()->GetOutermost()->GetName()) == UGameMapsSettings::GetGameDefaultMap())
+			{
+				UE_LOG(LogTemp, Error, TEXT("PerfTest: opened the default map %s instead of %s"), *GetWorld()->GetMapName(), *MapName);
+				FPlatformMisc::RequestExitWithStatus(false, 1);
+			}
+			return;
+		}
+		float Seconds = DefaultSeconds;
+		FParse::Value(FCommandLine::Get(), TEXT("PerfTestSeconds="), Seconds);
+		StartPerfTest(MultiPlayerGamePerfTest::ParseCounts(CountsValue), Seconds, true);
+	}
+}
+
+void UMultiPlayerGamePerfTestSubsystem::Deinitialize()
+{
+	UnregisterTickMarkers();
+	SpawnedCharacters.Empty();
+	Super::Deinitialize();
+}
+
+bool UMultiPlayerGamePerfTestSubsystem::IsTickable() const
+{
+	return !IsTemplate() && (Phase != EPhase::Idle || PendingCounts.Num() > 0);
+}
+
+TStatId UMultiPlayerGamePerfTestSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMultiPlayerGamePerfTestSubsystem, STATGROUP_Tickables);
+}
+
+void UMultiPlayerGamePerfTestSubsystem::StartPerfTest(const TArray<int32>& CharacterCounts, float Seconds, bool bInExitWhenDone)
+{
+	PendingCounts = CharacterCounts;
+	RunSeconds = Seconds > 0.f ? Seconds : DefaultSeconds;
+	bExitWhenDone = bInExitWhenDone;
+}
+
+void UMultiPlayerGamePerfTestSubsystem::Tick(float DeltaTime)
+{
+	if (Phase == EPhase::Idle)
+	{
+		// 等地图上的GameMode准备好再开始下一轮
+		if (PendingCounts.Num() > 0 && GetWorld()->HasBegunPlay())
+		{
+			StartRun();
+		}
+		return;
+	}
+
+	DriveCharacters(DeltaTime);
+	PhaseTime += DeltaTime;
+	if (Phase == EPhase::Warmup)
+	{
+		if (PhaseTime >= WarmupSeconds)
+		{
+			Phase = EPhase::Measure;
+			PhaseTime = 0.f;
+			FrameSamples.Reset();
+			FMemory::Memzero(TickGroupTotalMs);
+			NumTickGroupFrames = 0;
+#if CSV_PROFILER
+			FCsvProfiler::Get()->BeginCapture(-1, FString(), FString::Printf(TEXT("PerfTest_%s_%d.csv"), *GetWorld()->GetMapName(), CurrentCount));
+#endif
+		}
+		return;
+	}
+
+	RecordFrame(DeltaTime);
+	if (PhaseTime >= RunSeconds)
+	{
+		FinishRun();
+	}
+}
+
+bool UMultiPlayerGamePerfTestSubsystem::IsPerfTestMap(FString MapName) const
+{
+	// 允许带URL参数（?game=...），只比较地图本身；短名和完整包名都可以
+	int32 OptionsStart = INDEX_NONE;
+	if (MapName.FindChar(TEXT('?'), OptionsStart))
+	{
+		MapName.LeftInline(OptionsStart);
+	}
+	const FString PackageName = UWorld::RemovePIEPrefix(GetWorld()->GetOutermost()->GetName());
+	return MapName.Contains(TEXT("/"))
+		? PackageName.Equals(MapName, ESearchCase::IgnoreCase)
+		: FPackageName::GetShortName(PackageName).Equals(MapName, ESearchCase::IgnoreCase);
+}
+
+void UMultiPlayerGamePerfTestSubsystem::StartRun()
+{
+	CurrentCount = PendingCounts[0];
+	PendingCounts.RemoveAt(0);
+	SpawnCharacters(CurrentCount);
+	RegisterTickMarkers();
+	Phase = EPhase::Warmup;
+	PhaseTime = 0.f;
+	ScriptTime = 0.f;
+	UE_LOG(LogTemp, Display, TEXT("PerfTest: map %s, %d x %s (controller %s, anim %s), spacing %.0f, warmup %.1fs, measure %.1fs"),
+		*GetWorld()->GetOutermost()->GetName(), CurrentCount, *PawnClassName, *ControllerClassName,
+		AnimClassOverride ? *AnimClassOverride->GetName() : TEXT("default"), CharacterSpacing, WarmupSeconds, RunSeconds);
+}
+
+void UMultiPlayerGamePerfTestSubsystem::SpawnCharacters(int32 Count)
+{
+	UWorld* World = GetWorld();
+	UClass* PawnClass = World->GetAuthGameMode() ? World->GetAuthGameMode()->DefaultPawnClass : nullptr;
+	if (PawnClass == nullptr || !PawnClass->IsChildOf<AMultiPlayerGameCharacter>())
+	{
+		PawnClass = AMultiPlayerGameCharacter::StaticClass();
+	}
+
+	// 以第一个玩家为中心排成方阵，都在视野里
+	FVector Center = FVector::ZeroVector;
+	FRotator Facing = FRotator::ZeroRotator;
+	if (APlayerController* PC = World->GetFirstPlayerController())
+	{
+		PC->GetPlayerViewPoint(Center, Facing);
+		Center += FRotator(0.f, Facing.Yaw, 0.f).Vector() * 1000.f;
+	}
+	const int32 RowSize = FMath::Max(1, FMath::CeilToInt(FMath::Sqrt(static_cast<float>(Count))));
+
+	PawnClassName = PawnClass->GetPathName();
+	ControllerClassName = TEXT("None");
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		const FVector Offset((Index / RowSize - RowSize / 2) * CharacterSpacing, (Index % RowSize - RowSize / 2) * CharacterSpacing, 0.f);
+		ACharacter* Character = World->SpawnActor<ACharacter>(PawnClass, Center + Offset, FRotator::ZeroRotator, SpawnParams);
+		if (Character)
+		{
+			// 和游戏里一样由控制器驱动；AddMovementInput的输入由移动组件在控制器存在时消费
+			Character->SpawnDefaultController();
+			if (AController* Controller = Character->GetController())
+			{
+				ControllerClassName = Controller->GetClass()->GetPathName();
+			}
+			else
+			{
+				Character->GetCharacterMovement()->bRunPhysicsWithNoController = true;
+			}
+			if (AnimClassOverride)
+			{
+				Character->GetMesh()->SetAnimInstanceClass(AnimClassOverride);
+			}
+			SpawnedCharacters.Add(Character);
+		}
+	}
+}
+
+void UMultiPlayerGamePerfTestSubsystem::DestroyCharacters()
+{
+	for (APawn* Pawn : SpawnedCharacters)
+	{
+		if (!IsValid(Pawn))
+		{
+			continue;
+		}
+		// Pawn销毁时AI控制器只会解除控制，不会跟着销毁
+		if (AController* Controller = Pawn->GetController())
+		{
+			Controller->Destroy();
+		}
+		Pawn->Destroy();
+	}
+	SpawnedCharacters.Reset();
+}
+
+void UMultiPlayerGamePerfTestSubsystem::DriveCharacters(float DeltaTime)
+{
+	// 每个角色按自己的相位绕圈，每隔几秒跳一次，动画状态机各个状态都会走到
+	const float PreviousTime = ScriptTime;
+	ScriptTime += DeltaTime;
+	for (int32 Index = 0; Index < SpawnedCharacters.Num(); ++Index)
+	{
+		ACharacter* Character = Cast<ACharacter>(SpawnedCharacters[Index]);
+		if (!IsValid(Character))
+		{
+			continue;
+		}
+		const float PhaseOffset = Index * 37.f;
+		Character->AddMovementInput(FRotator(0.f, ScriptTime * 60.f + PhaseOffset, 0.f).Vector());
+		const float JumpTime = ScriptTime + Index * 0.1f;
+		if (FMath::FloorToInt(JumpTime / 4.f) != FMath::FloorToInt((JumpTime - (ScriptTime - PreviousTime)) / 4.f))
+		{
+			Character->Jump();
+		}
+		else
+		{
+			Character->StopJumping();
+		}
+	}
+}
+
+void UMultiPlayerGamePerfTestSubsystem::RecordFrame(float DeltaTime)
+{
+	FFrameSample& Sample = FrameSamples.AddDefaulted_GetRef();
+	Sample.FrameMs = DeltaTime * 1000.f;
+	Sample.GameThreadMs = FPlatformTime::ToMilliseconds(GGameThreadTime);
+	Sample.RenderThreadMs = FPlatformTime::ToMilliseconds(GRenderThreadTime);
+	Sample.GPUMs = FPlatformTime::ToMilliseconds(RHIGetGPUFrameCycles());
+}
+
+void UMultiPlayerGamePerfTestSubsystem::FinishRun()
+{
+#if CSV_PROFILER
+	FCsvProfiler::Get()->EndCapture();
+#endif
+	UnregisterTickMarkers();
+	// 销毁前记下角色实际用的动画类，对比时确认换成了想要的那个
+	FString AnimClassName = TEXT("None");
+	const ACharacter* FirstCharacter = SpawnedCharacters.Num() > 0 ? Cast<ACharacter>(SpawnedCharacters[0]) : nullptr;
+	if (FirstCharacter && FirstCharacter->GetMesh()->GetAnimInstance())
+	{
+		AnimClassName = FirstCharacter->GetMesh()->GetAnimInstance()->GetClass()->GetPathName();
+	}
+	DestroyCharacters();
+	Phase = EPhase::Idle;
+
+	TArray<float> FrameMs;
+	TArray<float> GameThreadMs;
+	TArray<float> RenderThreadMs;
+	TArray<float> GPUMs;
+	for (const FFrameSample& Sample : FrameSamples)
+	{
+		FrameMs.Add(Sample.FrameMs);
+		GameThreadMs.Add(Sample.GameThreadMs);
+		RenderThreadMs.Add(Sample.RenderThreadMs);
+		GPUMs.Add(Sample.GPUMs);
+	}
+
+	TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+	Report->SetStringField(TEXT("map"), GetWorld()->GetOutermost()->GetName());
+	Report->SetNumberField(TEXT("characters"), CurrentCount);
+	Report->SetStringField(TEXT("pawn_class"), PawnClassName);
+	Report->SetStringField(TEXT("controller_class"), ControllerClassName);
+	Report->SetNumberField(TEXT("warmup_seconds"), WarmupSeconds);
+	Report->SetNumberField(TEXT("measure_seconds"), RunSeconds);
+	Report->SetNumberField(TEXT("character_spacing"), CharacterSpacing);
+	Report->SetNumberField(TEXT("frames"), FrameSamples.Num());
+	Report->SetStringField(TEXT("build"), FString::Printf(TEXT("%s %s"), FApp::GetBuildVersion(), LexToString(FApp::GetBuildConfiguration())));
+	Report->SetStringField(TEXT("anim_class"), AnimClassName);
+	MultiPlayerGamePerfTest::WriteStats(Report, TEXT("frame_ms"), FrameMs);
+	MultiPlayerGamePerfTest::WriteStats(Report, TEXT("game_thread_ms"), GameThreadMs);
+	MultiPlayerGamePerfTest::WriteStats(Report, TEXT("render_thread_ms"), RenderThreadMs);
+	MultiPlayerGamePerfTest::WriteStats(Report, TEXT("gpu_ms"), GPUMs);
+	TSharedRef<FJsonObject> TickGroups = MakeShared<FJsonObject>();
+	for (int32 Group = 0; Group < NumTickGroups; ++Group)
+	{
+		TickGroups->SetNumberField(MultiPlayerGamePerfTest::TickGroupNames[Group], NumTickGroupFrames > 0 ? TickGroupTotalMs[Group] / NumTickGroupFrames : 0.0);
+	}
+	Report->SetObjectField(TEXT("tick_group_avg_ms"), TickGroups);
+
+	const FString ReportPath = ReportDir / FString::Printf(TEXT("PerfTest_%s_%d.json"), *GetWorld()->GetMapName(), CurrentCount);
+	FString Json;
+	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(Report, Writer);
+	FFileHelper::SaveStringToFile(Json, *ReportPath);
+	UE_LOG(LogTemp, Display, TEXT("PerfTest: %d characters, %d frames, report %s"), CurrentCount, FrameSamples.Num(), *ReportPath);
+
+	if (PendingCounts.Num() == 0 && bExitWhenDone)
+	{
+		FPlatformMisc::RequestExit(false);
+	}
+}
+
+void UMultiPlayerGamePerfTestSubsystem::RegisterTickMarkers()
+{
+	UWorld* World = GetWorld();
+	for (int32 Group = 0; Group < NumTickGroups; ++Group)
+	{
+		FMultiPlayerGamePerfTestTickMarker& Marker = TickMarkers[Group];
+		Marker.Subsystem = this;
+		Marker.GroupIndex = Group;
+		Marker.TickGroup = MultiPlayerGamePerfTest::TickGroups[Group];
+		Marker.EndTickGroup = Marker.TickGroup;
+		// 高优先级的Tick在组里最先执行，近似这个组开始的时间
+		Marker.bHighPriority = true;
+		Marker.bCanEverTick = true;
+		Marker.bTickEvenWhenPaused = true;
+		Marker.RegisterTickFunction(World->PersistentLevel);
+		TickGroupStatNames[Group] = FName(*FString::Printf(TEXT("TickGroup_%s"), MultiPlayerGamePerfTest::TickGroupNames[Group]));
+	}
+	PostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddUObject(this, &ThisClass::OnWorldPostActorTick);
+}
+
+void UMultiPlayerGamePerfTestSubsystem::UnregisterTickMarkers()
+{
+	for (FMultiPlayerGamePerfTestTickMarker& Marker : TickMarkers)
+	{
+		if (Marker.IsTickFunctionRegistered())
+		{
+			Marker.UnRegisterTickFunction();
+		}
+	}
+	FWorldDelegates::OnWorldPostActorTick.Remove(PostActorTickHandle);
+	PostActorTickHandle.Reset();
+}
+
+void UMultiPlayerGamePerfTestSubsystem::MarkTickGroupStart(int32 GroupIndex)
+{
+	TickGroupStartTimes[GroupIndex] = FPlatformTime::Seconds();
+}
+
+void UMultiPlayerGamePerfTestSubsystem::OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+{
+	if (World != GetWorld() || Phase != EPhase::Measure)
+	{
+		return;
+	}
+	// 每个组的耗时 = 下一个组开头 - 这个组开头，最后一个组到PostActorTick为止
+	const double EndTime = FPlatformTime::Seconds();
+	for (int32 Group = 0; Group < NumTickGroups; ++Group)
+	{
+		const double GroupEnd = Group + 1 < NumTickGroups ? TickGroupStartTimes[Group + 1] : EndTime;
+		const float GroupMs = static_cast<float>(FMath::Max(0.0, GroupEnd - TickGroupStartTimes[Group]) * 1000.0);
+		TickGroupTotalMs[Group] += GroupMs;
+#if CSV_PROFILER
+		FCsvProfiler::RecordCustomStat(TickGroupStatNames[Group], CSV_CATEGORY_INDEX(MultiPlayerGame), GroupMs, ECsvCustomStatOp::Set);
+#endif
+	}
+	++NumTickGroupFrames;
+}
+
+namespace MultiPlayerGamePerfTest
+{
+	// MultiPlayerGame.PerfTest <Count[,Count...]> [Seconds]
+	static void RunPerfTest(const TArray<FString>& Args, UWorld* World)
+	{
+		UMultiPlayerGamePerfTestSubsystem* PerfTest = World ? World->GetSubsystem<UMultiPlayerGamePerfTestSubsystem>() : nullptr;
+		if (PerfTest == nullptr || Args.Num() == 0)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Usage: MultiPlayerGame.PerfTest <Count[,Count...]> [Seconds]"));
+			return;
+		}
+		PerfTest->StartPerfTest(ParseCounts(Args[0]), Args.Num() > 1 ? FCString::Atof(*Args[1]) : 0.f, false);
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs PerfTestCommand(
+		TEXT("MultiPlayerGame.PerfTest"),
+		TEXT("Spawn N scripted characters and capture frame, thread and tick group timings to CSV and a json summary. Usage: MultiPlayerGame.PerfTest <Count[,Count...]> [Seconds]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunPerfTest));
+}
@@ -0,0 +1,133 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineBaseTypes.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "MultiPlayerGamePerfTestSubsystem.generated.h"
+
+class UMultiPlayerGamePerfTestSubsystem;
+
+//放在每个Tick组开头的标记，记录这个组开始的时间
+USTRUCT()
+struct FMultiPlayerGamePerfTestTickMarker : public FTickFunction
+{
+	GENERATED_BODY()
+
+	UMultiPlayerGamePerfTestSubsystem* Subsystem = nullptr;
+	int32 GroupIndex = 0;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FMultiPlayerGamePerfTestTickMarker> : public TStructOpsTypeTraitsBase2<FMultiPlayerGamePerfTestTickMarker>
+{
+	enum
+	{
+		WithCopy = false
+	};
+};
+
+/**
+ * 游戏线程性能测试：生成N个按脚本移动的角色，测一段时间的帧耗时，输出CSV和统计摘要，方便在同一台机器上对比不同版本。
+ * 命令行：MultiPlayerGame <地图> -PerfTest=1,50,200 -PerfTestMap=<地图> [-PerfTestSeconds=30] -nosound
+ * -PerfTestMap 必须给，只在这张图上测；地图路径写错时引擎会悄悄打开默认地图，这时直接报错退出，不会把别的图的数据当成结果。
+ * 依次测每个数量，每轮一个CSV（Saved/Profiling/CSV）和一个json摘要（Saved/PerfTest），全部测完后退出；
+ * 也可以在控制台用 MultiPlayerGame.PerfTest <数量> [秒数] 单独跑一轮。
+ * -PerfTestAnimClass=<动画类路径> 把生成的角色换成指定的动画实例类，同一张图上对比蓝图和原生动画实例的开销；
+ * -PerfTestDir=<目录> 指定json摘要的输出目录。
+ * 每帧记录帧时间、游戏线程、渲染线程、GPU时间，以及每个Tick组的大致耗时（相邻两个组开头标记的时间差）。
+ * 生成的角色由各自的AI控制器（角色的AIControllerClass）驱动，和服务器上有控制器的角色走同一条移动路径；
+ * 没有AI控制器类时才退回 bRunPhysicsWithNoController。地图、Pawn类、控制器和各项设置都写进日志和json。
+ */
+UCLASS(config = Game)
+class MULTIPLAYERGAME_API UMultiPlayerGamePerfTestSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+
+	//依次测试这些数量，bExitWhenDone时测完退出进程
+	void StartPerfTest(const TArray<int32>& CharacterCounts, float Seconds, bool bExitWhenDone);
+
+	void MarkTickGroupStart(int32 GroupIndex);
+
+	//生成角色后等多久才开始记录
+	UPROPERTY(Config)
+	float WarmupSeconds = 3.f;
+
+	UPROPERTY(Config)
+	float DefaultSeconds = 30.f;
+
+	//角色之间的间距
+	UPROPERTY(Config)
+	float CharacterSpacing = 250.f;
+
+private:
+	enum class EPhase : uint8
+	{
+		Idle,
+		Warmup,
+		Measure,
+	};
+
+	struct FFrameSample
+	{
+		float FrameMs = 0.f;
+		float GameThreadMs = 0.f;
+		float RenderThreadMs = 0.f;
+		float GPUMs = 0.f;
+	};
+
+	bool IsPerfTestMap(FString MapName) const;
+	void StartRun();
+	void FinishRun();
+	void SpawnCharacters(int32 Count);
+	void DestroyCharacters();
+	void DriveCharacters(float DeltaTime);
+	void RecordFrame(float DeltaTime);
+	void OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+	void RegisterTickMarkers();
+	void UnregisterTickMarkers();
+
+	//命令行指定的动画类，为空时用角色蓝图自己的
+	UPROPERTY(Transient)
+	TSubclassOf<class UAnimInstance> AnimClassOverride;
+	FString ReportDir;
+	//本轮实际用的Pawn类和控制器类，写进日志和json
+	FString PawnClassName;
+	FString ControllerClassName;
+
+	TArray<int32> PendingCounts;
+	int32 CurrentCount = 0;
+	float RunSeconds = 0.f;
+	float PhaseTime = 0.f;
+	float ScriptTime = 0.f;
+	EPhase Phase = EPhase::Idle;
+	bool bExitWhenDone = false;
+
+	UPROPERTY(Transient)
+	TArray<APawn*> SpawnedCharacters;
+
+	TArray<FFrameSample> FrameSamples;
+
+	static constexpr int32 NumTickGroups = 6;
+	FMultiPlayerGamePerfTestTickMarker TickMarkers[NumTickGroups];
+	FName TickGroupStatNames[NumTickGroups];
+	double TickGroupStartTimes[NumTickGroups] = {};
+	double TickGroupTotalMs[NumTickGroups] = {};
+	int32 NumTickGroupFrames = 0;
+	FDelegateHandle PostActorTickHandle;
+};
@@ -0,0 +1,18 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultiPlayerGamePlayerController.h"
+#include "MultiPlayerGamePawnPoolSubsystem.h"
+#include "Engine/World.h"
+
+void AMultiPlayerGamePlayerController::PawnLeavingGame()
+{
+	UWorld* World = GetWorld();
+	UMultiPlayerGamePawnPoolSubsystem* PawnPool = World ? World->GetSubsystem<UMultiPlayerGamePawnPoolSubsystem>() : nullptr;
+	if (PawnPool == nullptr || GetPawn() == nullptr || !HasAuthority())
+	{
+		Super::PawnLeavingGame();
+		return;
+	}
+	// 池满了ReleasePawn会自己销毁
+	PawnPool->ReleaseControllerPawn(this);
+}
@@ -0,0 +1,21 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/PlayerController.h"
+#include "MultiPlayerGamePlayerController.generated.h"
+
+/**
+ * 大厅和比赛共用的玩家控制器。
+ * 玩家断线时控制器在 Destroyed 里先处理Pawn再调用GameMode的Logout，
+ * 引擎默认的 PawnLeavingGame 会直接销毁Pawn，这里改成收回 UMultiPlayerGamePawnPoolSubsystem。
+ */
+UCLASS()
+class MULTIPLAYERGAME_API AMultiPlayerGamePlayerController : public APlayerController
+{
+	GENERATED_BODY()
+
+public:
+	virtual void PawnLeavingGame() override;
+};
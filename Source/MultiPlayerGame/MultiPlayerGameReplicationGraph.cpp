@@ -0,0 +1,131 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultiPlayerGameReplicationGraph.h"
+#include "MultiPlayerGameCharacter.h"
+#include "MultiPlayerGameStats.h"
+#include "Engine/NetDriver.h"
+#include "Engine/NetConnection.h"
+#include "GameFramework/PlayerState.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/GameStateBase.h"
+#include "Net/Core/PushModel/PushModel.h"
+#include "UObject/UObjectIterator.h"
+
+void UMultiPlayerGameReplicationGraph::InitGlobalActorClassSettings()
+{
+	// 父类按每个类CDO上的NetUpdateFrequency、剔除距离生成默认设置，这里只覆盖需要调整的类
+	Super::InitGlobalActorClassSettings();
+
+	FClassReplicationInfo CharacterInfo;
+	CharacterInfo.ReplicationPeriodFrame = GetReplicationPeriodFrameForFrequency(CharacterNetUpdateFrequency);
+	CharacterInfo.SetCullDistanceSquared(CharacterCullDistance * CharacterCullDistance);
+
+	FClassReplicationInfo PlayerStateInfo;
+	PlayerStateInfo.ReplicationPeriodFrame = GetReplicationPeriodFrameForFrequency(PlayerStateNetUpdateFrequency);
+	PlayerStateInfo.SetCullDistanceSquared(0.f);
+
+	// 父类已经按具体类登记了所有加载过的类（包括蓝图的ThirdPersonCharacter_C），只设基类的话实际在用的子类拿不到这些值
+	// 之后才加载的子类没有登记，查的时候会沿父类往上找到这里设的基类
+	GlobalActorReplicationInfoMap.SetClassInfo(AMultiPlayerGameCharacter::StaticClass(), CharacterInfo);
+	GlobalActorReplicationInfoMap.SetClassInfo(APlayerState::StaticClass(), PlayerStateInfo);
+	for (TObjectIterator<UClass> It; It; ++It)
+	{
+		UClass* Class = *It;
+		if (Class->GetName().StartsWith(TEXT("SKEL_")) || Class->GetName().StartsWith(TEXT("REINST_")))
+		{
+			continue;
+		}
+		if (Class->IsChildOf<AMultiPlayerGameCharacter>())
+		{
+			GlobalActorReplicationInfoMap.SetClassInfo(Class, CharacterInfo);
+		}
+		else if (Class->IsChildOf<APlayerState>())
+		{
+			GlobalActorReplicationInfoMap.SetClassInfo(Class, PlayerStateInfo);
+		}
+	}
+
+	// CSV里按类分开记复制耗时和字节数（含子类），其余的类合在Other里
+	CSVTracker.SetImplicitClassTracking(AMultiPlayerGameCharacter::StaticClass(), TEXT("Character"));
+	CSVTracker.SetImplicitClassTracking(APlayerState::StaticClass(), TEXT("PlayerState"));
+	CSVTracker.SetImplicitClassTracking(APlayerController::StaticClass(), TEXT("PlayerController"));
+	CSVTracker.SetImplicitClassTracking(AGameStateBase::StaticClass(), TEXT("GameState"));
+}
+
+void UMultiPlayerGameReplicationGraph::InitGlobalGraphNodes()
+{
+	Super::InitGlobalGraphNodes();
+
+	GridNode->CellSize = GridCellSize;
+	GridNode->SpatialBias = GridSpatialBias;
+
+	// 方便区分推送模式开关前后抓的CSV
+	CSV_METADATA(TEXT("PushModel"), IS_PUSH_MODEL_ENABLED() ? TEXT("1") : TEXT("0"));
+}
+
+void UMultiPlayerGameReplicationGraph::RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo)
+{
+	// 角色一直在动，按动态Actor放进网格，每帧更新所在的格子；池里的角色是DORM_DormantAll，休眠的Actor在复制时跳过，取出时再唤醒
+	if (ActorInfo.Actor->IsA<AMultiPlayerGameCharacter>())
+	{
+		GridNode->AddActor_Dynamic(ActorInfo, GlobalInfo);
+		SET_DWORD_STAT(STAT_MPG_RepGraphCharacters, ++NumCharacters);
+		return;
+	}
+	Super::RouteAddNetworkActorToNodes(ActorInfo, GlobalInfo);
+}
+
+void UMultiPlayerGameReplicationGraph::RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo)
+{
+	if (ActorInfo.Actor->IsA<AMultiPlayerGameCharacter>())
+	{
+		GridNode->RemoveActor_Dynamic(ActorInfo);
+		SET_DWORD_STAT(STAT_MPG_RepGraphCharacters, --NumCharacters);
+		return;
+	}
+	Super::RouteRemoveNetworkActorToNodes(ActorInfo);
+}
+
+int32 UMultiPlayerGameReplicationGraph::ServerReplicateActors(float DeltaSeconds)
+{
+	// 配合压测客户端（-AutoJoin）在16/64/128个连接下对比这项耗时
+	SCOPE_CYCLE_COUNTER(STAT_MPG_ServerReplicateActors);
+	CSV_SCOPED_TIMING_STAT(MultiPlayerGame, RepGraphServerReplicateActors);
+	const int32 NumConnections = NetDriver ? NetDriver->ClientConnections.Num() : 0;
+	SET_DWORD_STAT(STAT_MPG_RepGraphConnections, NumConnections);
+	CSV_CUSTOM_STAT(MultiPlayerGame, RepGraphConnections, NumConnections, ECsvCustomStatOp::Set);
+
+	const double StartTime = FPlatformTime::Seconds();
+	const int32 NumReplicated = Super::ServerReplicateActors(DeltaSeconds);
+	if (NumConnections > 0)
+	{
+		ServerReplicateActorsSeconds += FPlatformTime::Seconds() - StartTime;
+		++ServerReplicateActorsFrames;
+	}
+	return NumReplicated;
+}
+
+double UMultiPlayerGameReplicationGraph::GetAverageServerReplicateActorsMs() const
+{
+	return ServerReplicateActorsFrames > 0 ? ServerReplicateActorsSeconds * 1000.0 / ServerReplicateActorsFrames : 0.0;
+}
+
+void UMultiPlayerGameReplicationGraph::SetActorReplicationFrequency(AActor* Actor, UNetConnection* Connection, float Frequency)
+{
+	// 复制图不看Actor上的NetUpdateFrequency，每个连接各自缓存了一份复制间隔，直接改这里
+	UNetReplicationGraphConnection* ConnectionManager = Connection ? Cast<UNetReplicationGraphConnection>(Connection->GetReplicationConnectionDriver()) : nullptr;
+	if (ConnectionManager == nullptr)
+	{
+		return;
+	}
+	FConnectionReplicationActorInfo* ActorInfo = ConnectionManager->ActorInfoMap.Find(Actor);
+	if (ActorInfo == nullptr)
+	{
+		return;
+	}
+
+	const uint32 PeriodFrame = GetReplicationPeriodFrameForFrequency(Frequency);
+	ActorInfo->ReplicationPeriodFrame = static_cast<decltype(ActorInfo->ReplicationPeriodFrame)>(PeriodFrame);
+	// 频率提高时不用等完旧的间隔
+	ActorInfo->NextReplicationFrameNum = FMath::Min<uint32>(ActorInfo->NextReplicationFrameNum, ReplicationGraphFrame + PeriodFrame);
+}
@@ -0,0 +1,56 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BasicReplicationGraph.h"
+#include "MultiPlayerGameReplicationGraph.generated.h"
+
+/**
+ * 游戏的复制图：
+ * 角色放进二维空间网格，每个连接只收集附近格子里的角色，服务器开销不再随 玩家数 x Actor数 增长；
+ * GameState、PlayerState 这类 bAlwaysRelevant 的Actor放进全局的常驻节点；
+ * 其它会休眠的Actor按休眠状态进网格，每个连接单独处理休眠；只和拥有者相关的Actor放进该连接自己的节点。
+ */
+UCLASS(transient, config = Engine)
+class UMultiPlayerGameReplicationGraph : public UBasicReplicationGraph
+{
+	GENERATED_BODY()
+
+public:
+	virtual void InitGlobalActorClassSettings() override;
+	virtual void InitGlobalGraphNodes() override;
+	virtual void RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo) override;
+	virtual void RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo) override;
+	virtual int32 ServerReplicateActors(float DeltaSeconds) override;
+
+	//运行时调整某个Actor对某个连接的复制频率，由 UMultiPlayerGameNetUpdateSubsystem 按重要度调用
+	void SetActorReplicationFrequency(AActor* Actor, UNetConnection* Connection, float Frequency);
+
+	//网格单元的边长，角色的剔除距离应该比它大
+	UPROPERTY(Config)
+	float GridCellSize = 10000.f;
+
+	//网格的原点，地图坐标都要大于它
+	UPROPERTY(Config)
+	FVector2D GridSpatialBias = FVector2D(-150000.f, -150000.f);
+
+	//角色的复制频率和剔除距离
+	UPROPERTY(Config)
+	float CharacterNetUpdateFrequency = 100.f;
+
+	UPROPERTY(Config)
+	float CharacterCullDistance = 15000.f;
+
+	//PlayerState里大多是分数之类变化很慢的数据，不需要每帧复制
+	UPROPERTY(Config)
+	float PlayerStateNetUpdateFrequency = 2.f;
+
+	//开始复制以来有连接的帧里ServerReplicateActors的平均耗时，写进大厅的压测报告里对比推送模式开关前后
+	double GetAverageServerReplicateActorsMs() const;
+
+private:
+	int32 NumCharacters = 0;
+	double ServerReplicateActorsSeconds = 0.0;
+	int32 ServerReplicateActorsFrames = 0;
+};
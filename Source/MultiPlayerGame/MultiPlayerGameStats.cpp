@@ -0,0 +1,33 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultiPlayerGameStats.h"
+
+DEFINE_STAT(STAT_MPG_ServerReplicateActors);
+DEFINE_STAT(STAT_MPG_RepGraphConnections);
+DEFINE_STAT(STAT_MPG_RepGraphCharacters);
+DEFINE_STAT(STAT_MPG_MoveRPCs);
+DEFINE_STAT(STAT_MPG_MoveRPCBits);
+DEFINE_STAT(STAT_MPG_ReceivedMoveRPCBits);
+DEFINE_STAT(STAT_MPG_NetUpdateScheduler);
+DEFINE_STAT(STAT_MPG_AverageCharacterNetUpdateFrequency);
+DEFINE_STAT(STAT_MPG_IdleCharacters);
+DEFINE_STAT(STAT_MPG_AnimSignificance);
+DEFINE_STAT(STAT_MPG_AnimHighCharacters);
+DEFINE_STAT(STAT_MPG_AnimOffCharacters);
+DEFINE_STAT(STAT_MPG_AnimPreUpdate);
+DEFINE_STAT(STAT_MPG_AnimProxyUpdate);
+DEFINE_STAT(STAT_MPG_PawnPoolSize);
+DEFINE_STAT(STAT_MPG_PawnPoolHits);
+DEFINE_STAT(STAT_MPG_PawnPoolMisses);
+DEFINE_STAT(STAT_MPG_PawnPoolAcquireMs);
+DEFINE_STAT(STAT_MPG_PawnSpawnMs);
+DEFINE_STAT(STAT_MPG_PawnPoolSavedMs);
+DEFINE_STAT(STAT_MPG_LagCompensationRecord);
+DEFINE_STAT(STAT_MPG_LagCompensationRewind);
+DEFINE_STAT(STAT_MPG_LagCompensationMemory);
+DEFINE_STAT(STAT_MPG_OutBytesPerCharacter);
+DEFINE_STAT(STAT_MPG_InBytesPerConnection);
+DEFINE_STAT(STAT_MPG_MoveRPCBytesPerCharacter);
+DEFINE_STAT(STAT_MPG_ServerNetFlushMs);
+
+CSV_DEFINE_CATEGORY_MODULE(MULTIPLAYERGAME_API, MultiPlayerGame, true);
@@ -0,0 +1,56 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+/**
+ * 游戏模块的性能统计：stat MultiPlayerGame 查看，CSV分类为 MultiPlayerGame
+ */
+DECLARE_STATS_GROUP(TEXT("MultiPlayerGame"), STATGROUP_MultiPlayerGame, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("RepGraph ServerReplicateActors"), STAT_MPG_ServerReplicateActors, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("RepGraph Connections"), STAT_MPG_RepGraphConnections, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("RepGraph Characters"), STAT_MPG_RepGraphCharacters, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+
+// 客户端发给服务器的打包移动RPC：每帧的条数和位数，用 MultiPlayerGame.CompactMoves 切换格式对比
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Move RPCs"), STAT_MPG_MoveRPCs, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Move RPC Bits"), STAT_MPG_MoveRPCBits, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Received Move RPC Bits"), STAT_MPG_ReceivedMoveRPCBits, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+
+// 按重要度调整角色复制频率
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Net Update Scheduler"), STAT_MPG_NetUpdateScheduler, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Average Character Net Update Hz"), STAT_MPG_AverageCharacterNetUpdateFrequency, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Idle Characters"), STAT_MPG_IdleCharacters, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+
+// 客户端角色动画的重要度调度
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Anim Significance"), STAT_MPG_AnimSignificance, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Anim Full Rate Characters"), STAT_MPG_AnimHighCharacters, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Anim Disabled Characters"), STAT_MPG_AnimOffCharacters, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+
+// 原生动画实例：游戏线程上的拷贝和工作线程上的计算分开统计
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Anim PreUpdate (GameThread)"), STAT_MPG_AnimPreUpdate, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Anim Proxy Update"), STAT_MPG_AnimProxyUpdate, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+
+// Pawn池：命中、未命中、取出和新生成的耗时，以及累计省下的时间
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Pawn Pool Size"), STAT_MPG_PawnPoolSize, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Pawn Pool Hits"), STAT_MPG_PawnPoolHits, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Pawn Pool Misses"), STAT_MPG_PawnPoolMisses, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Pawn Pool Acquire (ms)"), STAT_MPG_PawnPoolAcquireMs, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Pawn Spawn (ms)"), STAT_MPG_PawnSpawnMs, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Pawn Pool Saved (ms)"), STAT_MPG_PawnPoolSavedMs, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+
+// 延迟补偿的记录、回溯耗时和历史占用的内存
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Lag Compensation Record"), STAT_MPG_LagCompensationRecord, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Lag Compensation Rewind"), STAT_MPG_LagCompensationRewind, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Lag Compensation History"), STAT_MPG_LagCompensationMemory, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+
+// 带宽监控：每个连接、每个角色每秒的字节数，以及服务器每帧网络驱动TickFlush的耗时
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Out Bytes/Character/s"), STAT_MPG_OutBytesPerCharacter, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("In Bytes/Connection/s"), STAT_MPG_InBytesPerConnection, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Move RPC Bytes/Character/s"), STAT_MPG_MoveRPCBytesPerCharacter, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Server Net Flush (ms)"), STAT_MPG_ServerNetFlushMs, STATGROUP_MultiPlayerGame, MULTIPLAYERGAME_API);
+
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(MULTIPLAYERGAME_API, MultiPlayerGame);
@@ -0,0 +1,18 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+using UnrealBuildTool;
+using System.Collections.Generic;
+
+public class MultiPlayerGameServerTarget : TargetRules
+{
+	public MultiPlayerGameServerTarget(TargetInfo Target) : base(Target)
+	{
+		Type = TargetType.Server;
+		DefaultBuildSettings = BuildSettingsVersion.V2;
+		//推送模式只编进专用服务器：改这个开关要用独立的编译环境，需要源码版引擎，
+		//游戏和编辑器目标保持共享环境，用安装版引擎也能编；编辑器里的listen服务器仍是轮询复制
+		BuildEnvironment = TargetBuildEnvironment.Unique;
+		bWithPushModel = true;
+		ExtraModuleNames.Add("MultiPlayerGame");
+	}
+}